@@ -0,0 +1,137 @@
+#include "acpi.h"
+#include "mmio.h"
+
+typedef struct {
+    char signature[8];           // "RSD PTR "
+    uint8_t checksum;            // Первые 20 байт
+    char oem[6];
+    uint8_t revision;            // 2 и выше - есть XSDT
+    uint32_t rsdt;
+    uint32_t length;
+    uint64_t xsdt;
+    uint8_t extended_checksum;
+    uint8_t reserved[3];
+} __attribute__((packed)) acpi_rsdp_t;
+
+typedef struct {
+    char signature[4];
+    uint32_t length;             // Вместе с заголовком
+    uint8_t revision;
+    uint8_t checksum;
+    char oem[6];
+    char oem_table[8];
+    uint32_t oem_revision;
+    uint32_t creator;
+    uint32_t creator_revision;
+} __attribute__((packed)) acpi_header_t;
+
+typedef struct {
+    acpi_header_t header;
+    uint32_t apic_base;
+    uint32_t flags;
+} __attribute__((packed)) acpi_madt_header_t;
+
+static int signature_is(const char* signature, const char* expected, uint32_t length) {
+    for (uint32_t i = 0; i < length; i++) {
+        if (signature[i] != expected[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static uint8_t checksum(const uint8_t* data, uint32_t length) {
+    uint8_t sum = 0;
+    for (uint32_t i = 0; i < length; i++) {
+        sum += data[i];
+    }
+    return sum;
+}
+
+static acpi_rsdp_t* scan_rsdp(uint64_t start, uint64_t end) {
+    for (uint64_t address = start; address + sizeof(acpi_rsdp_t) <= end; address += 16) {
+        acpi_rsdp_t* rsdp = (acpi_rsdp_t*)address;
+        if (signature_is(rsdp->signature, "RSD PTR ", 8) && checksum((const uint8_t*)rsdp, 20) == 0) {
+            return rsdp;
+        }
+    }
+    return NULL;
+}
+
+// Таблица целиком: сначала заголовок, затем вся длина
+static acpi_header_t* map_table(uint64_t phys) {
+    acpi_header_t* header = mmio_map(phys, sizeof(acpi_header_t));
+    if (!header || header->length < sizeof(acpi_header_t)) {
+        return NULL;
+    }
+    if (!mmio_map(phys, header->length) || checksum((const uint8_t*)header, header->length) != 0) {
+        return NULL;
+    }
+    return header;
+}
+
+// Элементы RSDT - 32-битные адреса, XSDT - 64-битные, без выравнивания
+static acpi_header_t* find_table(const acpi_rsdp_t* rsdp, const char* signature) {
+    int extended = rsdp->revision >= 2 && rsdp->xsdt;
+    acpi_header_t* root = map_table(extended ? rsdp->xsdt : rsdp->rsdt);
+    if (!root) {
+        return NULL;
+    }
+    uint32_t entry_size = extended ? 8 : 4;
+    const uint8_t* entries = (const uint8_t*)root + sizeof(acpi_header_t);
+    uint32_t count = (root->length - sizeof(acpi_header_t)) / entry_size;
+    for (uint32_t i = 0; i < count; i++) {
+        uint64_t address = 0;
+        for (uint32_t b = 0; b < entry_size; b++) {
+            address |= (uint64_t)entries[i * entry_size + b] << (b * 8);
+        }
+        acpi_header_t* table = map_table(address);
+        if (table && signature_is(table->signature, signature, 4)) {
+            return table;
+        }
+    }
+    return NULL;
+}
+
+int acpi_read_madt(acpi_madt_t* madt) {
+    // Адрес в нулевой странице компилятор считает недействительным,
+    // поэтому указатель проходит через пустую вставку
+    volatile uint16_t* ebda_pointer = (volatile uint16_t*)ACPI_EBDA_POINTER;
+    asm("" : "+r"(ebda_pointer));
+    uint64_t ebda = (uint64_t)*ebda_pointer << 4;
+    acpi_rsdp_t* rsdp = NULL;
+    if (ebda) {
+        rsdp = scan_rsdp(ebda, ebda + 1024);
+    }
+    if (!rsdp) {
+        rsdp = scan_rsdp(ACPI_BIOS_START, ACPI_BIOS_END);
+    }
+    if (!rsdp) {
+        return -1;
+    }
+    acpi_madt_header_t* header = (acpi_madt_header_t*)find_table(rsdp, "APIC");
+    if (!header) {
+        return -1;
+    }
+
+    madt->apic_base = header->apic_base;
+    madt->cpu_count = 0;
+    const uint8_t* entry = (const uint8_t*)header + sizeof(acpi_madt_header_t);
+    const uint8_t* end = (const uint8_t*)header + header->header.length;
+    while (entry + 2 <= end && entry[1] >= 2 && entry + entry[1] <= end) {
+        if (entry[0] == ACPI_MADT_LOCAL_APIC && entry[1] >= 8) {
+            // Идентификатор процессора ACPI, идентификатор APIC, флаги
+            if ((entry[4] & ACPI_MADT_ENABLED) && madt->cpu_count < ACPI_MAX_CPUS) {
+                madt->apic_ids[madt->cpu_count++] = entry[3];
+            }
+        } else if (entry[0] == ACPI_MADT_APIC_OVERRIDE && entry[1] >= 12) {
+            uint64_t base = 0;
+            for (uint32_t b = 0; b < 8; b++) {
+                base |= (uint64_t)entry[4 + b] << (b * 8);
+            }
+            madt->apic_base = base;
+        }
+        entry += entry[1];
+    }
+    return madt->cpu_count ? 0 : -1;
+}
@@ -0,0 +1,31 @@
+#ifndef ACPI_H
+#define ACPI_H
+
+#include "stdint.h"
+
+// Где BIOS оставляет RSDP: первый килобайт EBDA (сегмент по адресу
+// 0x40E) и область ROM 0xE0000-0xFFFFF, с шагом 16 байт
+#define ACPI_EBDA_POINTER 0x40E
+#define ACPI_BIOS_START   0xE0000
+#define ACPI_BIOS_END     0x100000
+
+// Записи MADT: локальный APIC процессора и 64-битный адрес APIC
+#define ACPI_MADT_LOCAL_APIC    0
+#define ACPI_MADT_APIC_OVERRIDE 5
+#define ACPI_MADT_ENABLED       0x01
+
+#define ACPI_MAX_CPUS 16
+
+// Процессоры из MADT
+typedef struct {
+    uint64_t apic_base;
+    uint32_t cpu_count;
+    uint8_t apic_ids[ACPI_MAX_CPUS];
+} acpi_madt_t;
+
+// Поиск RSDP, RSDT/XSDT и разбор MADT ("APIC"). Таблицы читаются
+// через mmio_map, так как могут лежать выше первого гигабайта.
+// Возвращает -1, если ACPI или MADT нет.
+int acpi_read_madt(acpi_madt_t* madt);
+
+#endif
@@ -0,0 +1,429 @@
+#include "ahci.h"
+#include "pci.h"
+#include "mmio.h"
+#include "io.h"
+#include "idt.h"
+#include "pic.h"
+#include "clock.h"
+
+// Предел опроса (итераций) до признания порта зависшим
+#define AHCI_TIMEOUT 10000000
+// Удержание COMRESET (не меньше 1 мс)
+#define AHCI_COMRESET_NS 1000000
+
+// Непрерывный кусок буфера запроса
+typedef struct {
+    void* buffer;
+    uint32_t count;    // Секторов
+} ahci_segment_t;
+
+// Запущенный порт с диском. Слот занят, пока команда выдана (issued)
+// или завершена, но ее результат не забран тем, кто ее выдал (done).
+typedef struct {
+    ahci_hba_regs_t* hba;
+    ahci_port_regs_t* regs;
+    uint32_t index;          // Номер порта в HBA
+    uint32_t slot_mask;      // Доступные слоты
+    uint8_t ncq;             // Команды выдаются в очередь диска (FPDMA QUEUED)
+    ahci_cmd_header_t* cmd_list;
+    ahci_cmd_table_t* tables;
+    volatile uint32_t issued;
+    volatile uint32_t done;
+    volatile uint32_t failed;  // Завершены с ошибкой (подмножество done)
+    block_request_t* slot_req[AHCI_MAX_SLOTS];  // Цепочка очереди в слоте
+    uint32_t stall;            // Опросов подряд без завершений
+    volatile uint32_t irq_status;  // PxIS, подтвержденный обработчиком прерывания
+} ahci_port_t;
+
+static ahci_port_t ports[AHCI_MAX_PORTS];
+static uint32_t port_count = 0;
+static block_device_t ahci_devs[AHCI_MAX_PORTS];
+static const char* ahci_names[AHCI_MAX_PORTS] = { "ahci0", "ahci1", "ahci2", "ahci3" };
+
+// Структуры в памяти, которые читает HBA. Ядро отображено один к одному,
+// поэтому адрес в них - это адрес переменной.
+static ahci_cmd_header_t cmd_lists[AHCI_MAX_PORTS][AHCI_MAX_SLOTS] __attribute__((aligned(1024)));
+static uint8_t received_fis[AHCI_MAX_PORTS][256] __attribute__((aligned(256)));
+static ahci_cmd_table_t cmd_tables[AHCI_MAX_PORTS][AHCI_MAX_SLOTS] __attribute__((aligned(128)));
+static uint16_t identify_buf[256];
+
+static void clear_bytes(void* ptr, uint32_t size) {
+    uint8_t* p = (uint8_t*)ptr;
+    for (uint32_t i = 0; i < size; i++) {
+        p[i] = 0;
+    }
+}
+
+// Ожидание, пока в регистре сброшены биты mask
+static int wait_clear(volatile uint32_t* reg, uint32_t mask) {
+    for (uint32_t i = 0; i < AHCI_TIMEOUT; i++) {
+        if (!(*reg & mask)) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Остановка обработки списка команд и приема FIS
+static int port_stop(ahci_port_regs_t* regs) {
+    regs->cmd &= ~AHCI_PORT_CMD_ST;
+    if (wait_clear(&regs->cmd, AHCI_PORT_CMD_CR) < 0) {
+        return -1;
+    }
+    regs->cmd &= ~AHCI_PORT_CMD_FRE;
+    return wait_clear(&regs->cmd, AHCI_PORT_CMD_FR);
+}
+
+// Запуск порта после сброса ошибок. Если диск остался занят,
+// выполняется COMRESET.
+static int port_start(ahci_port_regs_t* regs) {
+    regs->serr = 0xFFFFFFFF;
+    regs->is = 0xFFFFFFFF;
+    regs->cmd |= AHCI_PORT_CMD_FRE;
+    if (wait_clear(&regs->tfd, AHCI_TFD_BSY | AHCI_TFD_DRQ) < 0) {
+        regs->sctl = (regs->sctl & ~0xFu) | 1;
+        clock_delay_ns(AHCI_COMRESET_NS);
+        regs->sctl &= ~0xFu;
+        if (wait_clear(&regs->tfd, AHCI_TFD_BSY | AHCI_TFD_DRQ) < 0) {
+            return -1;
+        }
+        regs->serr = 0xFFFFFFFF;
+    }
+    regs->cmd |= AHCI_PORT_CMD_ST;
+    return 0;
+}
+
+// Перезапуск порта после ошибки. Все выданные команды завершаются
+// с ошибкой: какая из очереди NCQ сбойная, не выясняется.
+static void port_recover(ahci_port_t* p) {
+    uint32_t lost = p->issued;
+    p->issued = 0;
+    port_stop(p->regs);
+    port_start(p->regs);
+    p->failed |= lost;
+    p->done |= lost;
+}
+
+// Разбор завершений порта
+static void port_handle(ahci_port_t* p) {
+    uint32_t is = p->regs->is;
+    p->regs->is = is;
+    p->hba->is = 1u << p->index;
+    is |= __atomic_exchange_n(&p->irq_status, 0, __ATOMIC_RELAXED);
+    if (is & AHCI_PORT_IS_ERROR) {
+        port_recover(p);
+        return;
+    }
+    // Команда выполнена, когда HBA снял ее бит в PxCI,
+    // а для NCQ диск еще и снял бит в PxSACT
+    uint32_t finished = p->issued & ~(p->regs->sact | p->regs->ci);
+    p->issued &= ~finished;
+    p->done |= finished;
+}
+
+// Ожидание завершения хотя бы одной из команд pending.
+// Возвращает завершенные команды, забирая их результат. Служебные
+// команды (IDENTIFY, сброс кэша) ждут опросом: первая выдается до
+// включения прерываний.
+static uint32_t port_reap(ahci_port_t* p, uint32_t pending, uint32_t* failed) {
+    for (uint32_t i = 0; !(p->done & pending); i++) {
+        if (i == AHCI_TIMEOUT) {
+            port_recover(p);  // Диск не отвечает
+            break;
+        }
+        port_handle(p);
+    }
+    uint32_t finished = p->done & pending;
+    *failed |= p->failed & finished;
+    p->failed &= ~finished;
+    p->done &= ~finished;
+    return finished;
+}
+
+// Заполнение слота и выдача команды. Буфер задается кусками, которые
+// раскладываются по PRDT. Возвращает -1, если куски не помещаются в PRDT.
+static int port_issue(ahci_port_t* p, uint32_t slot, uint8_t command, uint64_t lba, uint32_t count,
+                      const ahci_segment_t* segs, uint32_t seg_count, int write) {
+    ahci_cmd_header_t* header = &p->cmd_list[slot];
+    ahci_cmd_table_t* table = &p->tables[slot];
+    clear_bytes(table, 128);
+
+    uint32_t prds = 0;
+    for (uint32_t s = 0; s < seg_count; s++) {
+        uint64_t address = (uint64_t)segs[s].buffer;
+        uint32_t bytes = segs[s].count * BLOCK_SECTOR_SIZE;
+        while (bytes) {
+            if (prds == AHCI_PRDT_ENTRIES) {
+                return -1;
+            }
+            uint32_t chunk = bytes < AHCI_PRD_MAX_BYTES ? bytes : AHCI_PRD_MAX_BYTES;
+            ahci_prd_t* prd = &table->prdt[prds++];
+            prd->dba = (uint32_t)address;
+            prd->dbau = (uint32_t)(address >> 32);
+            prd->reserved = 0;
+            prd->dbc = chunk - 1;
+            address += chunk;
+            bytes -= chunk;
+        }
+    }
+    if (prds) {
+        table->prdt[prds - 1].dbc |= 1u << 31;
+    }
+
+    // FIS "регистры от хоста к устройству"
+    uint8_t* fis = table->cfis;
+    fis[0] = AHCI_FIS_REG_H2D;
+    fis[1] = 0x80;  // Команда, а не управление
+    fis[2] = command;
+    fis[4] = lba;
+    fis[5] = lba >> 8;
+    fis[6] = lba >> 16;
+    fis[7] = command == AHCI_CMD_IDENTIFY ? 0 : 0x40;  // Режим LBA
+    fis[8] = lba >> 24;
+    fis[9] = lba >> 32;
+    fis[10] = lba >> 40;
+    if (command == AHCI_CMD_READ_FPDMA || command == AHCI_CMD_WRITE_FPDMA) {
+        // В NCQ счетчик секторов - в регистре свойств, а в счетчике - номер слота
+        fis[3] = count;
+        fis[11] = count >> 8;
+        fis[12] = slot << 3;
+    } else {
+        fis[12] = count;
+        fis[13] = count >> 8;
+    }
+
+    header->flags = 5 | (write ? 0x40 : 0);  // FIS - 5 двойных слов
+    header->prdtl = prds;
+    header->prdbc = 0;
+
+    p->issued |= 1u << slot;
+    asm volatile("" : : : "memory");  // Таблица заполнена до выдачи команды
+    if (command == AHCI_CMD_READ_FPDMA || command == AHCI_CMD_WRITE_FPDMA) {
+        p->regs->sact = 1u << slot;
+    }
+    p->regs->ci = 1u << slot;
+    return 0;
+}
+
+// Одиночная команда вне очереди NCQ, когда у порта нет других команд
+static int port_command(ahci_port_t* p, uint8_t command, void* buffer, uint32_t bytes) {
+    ahci_segment_t seg = { buffer, bytes / BLOCK_SECTOR_SIZE };
+    uint32_t failed = 0;
+    if (port_issue(p, 0, command, 0, 0, &seg, buffer ? 1 : 0, 0) < 0) {
+        return -1;
+    }
+    port_reap(p, 1, &failed);
+    return failed ? -1 : 0;
+}
+
+// Завершение команд очереди: разобранные слоты отдаются block_complete.
+// Если выданные команды долго не завершаются, порт перезапускается.
+static void port_complete(ahci_port_t* p) {
+    uint32_t before = p->done;
+    port_handle(p);
+    if (p->issued && p->done == before) {
+        if (++p->stall >= AHCI_TIMEOUT) {
+            port_recover(p);
+        }
+    } else {
+        p->stall = 0;
+    }
+    for (uint32_t slot = 0; slot < AHCI_MAX_SLOTS; slot++) {
+        block_request_t* req = p->slot_req[slot];
+        if (!req || !(p->done & (1u << slot))) {
+            continue;
+        }
+        int status = p->failed & (1u << slot) ? -1 : 0;
+        p->slot_req[slot] = NULL;
+        p->done &= ~(1u << slot);
+        p->failed &= ~(1u << slot);
+        block_complete(req, status);
+    }
+}
+
+// Прерывание подтверждается, состояние порта запоминается для
+// port_handle, и ожидающие потоки просыпаются. Завершения разбирает
+// ahci_poll из block_poll в разбуженном потоке, вне обработчика, чтобы
+// очередь не менялась посреди block_submit.
+void ahci_irq(void) {
+    int events = 0;
+    for (uint32_t i = 0; i < port_count; i++) {
+        ahci_port_t* p = &ports[i];
+        uint32_t is = p->regs->is;
+        if (!is) {
+            continue;
+        }
+        p->regs->is = is;
+        p->hba->is = 1u << p->index;
+        __atomic_fetch_or(&p->irq_status, is, __ATOMIC_RELAXED);
+        events = 1;
+    }
+    if (events) {
+        block_irq();
+    }
+}
+
+// Выдача цепочки очереди одной командой: сектора идут подряд,
+// буфер каждого запроса - отдельный кусок PRDT. С NCQ диск выполняет
+// до 32 таких команд параллельно и в удобном ему порядке.
+static int ahci_start(block_device_t* dev, block_request_t* req) {
+    ahci_port_t* p = (ahci_port_t*)dev->driver_data;
+    uint32_t free = p->slot_mask & ~(p->issued | p->done);
+    if (!free) {
+        return -1;
+    }
+    uint32_t slot = __builtin_ctz(free);
+    uint8_t command;
+    if (p->ncq) {
+        command = req->write ? AHCI_CMD_WRITE_FPDMA : AHCI_CMD_READ_FPDMA;
+    } else {
+        command = req->write ? AHCI_CMD_WRITE_DMA_EXT : AHCI_CMD_READ_DMA_EXT;
+    }
+
+    ahci_segment_t segs[BLOCK_MERGE_MAX_REQUESTS];
+    uint32_t seg_count = 0;
+    for (block_request_t* part = req; part && seg_count < BLOCK_MERGE_MAX_REQUESTS; part = part->merged) {
+        segs[seg_count].buffer = part->buffer;
+        segs[seg_count].count = part->count;
+        seg_count++;
+    }
+    p->slot_req[slot] = req;
+    if (port_issue(p, slot, command, req->lba, req->span, segs, seg_count, req->write) < 0) {
+        p->slot_req[slot] = NULL;
+        block_complete(req, -1);
+    }
+    return 0;
+}
+
+static void ahci_poll(block_device_t* dev) {
+    port_complete((ahci_port_t*)dev->driver_data);
+}
+
+static int ahci_flush(block_device_t* dev) {
+    return port_command((ahci_port_t*)dev->driver_data, AHCI_CMD_FLUSH_CACHE_EXT, NULL, 0);
+}
+
+// Запуск порта с диском и IDENTIFY. Возвращает количество секторов
+// или 0, если диск не подходит.
+static uint64_t port_setup(ahci_port_t* p, uint32_t hba_slots, int hba_ncq) {
+    ahci_port_regs_t* regs = p->regs;
+    uint32_t ssts = regs->ssts;
+    // Устройство подключено (DET = 3) и активно (IPM = 1), это SATA-диск
+    if ((ssts & 0xF) != 3 || ((ssts >> 8) & 0xF) != 1 || regs->sig != AHCI_SIG_ATA) {
+        return 0;
+    }
+    if (port_stop(regs) < 0) {
+        return 0;
+    }
+
+    clear_bytes(p->cmd_list, sizeof(ahci_cmd_header_t) * AHCI_MAX_SLOTS);
+    clear_bytes(p->tables, sizeof(ahci_cmd_table_t) * AHCI_MAX_SLOTS);
+    for (uint32_t slot = 0; slot < AHCI_MAX_SLOTS; slot++) {
+        uint64_t table = (uint64_t)&p->tables[slot];
+        p->cmd_list[slot].ctba = (uint32_t)table;
+        p->cmd_list[slot].ctbau = (uint32_t)(table >> 32);
+    }
+    uint64_t cmd_list = (uint64_t)p->cmd_list;
+    uint64_t fis = (uint64_t)received_fis[p - ports];
+    clear_bytes(received_fis[p - ports], 256);
+    regs->clb = (uint32_t)cmd_list;
+    regs->clbu = (uint32_t)(cmd_list >> 32);
+    regs->fb = (uint32_t)fis;
+    regs->fbu = (uint32_t)(fis >> 32);
+    regs->cmd |= AHCI_PORT_CMD_SUD | AHCI_PORT_CMD_POD;
+    p->issued = 0;
+    p->done = 0;
+    p->failed = 0;
+    p->stall = 0;
+    p->irq_status = 0;
+    for (uint32_t slot = 0; slot < AHCI_MAX_SLOTS; slot++) {
+        p->slot_req[slot] = NULL;
+    }
+    p->ncq = 0;
+    p->slot_mask = 1;
+    if (port_start(regs) < 0) {
+        return 0;
+    }
+    regs->ie = AHCI_PORT_IS_DHRS | AHCI_PORT_IS_PSS | AHCI_PORT_IS_SDBS | AHCI_PORT_IS_ERROR;
+
+    if (port_command(p, AHCI_CMD_IDENTIFY, identify_buf, sizeof(identify_buf)) < 0) {
+        return 0;
+    }
+    // Нужна 48-битная адресация: команды DMA EXT и FPDMA QUEUED
+    if (!(identify_buf[83] & (1 << 10))) {
+        return 0;
+    }
+    uint64_t sectors = (uint64_t)identify_buf[100] | (uint64_t)identify_buf[101] << 16 |
+                       (uint64_t)identify_buf[102] << 32 | (uint64_t)identify_buf[103] << 48;
+
+    // Глубина очереди - меньшая из возможностей HBA и диска
+    uint32_t depth = hba_slots;
+    if (hba_ncq && (identify_buf[76] & (1 << 8))) {
+        uint32_t queue = (identify_buf[75] & 0x1F) + 1;
+        depth = queue < depth ? queue : depth;
+        p->ncq = 1;
+    }
+    p->slot_mask = depth == 32 ? 0xFFFFFFFF : (1u << depth) - 1;
+    return sectors;
+}
+
+int ahci_init(void) {
+    int controllers = 0;
+    int found = 0;
+    pci_device_t* pci;
+    for (uint32_t c = 0; (pci = pci_find_class(AHCI_PCI_CLASS, AHCI_PCI_SUBCLASS, AHCI_PCI_PROG_IF, c)); c++) {
+        controllers++;
+        int is_io;
+        uint64_t abar = pci_bar_address(pci, AHCI_ABAR, &is_io);
+        if (is_io || !abar) {
+            continue;
+        }
+        ahci_hba_regs_t* hba = (ahci_hba_regs_t*)mmio_map(abar, sizeof(ahci_hba_regs_t));
+        if (!hba) {
+            continue;
+        }
+        pci_enable(pci);
+        hba->ghc |= AHCI_GHC_AE;
+
+        uint32_t slots = ((hba->cap >> 8) & 0x1F) + 1;
+        int ncq = (hba->cap & AHCI_CAP_SNCQ) != 0;
+        uint32_t implemented = hba->pi;
+        uint32_t first = port_count;
+        for (uint32_t n = 0; n < 32 && port_count < AHCI_MAX_PORTS; n++) {
+            if (!(implemented & (1u << n))) {
+                continue;
+            }
+            ahci_port_t* p = &ports[port_count];
+            p->hba = hba;
+            p->regs = &hba->ports[n];
+            p->index = n;
+            p->cmd_list = cmd_lists[port_count];
+            p->tables = cmd_tables[port_count];
+            uint64_t sectors = port_setup(p, slots, ncq);
+            if (!sectors) {
+                continue;
+            }
+
+            block_device_t* dev = &ahci_devs[port_count];
+            dev->name = ahci_names[port_count];
+            dev->sector_count = sectors;
+            dev->read = NULL;
+            dev->write = NULL;
+            dev->driver_data = p;
+            dev->flush = ahci_flush;
+            dev->start = ahci_start;
+            dev->poll = ahci_poll;
+            port_count++;
+            if (block_register(dev) >= 0) {
+                found++;
+            }
+        }
+        hba->is = 0xFFFFFFFF;
+        hba->ghc |= AHCI_GHC_IE;
+        uint8_t irq = pci->irq_line < PIC_IRQ_COUNT && irq_register(pci->irq_line, ahci_irq) == 0;
+        for (uint32_t i = first; i < port_count; i++) {
+            ahci_devs[i].irq = irq;
+        }
+    }
+    return controllers ? found : -1;
+}
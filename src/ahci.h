@@ -0,0 +1,147 @@
+#ifndef AHCI_H
+#define AHCI_H
+
+#include "stdint.h"
+#include "block.h"
+
+// Класс контроллера AHCI в PCI: запоминающее устройство, SATA, AHCI 1.0
+#define AHCI_PCI_CLASS    0x01
+#define AHCI_PCI_SUBCLASS 0x06
+#define AHCI_PCI_PROG_IF  0x01
+// Регистры HBA - в BAR5 (ABAR)
+#define AHCI_ABAR 5
+
+// Максимум обслуживаемых портов и слотов команд на порт
+#define AHCI_MAX_PORTS 4
+#define AHCI_MAX_SLOTS 32
+// Элементов PRDT в таблице команды: столько непрерывных кусков памяти
+// может собрать одна команда (не меньше BLOCK_MERGE_MAX_REQUESTS)
+#define AHCI_PRDT_ENTRIES 64
+// Наибольший кусок PRDT (ограничение поля длины)
+#define AHCI_PRD_MAX_BYTES 0x400000
+
+// Биты CAP
+#define AHCI_CAP_S64A (1u << 31)
+#define AHCI_CAP_SNCQ (1u << 30)
+#define AHCI_CAP_SSS  (1u << 27)
+
+// Биты GHC
+#define AHCI_GHC_AE (1u << 31)
+#define AHCI_GHC_IE (1u << 1)
+
+// Биты PxCMD
+#define AHCI_PORT_CMD_ST  (1u << 0)
+#define AHCI_PORT_CMD_SUD (1u << 1)
+#define AHCI_PORT_CMD_POD (1u << 2)
+#define AHCI_PORT_CMD_FRE (1u << 4)
+#define AHCI_PORT_CMD_FR  (1u << 14)
+#define AHCI_PORT_CMD_CR  (1u << 15)
+
+// Биты PxIS / PxIE
+#define AHCI_PORT_IS_DHRS (1u << 0)   // Пришел D2H Register FIS
+#define AHCI_PORT_IS_PSS  (1u << 1)   // Пришел PIO Setup FIS
+#define AHCI_PORT_IS_SDBS (1u << 3)   // Пришел Set Device Bits FIS (завершение NCQ)
+#define AHCI_PORT_IS_IFS  (1u << 27)
+#define AHCI_PORT_IS_HBDS (1u << 28)
+#define AHCI_PORT_IS_HBFS (1u << 29)
+#define AHCI_PORT_IS_TFES (1u << 30)  // Ошибка в регистре задачи
+#define AHCI_PORT_IS_ERROR (AHCI_PORT_IS_IFS | AHCI_PORT_IS_HBDS | AHCI_PORT_IS_HBFS | AHCI_PORT_IS_TFES)
+
+// Биты PxTFD (копия регистра состояния ATA)
+#define AHCI_TFD_ERR 0x01
+#define AHCI_TFD_DRQ 0x08
+#define AHCI_TFD_BSY 0x80
+
+// Сигнатура SATA-диска в PxSIG
+#define AHCI_SIG_ATA 0x00000101
+
+// Тип FIS: регистры от хоста к устройству
+#define AHCI_FIS_REG_H2D 0x27
+
+// Команды ATA
+#define AHCI_CMD_READ_DMA_EXT    0x25
+#define AHCI_CMD_WRITE_DMA_EXT   0x35
+#define AHCI_CMD_READ_FPDMA      0x60
+#define AHCI_CMD_WRITE_FPDMA     0x61
+#define AHCI_CMD_FLUSH_CACHE_EXT 0xEA
+#define AHCI_CMD_IDENTIFY        0xEC
+
+// Регистры порта
+typedef volatile struct {
+    uint32_t clb;      // Адрес списка команд
+    uint32_t clbu;
+    uint32_t fb;       // Адрес области принятых FIS
+    uint32_t fbu;
+    uint32_t is;
+    uint32_t ie;
+    uint32_t cmd;
+    uint32_t reserved0;
+    uint32_t tfd;
+    uint32_t sig;
+    uint32_t ssts;
+    uint32_t sctl;
+    uint32_t serr;
+    uint32_t sact;     // Выполняемые команды NCQ
+    uint32_t ci;       // Выданные команды
+    uint32_t sntf;
+    uint32_t fbs;
+    uint32_t reserved1[15];
+} ahci_port_regs_t;
+
+// Регистры HBA
+typedef volatile struct {
+    uint32_t cap;
+    uint32_t ghc;
+    uint32_t is;
+    uint32_t pi;       // Реализованные порты
+    uint32_t vs;
+    uint32_t ccc_ctl;
+    uint32_t ccc_ports;
+    uint32_t em_loc;
+    uint32_t em_ctl;
+    uint32_t cap2;
+    uint32_t bohc;
+    uint8_t reserved[0x100 - 0x2C];
+    ahci_port_regs_t ports[32];
+} ahci_hba_regs_t;
+
+// Заголовок команды в списке команд порта
+typedef struct {
+    uint16_t flags;    // Длина FIS в двойных словах, бит 6 - запись
+    uint16_t prdtl;    // Элементов PRDT
+    uint32_t prdbc;    // Передано байт
+    uint32_t ctba;     // Адрес таблицы команды
+    uint32_t ctbau;
+    uint32_t reserved[4];
+} ahci_cmd_header_t;
+
+// Элемент PRDT: непрерывный кусок памяти
+typedef struct {
+    uint32_t dba;
+    uint32_t dbau;
+    uint32_t reserved;
+    uint32_t dbc;      // Длина - 1, бит 31 - прерывание по завершении
+} ahci_prd_t;
+
+// Таблица команды: FIS команды и PRDT
+typedef struct {
+    uint8_t cfis[64];
+    uint8_t acmd[16];
+    uint8_t reserved[48];
+    ahci_prd_t prdt[AHCI_PRDT_ENTRIES];
+} ahci_cmd_table_t;
+
+// Поиск контроллеров AHCI среди найденных pci_init функций, запуск
+// портов с подключенными SATA-дисками и регистрация дисков как блочных
+// устройств "ahci0", "ahci1", ... Драйвер асинхронный: каждая цепочка
+// очереди блочного уровня - одна команда, диски с NCQ получают до 32
+// одновременно выполняемых команд. Возвращает количество дисков или -1, если
+// контроллеров нет.
+int ahci_init(void);
+
+// Обработчик прерывания контроллера (линия PCI подключается в ahci_init):
+// подтверждает прерывания портов и будит ожидающих (block_irq),
+// завершения разбирает block_poll
+void ahci_irq(void);
+
+#endif
@@ -0,0 +1,67 @@
+#include "apic.h"
+#include "mmio.h"
+#include "clock.h"
+
+#define APIC_SOFTWARE_ENABLE 0x100
+#define APIC_REGION_SIZE 0x1000
+
+static volatile uint8_t* apic_base = NULL;
+// Отсчетов таймера (с делителем 16) на тик планировщика
+static uint32_t timer_ticks_per_tick = 0;
+
+static uint32_t apic_read(uint32_t reg) {
+    return *(volatile uint32_t*)(apic_base + reg);
+}
+
+static void apic_write(uint32_t reg, uint32_t value) {
+    *(volatile uint32_t*)(apic_base + reg) = value;
+}
+
+// Замер таймера APIC: однократный счет с маскированным прерыванием,
+// пока TSC отмеряет APIC_CALIBRATE_NS
+static void calibrate_timer(void) {
+    apic_write(APIC_TIMER_DIV, APIC_TIMER_DIVIDE_16);
+    apic_write(APIC_LVT_TIMER, APIC_LVT_MASKED | APIC_TIMER_VECTOR);
+    apic_write(APIC_TIMER_INIT, 0xFFFFFFFF);
+    clock_delay_ns(APIC_CALIBRATE_NS);
+    uint32_t elapsed = 0xFFFFFFFF - apic_read(APIC_TIMER_COUNT);
+    apic_write(APIC_TIMER_INIT, 0);
+    timer_ticks_per_tick = (uint64_t)elapsed * CLOCK_TICK_NS / APIC_CALIBRATE_NS;
+}
+
+int apic_init(uint64_t base) {
+    apic_base = mmio_map(base, APIC_REGION_SIZE);
+    if (!apic_base) {
+        return -1;
+    }
+    apic_write(APIC_SPURIOUS, APIC_SOFTWARE_ENABLE | APIC_SPURIOUS_VECTOR);
+    calibrate_timer();
+    return 0;
+}
+
+// Прерывания устройств получает только загрузочный процессор, поэтому
+// линии LINT здесь закрыты
+void apic_init_ap(void) {
+    apic_write(APIC_SPURIOUS, APIC_SOFTWARE_ENABLE | APIC_SPURIOUS_VECTOR);
+    apic_write(APIC_LVT_LINT0, APIC_LVT_MASKED);
+    apic_write(APIC_LVT_LINT1, APIC_LVT_MASKED);
+    apic_write(APIC_TIMER_DIV, APIC_TIMER_DIVIDE_16);
+    apic_write(APIC_LVT_TIMER, APIC_TIMER_PERIODIC | APIC_TIMER_VECTOR);
+    apic_write(APIC_TIMER_INIT, timer_ticks_per_tick);
+}
+
+uint32_t apic_id(void) {
+    return apic_read(APIC_ID) >> 24;
+}
+
+void apic_eoi(void) {
+    apic_write(APIC_EOI, 0);
+}
+
+void apic_send_ipi(uint32_t apic_id, uint32_t command) {
+    apic_write(APIC_ICR_HIGH, apic_id << 24);
+    apic_write(APIC_ICR_LOW, command);
+    while (apic_read(APIC_ICR_LOW) & APIC_ICR_PENDING) {
+        asm volatile("pause");
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef APIC_H
+#define APIC_H
+
+#include "stdint.h"
+
+// Регистры локального APIC (смещения от базы)
+#define APIC_ID          0x020
+#define APIC_EOI         0x0B0
+#define APIC_SPURIOUS    0x0F0
+#define APIC_ICR_LOW     0x300
+#define APIC_ICR_HIGH    0x310
+#define APIC_LVT_TIMER   0x320
+#define APIC_LVT_LINT0   0x350
+#define APIC_LVT_LINT1   0x360
+#define APIC_TIMER_INIT  0x380
+#define APIC_TIMER_COUNT 0x390
+#define APIC_TIMER_DIV   0x3E0
+
+// Векторы локальных прерываний: выше линий PIC, ложное - с младшими
+// битами 1111, как требуют старые APIC
+#define APIC_TIMER_VECTOR    0x30
+#define APIC_RESCHED_VECTOR  0x31
+#define APIC_SPURIOUS_VECTOR 0x3F
+
+// Таймер отсчитывает такты шины, деленные на 16; калибровка по TSC
+#define APIC_TIMER_DIVIDE_16   0x03
+#define APIC_TIMER_PERIODIC    0x20000
+#define APIC_LVT_MASKED        0x10000
+#define APIC_CALIBRATE_NS      10000000ull
+
+// Межпроцессорные прерывания: фиксированное, INIT, SIPI
+#define APIC_ICR_FIXED   0x00000
+#define APIC_ICR_INIT    0x00500
+#define APIC_ICR_STARTUP 0x00600
+#define APIC_ICR_ASSERT  0x04000
+#define APIC_ICR_PENDING 0x01000
+
+// Отображение регистров и включение APIC этого процессора; на
+// загрузочном также замер частоты таймера. Линии LINT остаются как
+// есть: через LINT0 загрузочного процессора приходят прерывания PIC.
+// Возвращает -1, если регистры не отображаются.
+int apic_init(uint64_t base);
+// Включение APIC процессора приложений с периодическим таймером
+// на частоте тика планировщика
+void apic_init_ap(void);
+uint32_t apic_id(void);
+void apic_eoi(void);
+void apic_send_ipi(uint32_t apic_id, uint32_t command);
+
+#endif
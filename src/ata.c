@@ -0,0 +1,215 @@
+#include "ata.h"
+#include "io.h"
+
+// Предел опроса состояния (итераций) до признания устройства зависшим
+#define ATA_TIMEOUT 10000000
+
+// Диск первичного канала
+typedef struct {
+    uint8_t slave;       // 0 - ведущий, 1 - ведомый
+    uint8_t lba48;       // Поддерживается 48-битная адресация
+    uint16_t multiple;   // Секторов на блок DRQ в READ/WRITE MULTIPLE (0 - по одному)
+} ata_drive_t;
+
+static ata_drive_t drives[2];
+static block_device_t ata_devs[2];
+static const char* ata_names[2] = { "ata0", "ata1" };
+static uint16_t identify_buf[256];
+
+// Задержка около 400 нс после выбора диска или команды:
+// четыре чтения альтернативного регистра состояния
+static void ata_delay(void) {
+    for (int i = 0; i < 4; i++) {
+        inb(ATA_PRIMARY_CTRL);
+    }
+}
+
+// Ожидание снятия BSY. Возвращает состояние или -1 по таймауту.
+static int ata_wait_idle(void) {
+    for (uint32_t i = 0; i < ATA_TIMEOUT; i++) {
+        uint8_t status = inb(ATA_PRIMARY_CTRL);
+        if (!(status & ATA_SR_BSY)) {
+            return status;
+        }
+    }
+    return -1;
+}
+
+// Ожидание готовности очередного блока данных
+static int ata_wait_drq(void) {
+    int status = ata_wait_idle();
+    if (status < 0 || (status & (ATA_SR_ERR | ATA_SR_DF)) || !(status & ATA_SR_DRQ)) {
+        return -1;
+    }
+    return 0;
+}
+
+// Ожидание завершения команды без ошибки
+static int ata_wait_done(void) {
+    int status = ata_wait_idle();
+    return status < 0 || (status & (ATA_SR_ERR | ATA_SR_DF)) ? -1 : 0;
+}
+
+// Выбор диска, загрузка адреса и количества секторов, выдача команды.
+// Для LBA48 старшие байты записываются в регистры первыми.
+static int ata_command(const ata_drive_t* d, uint8_t cmd, uint64_t lba, uint32_t count) {
+    if (ata_wait_idle() < 0) {
+        return -1;
+    }
+    if (d->lba48) {
+        outb(ATA_PRIMARY_IO + ATA_REG_DRIVE, 0x40 | d->slave << 4);
+        ata_delay();
+        outb(ATA_PRIMARY_IO + ATA_REG_SECCOUNT, count >> 8);
+        outb(ATA_PRIMARY_IO + ATA_REG_LBA0, lba >> 24);
+        outb(ATA_PRIMARY_IO + ATA_REG_LBA1, lba >> 32);
+        outb(ATA_PRIMARY_IO + ATA_REG_LBA2, lba >> 40);
+    } else {
+        outb(ATA_PRIMARY_IO + ATA_REG_DRIVE, 0xE0 | d->slave << 4 | ((lba >> 24) & 0x0F));
+        ata_delay();
+    }
+    outb(ATA_PRIMARY_IO + ATA_REG_SECCOUNT, count);
+    outb(ATA_PRIMARY_IO + ATA_REG_LBA0, lba);
+    outb(ATA_PRIMARY_IO + ATA_REG_LBA1, lba >> 8);
+    outb(ATA_PRIMARY_IO + ATA_REG_LBA2, lba >> 16);
+    outb(ATA_PRIMARY_IO + ATA_REG_COMMAND, cmd);
+    ata_delay();
+    return 0;
+}
+
+// Передача секторов. Запрос делится на команды по максимуму регистра
+// счетчика (65536 для LBA48, 256 для LBA28), каждая команда - на блоки
+// по d->multiple секторов, которые переносятся одной rep insw/outsw.
+static int ata_transfer(block_device_t* dev, uint64_t lba, uint32_t count, uint8_t* buffer, int write) {
+    const ata_drive_t* d = (const ata_drive_t*)dev->driver_data;
+    uint32_t max = d->lba48 ? 65536 : 256;
+    uint32_t block = d->multiple ? d->multiple : 1;
+    uint8_t cmd;
+    if (d->lba48) {
+        cmd = write ? (d->multiple ? ATA_CMD_WRITE_MULTIPLE_EXT : ATA_CMD_WRITE_PIO_EXT)
+                    : (d->multiple ? ATA_CMD_READ_MULTIPLE_EXT : ATA_CMD_READ_PIO_EXT);
+    } else {
+        cmd = write ? (d->multiple ? ATA_CMD_WRITE_MULTIPLE : ATA_CMD_WRITE_PIO)
+                    : (d->multiple ? ATA_CMD_READ_MULTIPLE : ATA_CMD_READ_PIO);
+    }
+
+    while (count) {
+        uint32_t n = count < max ? count : max;
+        // Счетчик 0 в регистре означает максимум
+        if (ata_command(d, cmd, lba, n & (max - 1)) < 0) {
+            return -1;
+        }
+        for (uint32_t done = 0; done < n;) {
+            uint32_t chunk = n - done < block ? n - done : block;
+            if (ata_wait_drq() < 0) {
+                return -1;
+            }
+            if (write) {
+                outsw(ATA_PRIMARY_IO + ATA_REG_DATA, buffer, chunk * BLOCK_SECTOR_SIZE / 2);
+            } else {
+                insw(ATA_PRIMARY_IO + ATA_REG_DATA, buffer, chunk * BLOCK_SECTOR_SIZE / 2);
+            }
+            ata_delay();
+            buffer += chunk * BLOCK_SECTOR_SIZE;
+            done += chunk;
+        }
+        if (ata_wait_done() < 0) {
+            return -1;
+        }
+        lba += n;
+        count -= n;
+    }
+    return 0;
+}
+
+static int ata_read(block_device_t* dev, uint64_t lba, uint32_t count, void* buffer) {
+    return ata_transfer(dev, lba, count, (uint8_t*)buffer, 0);
+}
+
+static int ata_write(block_device_t* dev, uint64_t lba, uint32_t count, const void* buffer) {
+    return ata_transfer(dev, lba, count, (uint8_t*)buffer, 1);
+}
+
+static int ata_flush(block_device_t* dev) {
+    const ata_drive_t* d = (const ata_drive_t*)dev->driver_data;
+    if (ata_command(d, d->lba48 ? ATA_CMD_FLUSH_CACHE_EXT : ATA_CMD_FLUSH_CACHE, 0, 0) < 0) {
+        return -1;
+    }
+    return ata_wait_done();
+}
+
+// IDENTIFY DEVICE: наличие диска, адресация, размер и наибольший блок
+// READ/WRITE MULTIPLE, который затем включается командой SET MULTIPLE MODE.
+// Возвращает количество секторов или 0, если ATA-диска нет.
+static uint64_t ata_identify(uint8_t slave, ata_drive_t* d) {
+    outb(ATA_PRIMARY_IO + ATA_REG_DRIVE, 0xA0 | slave << 4);
+    ata_delay();
+    outb(ATA_PRIMARY_IO + ATA_REG_SECCOUNT, 0);
+    outb(ATA_PRIMARY_IO + ATA_REG_LBA0, 0);
+    outb(ATA_PRIMARY_IO + ATA_REG_LBA1, 0);
+    outb(ATA_PRIMARY_IO + ATA_REG_LBA2, 0);
+    outb(ATA_PRIMARY_IO + ATA_REG_COMMAND, ATA_CMD_IDENTIFY);
+    ata_delay();
+    if (inb(ATA_PRIMARY_IO + ATA_REG_STATUS) == 0 || ata_wait_idle() < 0) {
+        return 0;  // Диска нет
+    }
+    if (inb(ATA_PRIMARY_IO + ATA_REG_LBA1) || inb(ATA_PRIMARY_IO + ATA_REG_LBA2)) {
+        return 0;  // ATAPI или SATA в собственном режиме - не наш случай
+    }
+    if (ata_wait_drq() < 0) {
+        return 0;
+    }
+    insw(ATA_PRIMARY_IO + ATA_REG_DATA, identify_buf, 256);
+    if (!(identify_buf[49] & (1 << 9))) {
+        return 0;  // Без LBA
+    }
+
+    d->slave = slave;
+    d->lba48 = (identify_buf[83] >> 10) & 1;
+    uint64_t sectors;
+    if (d->lba48) {
+        sectors = (uint64_t)identify_buf[100] | (uint64_t)identify_buf[101] << 16 |
+                  (uint64_t)identify_buf[102] << 32 | (uint64_t)identify_buf[103] << 48;
+    } else {
+        sectors = (uint32_t)identify_buf[60] | (uint32_t)identify_buf[61] << 16;
+    }
+
+    d->multiple = 0;
+    uint16_t max_multiple = identify_buf[47] & 0xFF;
+    if (max_multiple &&
+        ata_command(d, ATA_CMD_SET_MULTIPLE, 0, max_multiple) == 0 && ata_wait_done() == 0) {
+        d->multiple = max_multiple;
+    }
+    return sectors;
+}
+
+int ata_init(void) {
+    if (inb(ATA_PRIMARY_IO + ATA_REG_STATUS) == 0xFF) {
+        return 0;  // Плавающая шина: контроллера нет
+    }
+    // Программный сброс канала, прерывания устройства запрещены:
+    // драйвер опрашивает состояние
+    outb(ATA_PRIMARY_CTRL, ATA_CTRL_SRST | ATA_CTRL_NIEN);
+    ata_delay();
+    outb(ATA_PRIMARY_CTRL, ATA_CTRL_NIEN);
+    ata_delay();
+    ata_wait_idle();
+
+    int found = 0;
+    for (uint8_t slave = 0; slave < 2; slave++) {
+        uint64_t sectors = ata_identify(slave, &drives[slave]);
+        if (!sectors) {
+            continue;
+        }
+        block_device_t* dev = &ata_devs[slave];
+        dev->name = ata_names[slave];
+        dev->sector_count = sectors;
+        dev->read = ata_read;
+        dev->write = ata_write;
+        dev->driver_data = &drives[slave];
+        dev->flush = ata_flush;
+        if (block_register(dev) >= 0) {
+            found++;
+        }
+    }
+    return found;
+}
@@ -0,0 +1,54 @@
+#ifndef ATA_H
+#define ATA_H
+
+#include "stdint.h"
+#include "block.h"
+
+// Порты первичного канала ATA
+#define ATA_PRIMARY_IO   0x1F0
+#define ATA_PRIMARY_CTRL 0x3F6
+
+// Регистры относительно ATA_PRIMARY_IO
+#define ATA_REG_DATA     0
+#define ATA_REG_ERROR    1
+#define ATA_REG_FEATURES 1
+#define ATA_REG_SECCOUNT 2
+#define ATA_REG_LBA0     3
+#define ATA_REG_LBA1     4
+#define ATA_REG_LBA2     5
+#define ATA_REG_DRIVE    6
+#define ATA_REG_STATUS   7
+#define ATA_REG_COMMAND  7
+
+// Биты регистра состояния
+#define ATA_SR_BSY  0x80
+#define ATA_SR_DRDY 0x40
+#define ATA_SR_DF   0x20
+#define ATA_SR_DRQ  0x08
+#define ATA_SR_ERR  0x01
+
+// Биты регистра управления устройством
+#define ATA_CTRL_NIEN 0x02  // Запрет прерываний
+#define ATA_CTRL_SRST 0x04  // Программный сброс
+
+// Команды
+#define ATA_CMD_READ_PIO          0x20
+#define ATA_CMD_READ_PIO_EXT      0x24
+#define ATA_CMD_READ_MULTIPLE_EXT 0x29
+#define ATA_CMD_WRITE_PIO         0x30
+#define ATA_CMD_WRITE_PIO_EXT     0x34
+#define ATA_CMD_WRITE_MULTIPLE_EXT 0x39
+#define ATA_CMD_READ_MULTIPLE     0xC4
+#define ATA_CMD_WRITE_MULTIPLE    0xC5
+#define ATA_CMD_SET_MULTIPLE      0xC6
+#define ATA_CMD_FLUSH_CACHE       0xE7
+#define ATA_CMD_FLUSH_CACHE_EXT   0xEA
+#define ATA_CMD_IDENTIFY          0xEC
+
+// Поиск дисков на первичном канале (ведущий и ведомый) и регистрация
+// найденных как блочных устройств "ata0" и "ata1". Обмен идет в режиме PIO
+// с опросом состояния, прерывания устройства запрещены.
+// Возвращает количество найденных дисков.
+int ata_init(void);
+
+#endif
@@ -0,0 +1,314 @@
+#include "bcache.h"
+
+// Буферы и их данные
+static bcache_buf_t bufs[BCACHE_BUFFERS];
+static uint8_t buf_data[BCACHE_BUFFERS][BLOCK_SECTOR_SIZE];
+// Хеш-таблица по (устройство, LBA), цепочки через hash_next
+static int32_t hash_heads[BCACHE_HASH_BUCKETS];
+// Список LRU: в голове недавно использованные, в хвосте кандидаты на вытеснение
+static int32_t lru_head = -1;
+static int32_t lru_tail = -1;
+// Асинхронные запросы буферов (по одному на буфер, пока стоит BCACHE_BUSY)
+static block_request_t buf_reqs[BCACHE_BUFFERS];
+static uint32_t io_in_flight = 0;
+static uint32_t write_errors = 0;
+
+static bcache_stats_t stats;
+
+static uint32_t bcache_bucket(block_device_t* dev, uint64_t lba) {
+    uint32_t key = (uint32_t)lba ^ (uint32_t)((uint64_t)dev >> 4);
+    return (key * 2654435761u) >> 22 & (BCACHE_HASH_BUCKETS - 1);
+}
+
+static void lru_unlink(int32_t i) {
+    if (bufs[i].lru_prev == -1) {
+        lru_head = bufs[i].lru_next;
+    } else {
+        bufs[bufs[i].lru_prev].lru_next = bufs[i].lru_next;
+    }
+    if (bufs[i].lru_next == -1) {
+        lru_tail = bufs[i].lru_prev;
+    } else {
+        bufs[bufs[i].lru_next].lru_prev = bufs[i].lru_prev;
+    }
+}
+
+static void lru_push_front(int32_t i) {
+    bufs[i].lru_prev = -1;
+    bufs[i].lru_next = lru_head;
+    if (lru_head == -1) {
+        lru_tail = i;
+    } else {
+        bufs[lru_head].lru_prev = i;
+    }
+    lru_head = i;
+}
+
+static void lru_push_back(int32_t i) {
+    bufs[i].lru_next = -1;
+    bufs[i].lru_prev = lru_tail;
+    if (lru_tail == -1) {
+        lru_head = i;
+    } else {
+        bufs[lru_tail].lru_next = i;
+    }
+    lru_tail = i;
+}
+
+static void hash_insert(int32_t i) {
+    uint32_t b = bcache_bucket(bufs[i].dev, bufs[i].lba);
+    bufs[i].hash_next = hash_heads[b];
+    hash_heads[b] = i;
+}
+
+static void hash_remove(int32_t i) {
+    int32_t* link = &hash_heads[bcache_bucket(bufs[i].dev, bufs[i].lba)];
+    while (*link != -1) {
+        if (*link == i) {
+            *link = bufs[i].hash_next;
+            break;
+        }
+        link = &bufs[*link].hash_next;
+    }
+    bufs[i].hash_next = -1;
+    bufs[i].dev = NULL;
+    bufs[i].flags = 0;
+}
+
+static int32_t lookup(block_device_t* dev, uint64_t lba) {
+    for (int32_t i = hash_heads[bcache_bucket(dev, lba)]; i != -1; i = bufs[i].hash_next) {
+        if (bufs[i].dev == dev && bufs[i].lba == lba) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void bcache_init(void) {
+    // Буферы нельзя переиспользовать, пока они в очереди устройства
+    while (io_in_flight) {
+        block_poll_wait();
+    }
+    write_errors = 0;
+    for (uint32_t i = 0; i < BCACHE_HASH_BUCKETS; i++) {
+        hash_heads[i] = -1;
+    }
+    lru_head = -1;
+    lru_tail = -1;
+    for (int32_t i = 0; i < BCACHE_BUFFERS; i++) {
+        bufs[i].dev = NULL;
+        bufs[i].lba = 0;
+        bufs[i].flags = 0;
+        bufs[i].refcount = 0;
+        bufs[i].hash_next = -1;
+        bufs[i].data = buf_data[i];
+        lru_push_back(i);
+    }
+    bcache_stats_t empty = {0};
+    stats = empty;
+}
+
+// Выбор буфера для повторного использования: самый давний незакрепленный.
+// Грязный буфер перед вытеснением записывается на устройство.
+static int32_t evict(void) {
+    for (int32_t i = lru_tail; i != -1; i = bufs[i].lru_prev) {
+        if (bufs[i].refcount) {
+            continue;
+        }
+        if (bufs[i].flags & BCACHE_DIRTY) {
+            if (block_write(bufs[i].dev, bufs[i].lba, 1, bufs[i].data) < 0) {
+                continue;
+            }
+            stats.writebacks++;
+        }
+        if (bufs[i].dev) {
+            stats.evictions++;
+            if (bufs[i].flags & BCACHE_READAHEAD) {
+                stats.readahead_wasted++;
+            }
+            hash_remove(i);
+        }
+        return i;
+    }
+    return -1;  // Все буферы закреплены
+}
+
+// Постановка обмена буфера с устройством в очередь. Буфер закрепляется
+// и помечается BCACHE_BUSY до завершения. Устройство без очереди
+// (не зарегистрированное) обслуживается сразу.
+static void buf_submit(int32_t i, uint8_t write, void (*done)(block_request_t*, int)) {
+    block_request_t* req = &buf_reqs[i];
+    req->dev = bufs[i].dev;
+    req->lba = bufs[i].lba;
+    req->count = 1;
+    req->write = write;
+    req->buffer = bufs[i].data;
+    req->done = done;
+    req->context = NULL;
+    bufs[i].flags |= BCACHE_BUSY;
+    bufs[i].refcount++;
+    io_in_flight++;
+    if (block_submit(req) < 0) {
+        int status = write ? block_write(req->dev, req->lba, 1, req->buffer)
+                           : block_read(req->dev, req->lba, 1, req->buffer);
+        done(req, status);
+    }
+}
+
+static int32_t buf_io_done(block_request_t* req) {
+    int32_t i = (int32_t)(req - buf_reqs);
+    bufs[i].flags &= ~BCACHE_BUSY;
+    bufs[i].refcount--;
+    io_in_flight--;
+    return i;
+}
+
+static void readahead_done(block_request_t* req, int status) {
+    int32_t i = buf_io_done(req);
+    if (status < 0) {
+        hash_remove(i);
+        lru_unlink(i);
+        lru_push_back(i);
+        return;
+    }
+    bufs[i].flags |= BCACHE_VALID;
+    stats.readahead++;
+}
+
+static void writeback_done(block_request_t* req, int status) {
+    int32_t i = buf_io_done(req);
+    if (status < 0) {
+        bufs[i].flags |= BCACHE_DIRTY;
+        write_errors++;
+        return;
+    }
+    stats.writebacks++;
+}
+
+static bcache_buf_t* bcache_lookup_or_fill(block_device_t* dev, uint64_t lba, int fill) {
+    int32_t i = lookup(dev, lba);
+    // Обмен с устройством еще идет: ждем (неудачное чтение убирает буфер)
+    while (i != -1 && (bufs[i].flags & BCACHE_BUSY)) {
+        block_poll_wait();
+        i = lookup(dev, lba);
+    }
+    if (i != -1) {
+        stats.hits++;
+        if (bufs[i].flags & BCACHE_READAHEAD) {
+            bufs[i].flags &= ~BCACHE_READAHEAD;
+            stats.readahead_hits++;
+        }
+    } else {
+        stats.misses++;
+        i = evict();
+        if (i == -1) {
+            return NULL;
+        }
+        bufs[i].dev = dev;
+        bufs[i].lba = lba;
+        hash_insert(i);
+        if (fill && block_read(dev, lba, 1, bufs[i].data) < 0) {
+            hash_remove(i);
+            return NULL;
+        }
+        bufs[i].flags = BCACHE_VALID;
+    }
+
+    bufs[i].refcount++;
+    lru_unlink(i);
+    lru_push_front(i);
+    return &bufs[i];
+}
+
+bcache_buf_t* bcache_get(block_device_t* dev, uint64_t lba) {
+    return bcache_lookup_or_fill(dev, lba, 1);
+}
+
+bcache_buf_t* bcache_get_nofill(block_device_t* dev, uint64_t lba) {
+    return bcache_lookup_or_fill(dev, lba, 0);
+}
+
+void bcache_release(bcache_buf_t* buf) {
+    if (buf->refcount) {
+        buf->refcount--;
+    }
+}
+
+void bcache_mark_dirty(bcache_buf_t* buf) {
+    buf->flags |= BCACHE_VALID | BCACHE_DIRTY;
+}
+
+// Фоновая запись: грязные буферы устройства ставятся в очередь без
+// ожидания, соседние сектора очередь сливает в одну команду, и очередь
+// сразу выдается устройству. Возвращает количество поставленных секторов.
+uint32_t bcache_writeback(block_device_t* dev) {
+    uint32_t count = 0;
+    for (int32_t i = 0; i < BCACHE_BUFFERS; i++) {
+        if (bufs[i].dev != dev || (bufs[i].flags & (BCACHE_DIRTY | BCACHE_BUSY)) != BCACHE_DIRTY) {
+            continue;
+        }
+        // Изменение во время записи снова пометит буфер грязным
+        bufs[i].flags &= ~BCACHE_DIRTY;
+        buf_submit(i, 1, writeback_done);
+        count++;
+    }
+    if (count) {
+        block_poll();
+    }
+    return count;
+}
+
+// Запись всех грязных буферов устройства с ожиданием завершения
+int bcache_flush(block_device_t* dev) {
+    write_errors = 0;
+    uint32_t submitted;
+    do {
+        submitted = bcache_writeback(dev);
+        while (io_in_flight) {
+            block_poll_wait();
+        }
+    } while (submitted && !write_errors);
+    return write_errors ? -1 : 0;
+}
+
+// Опережающее чтение: отсутствующие в кэше сектора диапазона ставятся
+// в очередь без ожидания. Соседние сектора очередь сливает в один запрос,
+// bcache_get дождется сектора, если он еще читается.
+void bcache_readahead(block_device_t* dev, uint64_t lba, uint32_t count) {
+    for (uint64_t end = lba + count; lba < end; lba++) {
+        if (lookup(dev, lba) != -1) {
+            continue;
+        }
+        int32_t i = evict();
+        if (i == -1) {
+            break;
+        }
+        bufs[i].dev = dev;
+        bufs[i].lba = lba;
+        bufs[i].flags = BCACHE_READAHEAD;
+        hash_insert(i);
+        lru_unlink(i);
+        lru_push_front(i);
+        buf_submit(i, 0, readahead_done);
+    }
+    block_poll();
+}
+
+void bcache_invalidate(block_device_t* dev, uint64_t lba) {
+    int32_t i = lookup(dev, lba);
+    if (i == -1) {
+        return;
+    }
+    if (bufs[i].refcount) {
+        // Буфер кем-то закреплен, только отменяем запись
+        bufs[i].flags &= ~BCACHE_DIRTY;
+        return;
+    }
+    hash_remove(i);
+    lru_unlink(i);
+    lru_push_back(i);
+}
+
+void bcache_get_stats(bcache_stats_t* out) {
+    *out = stats;
+}
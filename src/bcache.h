@@ -0,0 +1,63 @@
+#ifndef BCACHE_H
+#define BCACHE_H
+
+#include "stdint.h"
+#include "block.h"
+
+// Количество буферов (бюджет памяти: BCACHE_BUFFERS * 512 байт)
+#define BCACHE_BUFFERS 512
+// Количество корзин хеш-таблицы (степень двойки)
+#define BCACHE_HASH_BUCKETS 1024
+// Максимум секторов в одном опережающем чтении
+#define BCACHE_MAX_RUN 64
+
+// Флаги буфера
+#define BCACHE_VALID     0x01  // Данные прочитаны или полностью записаны
+#define BCACHE_DIRTY     0x02  // Требуется запись на устройство
+#define BCACHE_READAHEAD 0x04  // Прочитан заранее и еще не запрашивался
+#define BCACHE_BUSY      0x08  // Запрос к устройству еще не завершен
+
+// Буфер одного сектора
+typedef struct {
+    block_device_t* dev;
+    uint64_t lba;
+    uint32_t flags;
+    uint32_t refcount;      // Закрепления: такой буфер не вытесняется
+    int32_t hash_next;
+    int32_t lru_prev;
+    int32_t lru_next;
+    uint8_t* data;
+} bcache_buf_t;
+
+// Счетчики кэша
+typedef struct {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint64_t writebacks;      // Сектора, записанные на устройство
+    uint64_t readahead;       // Сектора, прочитанные заранее
+    uint64_t readahead_hits;  // Из них затем запрошенные
+    uint64_t readahead_wasted; // Вытеснены, так и не понадобившись
+} bcache_stats_t;
+
+void bcache_init(void);
+
+// Получение буфера с данными сектора (закрепляет буфер)
+bcache_buf_t* bcache_get(block_device_t* dev, uint64_t lba);
+// Получение буфера без чтения, для полной перезаписи сектора
+bcache_buf_t* bcache_get_nofill(block_device_t* dev, uint64_t lba);
+void bcache_release(bcache_buf_t* buf);
+void bcache_mark_dirty(bcache_buf_t* buf);
+
+// Политики записи и опережающего чтения. Запросы асинхронные: они
+// выдаются устройству сразу, а завершаются в block_poll (в ядре - поток
+// io по прерыванию диска); bcache_flush дожидается записи.
+uint32_t bcache_writeback(block_device_t* dev);
+int bcache_flush(block_device_t* dev);
+void bcache_readahead(block_device_t* dev, uint64_t lba, uint32_t count);
+// Отбрасывание сектора (например, освобожденного блока)
+void bcache_invalidate(block_device_t* dev, uint64_t lba);
+
+void bcache_get_stats(bcache_stats_t* stats);
+
+#endif
@@ -0,0 +1,432 @@
+#include "block.h"
+#include "io.h"
+
+// Частей синхронного обмена через очередь, ожидаемых одновременно
+#define BLOCK_SYNC_PARTS 8
+
+// Очередь запросов устройства
+typedef struct {
+    block_request_t* head;     // Ожидающие выдачи, по возрастанию LBA
+    uint64_t position;         // LBA за последней выданной цепочкой (для лифта)
+    uint32_t in_flight;        // Цепочек у драйвера
+    uint32_t depth;
+    block_queue_stats_t stats;
+} block_queue_t;
+
+// Зарегистрированные устройства и их очереди
+static block_device_t* devices[BLOCK_MAX_DEVICES];
+static block_queue_t queues[BLOCK_MAX_DEVICES];
+static uint32_t device_count = 0;
+
+// Завершенные цепочки и прерывания устройств (счетчики для ожидания)
+static uint64_t completions = 0;
+static volatile uint32_t irq_events = 0;
+static void (*irq_sleep)(volatile uint32_t* events, uint32_t seen) = NULL;
+static void (*irq_wake)(void) = NULL;
+
+int block_register(block_device_t* dev) {
+    for (uint32_t i = 0; i < device_count; i++) {
+        if (devices[i] == dev) {
+            return i;
+        }
+    }
+    if (device_count >= BLOCK_MAX_DEVICES ||
+        !((dev->read && dev->write) || (dev->start && dev->poll))) {
+        return -1;
+    }
+    block_queue_t* q = &queues[device_count];
+    q->head = NULL;
+    q->position = 0;
+    q->in_flight = 0;
+    q->depth = BLOCK_QUEUE_DEPTH;
+    block_queue_stats_t empty = {0};
+    q->stats = empty;
+    devices[device_count] = dev;
+    return device_count++;
+}
+
+block_device_t* block_get(uint32_t index) {
+    return index < device_count ? devices[index] : NULL;
+}
+
+uint32_t block_device_count(void) {
+    return device_count;
+}
+
+static block_queue_t* queue_of(block_device_t* dev) {
+    for (uint32_t i = 0; i < device_count; i++) {
+        if (devices[i] == dev) {
+            return &queues[i];
+        }
+    }
+    return NULL;
+}
+
+// Синхронный обмен с асинхронным драйвером: запрос делится на части
+// по BLOCK_MERGE_MAX_SECTORS, до BLOCK_SYNC_PARTS частей выполняются
+// параллельно
+static int queued_transfer(block_device_t* dev, uint64_t lba, uint32_t count, uint8_t* buffer, uint8_t write) {
+    if (!queue_of(dev)) {
+        return -1;
+    }
+    block_request_t parts[BLOCK_SYNC_PARTS];
+    int result = 0;
+    while (count && result == 0) {
+        uint32_t n = 0;
+        for (; count && n < BLOCK_SYNC_PARTS; n++) {
+            uint32_t part = count < BLOCK_MERGE_MAX_SECTORS ? count : BLOCK_MERGE_MAX_SECTORS;
+            parts[n].dev = dev;
+            parts[n].lba = lba;
+            parts[n].count = part;
+            parts[n].write = write;
+            parts[n].buffer = buffer;
+            parts[n].done = NULL;
+            block_submit(&parts[n]);
+            lba += part;
+            count -= part;
+            buffer += part * BLOCK_SECTOR_SIZE;
+        }
+        for (uint32_t i = 0; i < n; i++) {
+            if (block_wait(&parts[i]) < 0) {
+                result = -1;
+            }
+        }
+    }
+    return result;
+}
+
+int block_read(block_device_t* dev, uint64_t lba, uint32_t count, void* buffer) {
+    if (!dev || lba + count > dev->sector_count) {
+        return -1;
+    }
+    if (!count) {
+        return 0;
+    }
+    if (dev->start) {
+        return queued_transfer(dev, lba, count, (uint8_t*)buffer, 0);
+    }
+    return dev->read(dev, lba, count, buffer);
+}
+
+int block_write(block_device_t* dev, uint64_t lba, uint32_t count, const void* buffer) {
+    if (!dev || lba + count > dev->sector_count) {
+        return -1;
+    }
+    if (!count) {
+        return 0;
+    }
+    if (dev->start) {
+        return queued_transfer(dev, lba, count, (uint8_t*)buffer, 1);
+    }
+    return dev->write(dev, lba, count, buffer);
+}
+
+int block_flush(block_device_t* dev) {
+    if (!dev) {
+        return -1;
+    }
+    block_queue_t* q = queue_of(dev);
+    while (q && (q->head || q->in_flight)) {
+        block_poll_wait();
+    }
+    return dev->flush ? dev->flush(dev) : 0;
+}
+
+// Можно ли присоединить цепочку b в конец цепочки a
+static int can_merge(const block_request_t* a, const block_request_t* b) {
+    return a->write == b->write && a->lba + a->span == b->lba &&
+           a->parts + b->parts <= BLOCK_MERGE_MAX_REQUESTS &&
+           a->span + b->span <= BLOCK_MERGE_MAX_SECTORS;
+}
+
+static void chain_append(block_request_t* a, block_request_t* b) {
+    block_request_t* tail = a;
+    while (tail->merged) {
+        tail = tail->merged;
+    }
+    tail->merged = b;
+    a->span += b->span;
+    a->parts += b->parts;
+}
+
+int block_submit(block_request_t* req) {
+    block_device_t* dev = req->dev;
+    block_queue_t* q = dev ? queue_of(dev) : NULL;
+    if (!q || !req->count || req->count > BLOCK_REQUEST_MAX_SECTORS ||
+        req->lba + req->count > dev->sector_count) {
+        return -1;
+    }
+    req->next = NULL;
+    req->merged = NULL;
+    req->span = req->count;
+    req->parts = 1;
+    req->status = 0;
+    req->complete = 0;
+    q->stats.submitted++;
+
+    // Место по LBA: после запросов с тем же началом, чтобы повторная
+    // запись того же сектора не обогнала предыдущую
+    block_request_t* prev = NULL;
+    block_request_t* cur = q->head;
+    while (cur && cur->lba <= req->lba) {
+        prev = cur;
+        cur = cur->next;
+    }
+
+    if (prev && can_merge(prev, req)) {
+        // Продолжение предыдущей цепочки; она могла дорасти до следующей
+        chain_append(prev, req);
+        q->stats.merged++;
+        if (cur && can_merge(prev, cur)) {
+            prev->next = cur->next;
+            chain_append(prev, cur);
+            q->stats.merged++;
+        }
+        return 0;
+    }
+    if (cur && can_merge(req, cur)) {
+        // Начало следующей цепочки: она присоединяется к новому запросу
+        req->next = cur->next;
+        chain_append(req, cur);
+        q->stats.merged++;
+    } else {
+        req->next = cur;
+    }
+    if (prev) {
+        prev->next = req;
+    } else {
+        q->head = req;
+    }
+    return 0;
+}
+
+void block_complete(block_request_t* req, int status) {
+    block_queue_t* q = queue_of(req->dev);
+    if (q && q->in_flight) {
+        q->in_flight--;
+    }
+    completions++;
+    while (req) {
+        // Следующий берется заранее: после done запрос принадлежит вызывающему
+        block_request_t* part = req;
+        req = req->merged;
+        part->status = status;
+        part->complete = 1;
+        if (part->done) {
+            part->done(part, status);
+        }
+    }
+}
+
+// Промежуточный буфер синхронного драйвера для цепочек из раздельных
+// буферов (слияние ограничено BLOCK_MERGE_MAX_SECTORS)
+static uint8_t sync_buffer[BLOCK_MERGE_MAX_SECTORS * BLOCK_SECTOR_SIZE];
+
+// Выполнение цепочки синхронным драйвером одним вызовом. Если буферы
+// частей не лежат подряд в памяти, данные проходят через sync_buffer.
+static int run_sync(block_device_t* dev, block_request_t* req) {
+    uint8_t* expected = (uint8_t*)req->buffer;
+    int contiguous = 1;
+    for (block_request_t* part = req; part; part = part->merged) {
+        if ((uint8_t*)part->buffer != expected) {
+            contiguous = 0;
+            break;
+        }
+        expected += part->count * BLOCK_SECTOR_SIZE;
+    }
+    if (contiguous) {
+        return req->write ? dev->write(dev, req->lba, req->span, req->buffer)
+                          : dev->read(dev, req->lba, req->span, req->buffer);
+    }
+
+    if (req->write) {
+        uint32_t offset = 0;
+        for (block_request_t* part = req; part; part = part->merged) {
+            const uint8_t* src = (const uint8_t*)part->buffer;
+            for (uint32_t i = 0; i < part->count * BLOCK_SECTOR_SIZE; i++) {
+                sync_buffer[offset++] = src[i];
+            }
+        }
+        return dev->write(dev, req->lba, req->span, sync_buffer);
+    }
+    if (dev->read(dev, req->lba, req->span, sync_buffer) < 0) {
+        return -1;
+    }
+    uint32_t offset = 0;
+    for (block_request_t* part = req; part; part = part->merged) {
+        uint8_t* dst = (uint8_t*)part->buffer;
+        for (uint32_t i = 0; i < part->count * BLOCK_SECTOR_SIZE; i++) {
+            dst[i] = sync_buffer[offset++];
+        }
+    }
+    return 0;
+}
+
+// Выдача цепочек драйверу в порядке лифта (C-LOOK): первая цепочка
+// не ниже позиции после предыдущей, за последней - снова с начала.
+// Синхронный драйвер выполняет одну цепочку за вызов, чтобы ожидающий
+// цикл (терминал) не стоял на длинной очереди.
+static void queue_run(block_device_t* dev, block_queue_t* q) {
+    while (q->head && q->in_flight < q->depth) {
+        block_request_t* prev = NULL;
+        block_request_t* req = q->head;
+        while (req && req->lba < q->position) {
+            prev = req;
+            req = req->next;
+        }
+        if (!req) {
+            prev = NULL;
+            req = q->head;
+        }
+        if (prev) {
+            prev->next = req->next;
+        } else {
+            q->head = req->next;
+        }
+
+        uint64_t end = req->lba + req->span;
+        q->in_flight++;
+        if (dev->start) {
+            if (dev->start(dev, req) < 0) {
+                // У драйвера нет места: цепочка возвращается на свое место
+                q->in_flight--;
+                if (prev) {
+                    prev->next = req;
+                } else {
+                    q->head = req;
+                }
+                return;
+            }
+        }
+        q->position = end;
+        q->stats.dispatched++;
+        if (!dev->start) {
+            block_complete(req, run_sync(dev, req));
+            return;
+        }
+    }
+}
+
+void block_poll(void) {
+    for (uint32_t i = 0; i < device_count; i++) {
+        block_device_t* dev = devices[i];
+        queue_run(dev, &queues[i]);
+        if (dev->poll) {
+            dev->poll(dev);
+        }
+    }
+}
+
+void block_irq(void) {
+    __atomic_fetch_add(&irq_events, 1, __ATOMIC_RELEASE);
+    if (irq_wake) {
+        irq_wake();
+    }
+}
+
+void block_set_sleep(void (*sleep)(volatile uint32_t* events, uint32_t seen), void (*wake)(void)) {
+    irq_wake = wake;
+    irq_sleep = sleep;
+}
+
+// Спать можно, если все ожидающие запросы выданы устройствам, которые
+// сообщат о завершении прерыванием. Запросы у драйвера без прерываний
+// или не выданные из-за занятости драйвера продвигает только опрос.
+static int can_sleep(void) {
+    if (!irq_sleep) {
+        return 0;
+    }
+    int busy = 0;
+    for (uint32_t i = 0; i < device_count; i++) {
+        block_queue_t* q = &queues[i];
+        if (!q->head && !q->in_flight) {
+            continue;
+        }
+        if (!devices[i]->irq || !q->in_flight) {
+            return 0;
+        }
+        busy = 1;
+    }
+    return busy;
+}
+
+int block_sync_pending(void) {
+    for (uint32_t i = 0; i < device_count; i++) {
+        block_queue_t* q = &queues[i];
+        if (!devices[i]->irq && (q->head || q->in_flight)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Номер прерывания запоминается до опроса: прерывание, пришедшее после
+// опроса, но до сна, не дает заснуть
+void block_poll_wait(void) {
+    uint32_t seen = __atomic_load_n(&irq_events, __ATOMIC_ACQUIRE);
+    uint64_t before = completions;
+    block_poll();
+    if (completions == before && can_sleep()) {
+        irq_sleep(&irq_events, seen);
+    }
+}
+
+int block_wait(block_request_t* req) {
+    while (!req->complete) {
+        block_poll_wait();
+    }
+    return req->status;
+}
+
+int block_set_queue_depth(block_device_t* dev, uint32_t depth) {
+    block_queue_t* q = queue_of(dev);
+    if (!q || depth == 0) {
+        return -1;
+    }
+    q->depth = depth;
+    return 0;
+}
+
+void block_get_queue_stats(block_device_t* dev, block_queue_stats_t* stats) {
+    block_queue_t* q = queue_of(dev);
+    block_queue_stats_t empty = {0};
+    *stats = q ? q->stats : empty;
+}
+
+// Буфер замера: один последовательный запрос
+static uint8_t bench_buffer[BLOCK_BENCH_REQUEST * BLOCK_SECTOR_SIZE];
+
+int block_benchmark(block_device_t* dev, block_bench_t* result) {
+    if (!dev || dev->sector_count < 8) {
+        return -1;
+    }
+    result->seq_bytes = 0;
+    result->random_reads = 0;
+
+    uint64_t start = rdtsc();
+    uint64_t lba = 0;
+    for (uint32_t i = 0; i < BLOCK_BENCH_SEQ_REQUESTS && lba < dev->sector_count; i++) {
+        uint64_t left = dev->sector_count - lba;
+        uint32_t count = left < BLOCK_BENCH_REQUEST ? left : BLOCK_BENCH_REQUEST;
+        if (block_read(dev, lba, count, bench_buffer) < 0) {
+            return -1;
+        }
+        lba += count;
+        result->seq_bytes += count * BLOCK_SECTOR_SIZE;
+    }
+    result->seq_cycles = rdtsc() - start;
+
+    // Адреса из линейного конгруэнтного генератора, выровнены по 4 КБ
+    uint32_t seed = 12345;
+    uint64_t blocks = dev->sector_count / 8;
+    start = rdtsc();
+    for (uint32_t i = 0; i < BLOCK_BENCH_RANDOM_READS; i++) {
+        seed = seed * 1103515245 + 12345;
+        if (block_read(dev, (seed % blocks) * 8, 8, bench_buffer) < 0) {
+            return -1;
+        }
+        result->random_reads++;
+    }
+    result->random_cycles = rdtsc() - start;
+    return 0;
+}
@@ -0,0 +1,133 @@
+#ifndef BLOCK_H
+#define BLOCK_H
+
+#include "stdint.h"
+
+// Размер сектора блочного устройства
+#define BLOCK_SECTOR_SIZE 512
+// Максимальное количество зарегистрированных устройств
+#define BLOCK_MAX_DEVICES 8
+
+// Очередь запросов устройства: глубина по умолчанию (запросов у драйвера)
+#define BLOCK_QUEUE_DEPTH 32
+// Пределы слияния соседних запросов в одну команду драйвера
+#define BLOCK_MERGE_MAX_REQUESTS 64
+#define BLOCK_MERGE_MAX_SECTORS 256
+// Наибольший одиночный запрос в очереди
+#define BLOCK_REQUEST_MAX_SECTORS 65535
+
+struct block_request;
+
+// Блочное устройство. Драйвер заполняет структуру и регистрирует ее,
+// файловая система работает только через этот интерфейс.
+// Синхронный драйвер задает read/write, асинхронный - start/poll.
+typedef struct block_device {
+    const char* name;
+    uint64_t sector_count;
+    int (*read)(struct block_device* dev, uint64_t lba, uint32_t count, void* buffer);
+    int (*write)(struct block_device* dev, uint64_t lba, uint32_t count, const void* buffer);
+    void* driver_data;
+    // Сброс кэша записи устройства на носитель (NULL - кэша нет).
+    // Вызывается, когда у драйвера нет запросов.
+    int (*flush)(struct block_device* dev);
+    // Выдача запроса вместе с присоединенными к нему (цепочка merged,
+    // сектора подряд, буферы раздельные). -1 - у драйвера нет места,
+    // запрос остается в очереди. Завершение - через block_complete.
+    int (*start)(struct block_device* dev, struct block_request* req);
+    // Отправка выданного устройству и разбор завершенных запросов
+    void (*poll)(struct block_device* dev);
+    // Асинхронный драйвер сообщает о завершениях прерыванием (block_irq),
+    // и ожидающий может спать до него вместо опроса
+    uint8_t irq;
+} block_device_t;
+
+// Асинхронный запрос. Память принадлежит вызывающему до вызова done.
+typedef struct block_request {
+    block_device_t* dev;
+    uint64_t lba;
+    uint32_t count;
+    uint8_t write;
+    void* buffer;
+    // Завершение: status 0 или -1. Вызывается из block_poll; NULL, если
+    // запрос ждут через block_wait.
+    void (*done)(struct block_request* req, int status);
+    void* context;
+    // Поля ниже заполняет очередь
+    struct block_request* next;     // Следующий в очереди (по возрастанию LBA)
+    struct block_request* merged;   // Следующий присоединенный запрос
+    uint32_t span;                  // Секторов во всей цепочке (у первого)
+    uint32_t parts;                 // Запросов в цепочке (у первого)
+    volatile int status;
+    volatile uint8_t complete;
+} block_request_t;
+
+// Счетчики очереди устройства
+typedef struct {
+    uint64_t submitted;
+    uint64_t merged;       // Присоединены к соседнему запросу
+    uint64_t dispatched;   // Команд, выданных драйверу
+} block_queue_stats_t;
+
+// Регистрация устройств. Очередь запросов есть только у зарегистрированных.
+int block_register(block_device_t* dev);
+block_device_t* block_get(uint32_t index);
+uint32_t block_device_count(void);
+
+// Чтение и запись секторов с проверкой границ. Для асинхронного драйвера
+// запрос проходит через очередь, и вызов ждет его завершения.
+int block_read(block_device_t* dev, uint64_t lba, uint32_t count, void* buffer);
+int block_write(block_device_t* dev, uint64_t lba, uint32_t count, const void* buffer);
+// Барьер: все завершенные записи находятся на носителе.
+// Сначала дожидается всех запросов в очереди устройства.
+int block_flush(block_device_t* dev);
+
+// Постановка запроса в очередь без ожидания. Соседний по LBA запрос
+// той же операции присоединяется к уже стоящему, очередь обслуживается
+// лифтом (C-LOOK). Порядок запросов к пересекающимся секторам не
+// гарантируется. Возвращает -1, если запрос некорректен.
+int block_submit(block_request_t* req);
+// Продвижение очередей всех устройств: разбор завершений и выдача
+// новых запросов
+void block_poll(void);
+// Шаг цикла ожидания: block_poll, и если ни один запрос не завершился,
+// а все незавершенные выданы устройствам с прерываниями, сон до
+// следующего прерывания устройства
+void block_poll_wait(void);
+// Есть ли запросы в очереди или в работе у устройства без прерываний:
+// их продвигает только опрос
+int block_sync_pending(void);
+// Ожидание завершения запроса, возвращает его состояние
+int block_wait(block_request_t* req);
+// Вызывается драйвером по завершении запроса, выданного start
+void block_complete(block_request_t* req, int status);
+// Вызывается обработчиком прерывания устройства: будит ожидающих.
+// Сами завершения разбирает block_poll в потоке, который ждет: функции
+// done (кэш буферов) работают под io_lock и в прерывании не вызываются.
+void block_irq(void);
+// Сон до прерывания устройства подключает ядро после запуска
+// планировщика: sleep возвращается, когда *events отличается от seen
+// (или раньше), wake вызывается из block_irq. Без них (утилиты хоста,
+// загрузка) ожидание остается опросом.
+void block_set_sleep(void (*sleep)(volatile uint32_t* events, uint32_t seen), void (*wake)(void));
+
+// Глубина очереди устройства (запросов у драйвера одновременно)
+int block_set_queue_depth(block_device_t* dev, uint32_t depth);
+void block_get_queue_stats(block_device_t* dev, block_queue_stats_t* stats);
+
+// Замер чтения для сравнения драйверов: последовательное чтение запросами
+// по BLOCK_BENCH_REQUEST секторов и случайные чтения по 4 КБ.
+// Время - в тактах TSC. Данные на устройстве не меняются.
+#define BLOCK_BENCH_REQUEST 2048
+#define BLOCK_BENCH_SEQ_REQUESTS 16
+#define BLOCK_BENCH_RANDOM_READS 256
+
+typedef struct {
+    uint64_t seq_bytes;
+    uint64_t seq_cycles;
+    uint32_t random_reads;
+    uint64_t random_cycles;
+} block_bench_t;
+
+int block_benchmark(block_device_t* dev, block_bench_t* result);
+
+#endif
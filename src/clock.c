@@ -0,0 +1,176 @@
+#include "clock.h"
+#include "io.h"
+#include "idt.h"
+
+// Команды PIT: канал, запись младшего и старшего байта, режим
+#define PIT_CH0_RATE      0x34   // Канал 0, режим 2 (делитель частоты)
+#define PIT_CH2_ONESHOT   0xB0   // Канал 2, режим 0 (OUT по окончании счета)
+#define PIT_PORT_B_GATE2  0x01
+#define PIT_PORT_B_SPEAKER 0x02
+#define PIT_PORT_B_OUT2   0x20
+
+static uint64_t tsc_hz = 0;
+static uint64_t tsc_start = 0;
+// Наносекунд на такт TSC, 32 дробных бита
+static uint64_t ns_per_cycle = 0;
+static int tsc_invariant = 0;
+static volatile uint64_t ticks = 0;
+
+// Колесо таймеров: ячейка - шаг по модулю CLOCK_WHEEL_SLOTS,
+// wheel_tick - последний обработанный шаг
+static clock_timer_t* wheel[CLOCK_WHEEL_SLOTS];
+static uint64_t wheel_tick = 0;
+
+static void cpuid(uint32_t leaf, uint32_t* a, uint32_t* b, uint32_t* c, uint32_t* d) {
+    asm volatile("cpuid" : "=a"(*a), "=b"(*b), "=c"(*c), "=d"(*d) : "a"(leaf), "c"(0));
+}
+
+// Один замер частоты TSC: канал 2 считает CLOCK_CALIBRATE_MS, пока
+// GATE2 поднят, и поднимает OUT2 по окончании. Канал 2 не связан
+// с прерываниями, поэтому замер не зависит от IDT.
+static uint64_t calibrate_once(void) {
+    uint32_t latch = PIT_FREQUENCY * CLOCK_CALIBRATE_MS / 1000;
+    uint8_t port_b = inb(PIT_PORT_B) & ~(PIT_PORT_B_GATE2 | PIT_PORT_B_SPEAKER);
+    outb(PIT_PORT_B, port_b);
+    outb(PIT_COMMAND, PIT_CH2_ONESHOT);
+    outb(PIT_CHANNEL2, latch & 0xFF);
+    outb(PIT_CHANNEL2, latch >> 8);
+
+    outb(PIT_PORT_B, port_b | PIT_PORT_B_GATE2);
+    uint64_t start = rdtsc();
+    while (!(inb(PIT_PORT_B) & PIT_PORT_B_OUT2));
+    uint64_t end = rdtsc();
+    outb(PIT_PORT_B, port_b);
+    return (end - start) * PIT_FREQUENCY / latch;
+}
+
+static void clock_irq(void) {
+    ticks++;
+}
+
+uint64_t clock_init(void) {
+    uint32_t a, b, c, d;
+    cpuid(0x80000000, &a, &b, &c, &d);
+    if (a >= 0x80000007) {
+        cpuid(0x80000007, &a, &b, &c, &d);
+        tsc_invariant = (d >> 8) & 1;
+    }
+
+    // Задержка замера (SMI, эмулятор) только завышает результат,
+    // поэтому берется наименьший
+    tsc_hz = 0;
+    for (int i = 0; i < CLOCK_CALIBRATE_RUNS; i++) {
+        uint64_t hz = calibrate_once();
+        if (!tsc_hz || hz < tsc_hz) {
+            tsc_hz = hz;
+        }
+    }
+    ns_per_cycle = (1000000000ull << 32) / tsc_hz;
+    tsc_start = rdtsc();
+
+    for (uint32_t i = 0; i < CLOCK_WHEEL_SLOTS; i++) {
+        wheel[i] = NULL;
+    }
+    wheel_tick = 0;
+    ticks = 0;
+
+    uint32_t divisor = (PIT_FREQUENCY + CLOCK_TICK_HZ / 2) / CLOCK_TICK_HZ;
+    outb(PIT_COMMAND, PIT_CH0_RATE);
+    outb(PIT_CHANNEL0, divisor & 0xFF);
+    outb(PIT_CHANNEL0, divisor >> 8);
+    irq_register(PIT_IRQ, clock_irq);
+    return tsc_hz;
+}
+
+uint64_t clock_cycles_to_ns(uint64_t cycles) {
+    return (uint64_t)((unsigned __int128)cycles * ns_per_cycle >> 32);
+}
+
+uint64_t clock_now(void) {
+    return clock_cycles_to_ns(rdtsc() - tsc_start);
+}
+
+uint64_t clock_tsc_hz(void) {
+    return tsc_hz;
+}
+
+int clock_tsc_invariant(void) {
+    return tsc_invariant;
+}
+
+uint64_t clock_ticks(void) {
+    return ticks;
+}
+
+void clock_delay_ns(uint64_t ns) {
+    uint64_t end = clock_now() + ns;
+    while (clock_now() < end) {
+        asm volatile("pause");
+    }
+}
+
+static void timer_unlink(clock_timer_t* timer) {
+    if (timer->prev) {
+        timer->prev->next = timer->next;
+    } else {
+        wheel[timer->tick & (CLOCK_WHEEL_SLOTS - 1)] = timer->next;
+    }
+    if (timer->next) {
+        timer->next->prev = timer->prev;
+    }
+    timer->active = 0;
+}
+
+void clock_timer_start(clock_timer_t* timer, uint64_t deadline,
+                       void (*callback)(clock_timer_t* timer), void* context) {
+    if (timer->active) {
+        timer_unlink(timer);
+    }
+    // Срок округляется вверх до шага; прошедший срок - ближайший шаг
+    uint64_t tick = (deadline + CLOCK_TICK_NS - 1) / CLOCK_TICK_NS;
+    if (tick <= wheel_tick) {
+        tick = wheel_tick + 1;
+    }
+    timer->tick = tick;
+    timer->callback = callback;
+    timer->context = context;
+    clock_timer_t** slot = &wheel[tick & (CLOCK_WHEEL_SLOTS - 1)];
+    timer->prev = NULL;
+    timer->next = *slot;
+    if (*slot) {
+        (*slot)->prev = timer;
+    }
+    *slot = timer;
+    timer->active = 1;
+}
+
+void clock_timer_cancel(clock_timer_t* timer) {
+    if (timer->active) {
+        timer_unlink(timer);
+    }
+}
+
+// Обход ячеек от последнего обработанного шага до текущего. После паузы
+// длиннее оборота колеса каждая ячейка просматривается один раз.
+// Обработчик может запускать и отменять любые таймеры, поэтому после
+// каждого срабатывания ячейка просматривается заново.
+void clock_run_timers(void) {
+    uint64_t now = clock_now() / CLOCK_TICK_NS;
+    if (now - wheel_tick > CLOCK_WHEEL_SLOTS) {
+        wheel_tick = now - CLOCK_WHEEL_SLOTS;
+    }
+    while (wheel_tick < now) {
+        wheel_tick++;
+        clock_timer_t** slot = &wheel[wheel_tick & (CLOCK_WHEEL_SLOTS - 1)];
+        clock_timer_t* timer = *slot;
+        while (timer) {
+            if (timer->tick > now) {
+                timer = timer->next;
+                continue;
+            }
+            timer_unlink(timer);
+            timer->callback(timer);
+            timer = *slot;
+        }
+    }
+}
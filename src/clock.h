@@ -0,0 +1,60 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include "stdint.h"
+
+// Частота входа PIT и порты каналов
+#define PIT_FREQUENCY 1193182
+#define PIT_CHANNEL0  0x40
+#define PIT_CHANNEL2  0x42
+#define PIT_COMMAND   0x43
+// Порт B контроллера: вход GATE и выход OUT канала 2
+#define PIT_PORT_B    0x61
+#define PIT_IRQ 0
+
+// Периодическое прерывание таймера: будит цикл ожидания и задает
+// шаг колеса таймеров
+#define CLOCK_TICK_HZ 1000
+#define CLOCK_TICK_NS (1000000000ull / CLOCK_TICK_HZ)
+// Калибровка TSC: интервал PIT и количество замеров (берется лучший)
+#define CLOCK_CALIBRATE_MS 10
+#define CLOCK_CALIBRATE_RUNS 3
+// Ячеек колеса таймеров (степень двойки). Срок дальше оборота колеса
+// ждет в своей ячейке нужного оборота.
+#define CLOCK_WHEEL_SLOTS 256
+
+// Таймер с однократным сроком. Перед первым запуском структура
+// обнуляется; память принадлежит вызывающему, пока таймер запущен.
+typedef struct clock_timer {
+    uint64_t tick;                       // Шаг колеса, на котором срабатывает
+    void (*callback)(struct clock_timer* timer);
+    void* context;
+    struct clock_timer* next;
+    struct clock_timer* prev;
+    uint8_t active;
+} clock_timer_t;
+
+// Калибровка TSC по каналу 2 PIT и запуск тика на канале 0 (IRQ 0,
+// после idt_init). Возвращает частоту TSC в Гц.
+uint64_t clock_init(void);
+// Монотонное время в наносекундах с clock_init
+uint64_t clock_now(void);
+uint64_t clock_tsc_hz(void);
+// TSC идет с постоянной частотой независимо от состояния процессора
+int clock_tsc_invariant(void);
+uint64_t clock_cycles_to_ns(uint64_t cycles);
+// Активное ожидание (для задержек оборудования)
+void clock_delay_ns(uint64_t ns);
+// Количество тиков с запуска
+uint64_t clock_ticks(void);
+
+// Запуск таймера на момент deadline (по clock_now). Уже запущенный
+// таймер переставляется. Обработчик вызывается из clock_run_timers
+// и может снова запустить свой таймер.
+void clock_timer_start(clock_timer_t* timer, uint64_t deadline,
+                       void (*callback)(clock_timer_t* timer), void* context);
+void clock_timer_cancel(clock_timer_t* timer);
+// Срабатывание наступивших таймеров. Вызывается из цикла ожидания.
+void clock_run_timers(void);
+
+#endif
@@ -1,217 +1,2429 @@
 #include "fs.h"
 #include "vga.h"  // Добавляем для вывода отладочной информации
+#include "bcache.h"
+#include "lz4.h"
+#include "sync.h"
 
-// Массив всех файлов
-static file_t files[MAX_FILES];
-// Текущее количество файлов
-static uint32_t file_count = 0;
-// Номер порта SATA диска
-static uint32_t disk_port = 0;
+// Состояние тома в памяти: все, что fs_load восстанавливает с диска.
+// Связи внутри состояния - только индексы, поэтому его снимок
+// (см. fs_write_snapshot) можно использовать прямо из памяти образа,
+// загруженного загрузчиком, без копирования и разбора (fs_mount_image).
+typedef struct {
+    // Массив всех файлов
+    file_t files[MAX_FILES];
+    // Граница использованных слотов (слоты за ней ни разу не выделялись)
+    uint32_t file_count;
+    // Список освобожденных слотов, связанный через slot_free_next
+    int32_t slot_free_head;
+    int32_t slot_free_next[MAX_FILES];
+
+    // Горячие поля inode, которые читают поиск по имени и обход директорий.
+    // Лежат в плотных параллельных массивах, чтобы просмотр цепочки или списка
+    // директории шел по соседним кэш-линиям; file_t хранит остальные (холодные) поля.
+    uint32_t file_parent[MAX_FILES];
+    uint8_t file_type[MAX_FILES];
+    uint32_t file_hash[MAX_FILES];               // Хеш имени
+    uint64_t file_prefix[MAX_FILES];             // Первые 8 байт имени
+    int32_t file_next_sibling[MAX_FILES];
+
+    // Кэш записей каталогов: хеш-таблица по (parent_index, хеш имени).
+    // Цепочки связаны через dcache_next, -1 означает конец цепочки.
+    int32_t dcache_buckets[FS_DCACHE_BUCKETS];
+    int32_t dcache_next[MAX_FILES];
+
+    // Битовая карта занятости блоков данных (1 - блок занят).
+    // Сами блоки живут на устройстве и читаются через кэш буферов.
+    uint32_t block_bitmap[FS_MAX_BLOCKS / 32];
+    uint32_t blocks_free;
+    // Подсказка для поиска свободного блока
+    uint32_t block_hint;
+
+    // Дедупликация: число ссылок на блок из экстентов (восстанавливается
+    // при загрузке), хеш содержимого полных блоков (0 - блок не в индексе,
+    // хранится на диске) и индекс хеш -> блок с цепочками через dedup_next
+    uint16_t block_refs[FS_MAX_BLOCKS];
+    uint32_t block_hash[FS_MAX_BLOCKS];
+    int32_t dedup_buckets[FS_DEDUP_BUCKETS];
+    int32_t dedup_next[FS_MAX_BLOCKS];
+    uint32_t blocks_shared;
+
+    // Таблица экстентов, свободные связаны через поле next
+    fs_extent_t extents[FS_MAX_EXTENTS];
+    int32_t extent_free_head;
+    uint32_t extents_free;
+} fs_core_t;
+
+// Заголовок снимка состояния, первый сектор области снимка
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t core_size;         // sizeof(fs_core_t) при записи
+    uint32_t journal_sequence;  // Номер журнала, с которым снимок совпадает
+} __attribute__((packed)) fs_snapshot_header_t;
+
+#define FS_SNAPSHOT_MAGIC 0x50414E53  // "SNAP"
+
+_Static_assert(sizeof(fs_core_t) <= (FS_SNAPSHOT_SECTORS - 1) * BLOCK_SECTOR_SIZE,
+               "FS_SNAPSHOT_SECTORS is too small for fs_core_t");
+
+// Собственное состояние и текущее (собственное или снимок в образе)
+static fs_core_t core_mem;
+static fs_core_t* core = &core_mem;
+
+// Пространство имен: имена, родители, типы, кэш записей каталогов,
+// file_count и сам указатель core. Поиск по имени (fs_lookup,
+// fs_parse_path) читает его без блокировки и может идти параллельно
+// с другими потоками; все остальное сериализует вызывающий (io_lock).
+// Читатель ждет вытесненного писателя активно, поэтому поток, который
+// ищет без io_lock, не должен быть приоритетнее писателей (в ядре
+// пишет и читает без блокировки один поток - терминал).
+static seqlock_t names = SEQLOCK_INIT;
+
+// Счетчики стоимости поиска. Поиски идут параллельно, поэтому
+// счетчики поиска прибавляются атомарно.
+static fs_stats_t fs_stats;
+
+// Таблица открытых файлов
+typedef struct {
+    int32_t index;          // Индекс inode (-1 - дескриптор свободен)
+    uint32_t generation;    // Поколение слота на момент открытия
+    uint32_t offset;        // Текущая позиция
+    uint32_t flags;
+    fs_readahead_t ra;
+} fs_open_file_t;
+static fs_open_file_t open_files[FS_MAX_OPEN];
+
+// Сжатие новых файлов в fs_write
+static int fs_compression = 0;
+// Последний распакованный кластер (экстент -1 - нет), чтобы чтение
+// малыми порциями не распаковывало один кластер повторно
+static int32_t zcache_extent = -1;
+static uint8_t zcache_data[FS_CLUSTER_SIZE];
+// Сжатые данные кластера
+static uint8_t zbuf[FS_CLUSTER_SIZE];
+
+// Устройство, на котором хранится файловая система (NULL - только память)
+static block_device_t* fs_dev = NULL;
+
+// Измененные сектора метаданных (по номеру от FS_SUPERBLOCK_SECTOR).
+// Измененные блоки данных отслеживает кэш буферов.
+static uint32_t meta_dirty[(FS_META_SECTORS + 31) / 32];
+static uint32_t meta_dirty_count = 0;
+// Сектора, зафиксированные в журнале, но еще не записанные на место
+static uint32_t meta_ckpt[(FS_META_SECTORS + 31) / 32];
+// Блоки, освобожденные незафиксированной транзакцией. На них еще
+// ссылаются метаданные последней фиксации, поэтому до фиксации они
+// считаются занятыми и не выделяются повторно (в blocks_free не входят).
+static uint32_t block_pending[FS_MAX_BLOCKS / 32];
+static uint32_t blocks_pending = 0;
+// Блоки, выделенные незафиксированной транзакцией: зафиксированные
+// метаданные на них не ссылаются, и освобожденный такой блок свободен сразу
+static uint32_t block_fresh[FS_MAX_BLOCKS / 32];
+
+// Состояние журнала
+static uint32_t journal_seq = 1;     // Номер следующей транзакции
+static uint32_t journal_head = 1;    // Следующий свободный сектор журнала
+static uint32_t journal_pending = 0; // Операции, ожидающие фиксации
+static uint32_t journal_age = 0;     // Тики с первой неподтвержденной операции
+
+// Буфер для сериализации одного сектора метаданных
+static uint8_t sector_buf[BLOCK_SECTOR_SIZE];
+// Буфер транзакции: дескрипторы, образы секторов и запись фиксации
+// (самая большая транзакция занимает весь журнал без заголовка)
+static uint8_t journal_buf[(FS_JOURNAL_SECTORS - 1) * BLOCK_SECTOR_SIZE];
 
 // Вспомогательная функция для копирования строк
 void strcpy(char* dest, const char* src) {
     while (*src) {
         *dest++ = *src++;
     }
-    *dest = 0;
+    *dest = 0;
+}
+
+// Вспомогательная функция для сравнения строк
+int strcmp(const char* s1, const char* s2) {
+    while (*s1 && (*s1 == *s2)) {
+        s1++;
+        s2++;
+    }
+    return *(const unsigned char*)s1 - *(const unsigned char*)s2;
+}
+
+// Вспомогательная функция для получения длины строки
+uint32_t strlen(const char* str) {
+    const char* s = str;
+    while (*s) s++;
+    return s - str;
+}
+
+// Вспомогательная функция для конкатенации строк
+void strcat(char* dest, const char* src) {
+    dest += strlen(dest);
+    strcpy(dest, src);
+}
+
+// Вспомогательная функция для копирования n символов
+void strncpy(char* dest, const char* src, uint32_t n) {
+    uint32_t i;
+    for (i = 0; i < n && src[i]; i++) {
+        dest[i] = src[i];
+    }
+    for (; i < n; i++) {
+        dest[i] = 0;
+    }
+}
+
+// Вспомогательная функция для сравнения начала строки
+int strncmp(const char* s1, const char* s2, uint32_t n) {
+    while (n && *s1 && (*s1 == *s2)) {
+        s1++;
+        s2++;
+        n--;
+    }
+    return n ? *(const unsigned char*)s1 - *(const unsigned char*)s2 : 0;
+}
+
+// Вспомогательная функция для поиска следующего компонента пути
+static const char* get_next_path_component(const char* path, char* component) {
+    // Пропускаем начальные слеши
+    while (*path == '/') path++;
+    
+    // Копируем символы до следующего слеша или конца строки
+    while (*path && *path != '/') {
+        *component++ = *path++;
+    }
+    *component = 0;
+    
+    return *path ? path : NULL;
+}
+
+// Хеш имени (FNV-1a)
+static uint32_t fs_name_hash(const char* name) {
+    uint32_t hash = 2166136261u;
+    while (*name) {
+        hash ^= (uint8_t)*name++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Первые FS_NAME_PREFIX байт имени, дополненные нулями. Если имя короче,
+// префикс содержит его целиком вместе с завершающим нулем.
+static uint64_t fs_name_prefix(const char* name, int* complete) {
+    uint64_t prefix = 0;
+    uint32_t i = 0;
+    for (; i < FS_NAME_PREFIX && name[i]; i++) {
+        prefix |= (uint64_t)(uint8_t)name[i] << (i * 8);
+    }
+    *complete = i < FS_NAME_PREFIX;
+    return prefix;
+}
+
+// Номер корзины для пары (родитель, хеш имени)
+static uint32_t dcache_bucket(uint32_t parent_index, uint32_t hash) {
+    return (hash ^ (parent_index * 0x9E3779B1u)) & (FS_DCACHE_BUCKETS - 1);
+}
+
+// Добавление записи в кэш
+static void dcache_insert(uint32_t index) {
+    uint32_t hash = fs_name_hash(core->files[index].name);
+    uint32_t bucket = dcache_bucket(core->file_parent[index], hash);
+    int complete;
+    core->file_hash[index] = hash;
+    core->file_prefix[index] = fs_name_prefix(core->files[index].name, &complete);
+    core->dcache_next[index] = core->dcache_buckets[bucket];
+    core->dcache_buckets[bucket] = index;
+}
+
+// Удаление записи из кэша
+static void dcache_remove(uint32_t index) {
+    uint32_t bucket = dcache_bucket(core->file_parent[index], core->file_hash[index]);
+    int32_t* link = &core->dcache_buckets[bucket];
+    while (*link != -1) {
+        if ((uint32_t)*link == index) {
+            *link = core->dcache_next[index];
+            core->dcache_next[index] = -1;
+            return;
+        }
+        link = &core->dcache_next[*link];
+    }
+}
+
+// Полное перестроение кэша (после перенумерации записей)
+static void dcache_rebuild(void) {
+    for (uint32_t i = 0; i < FS_DCACHE_BUCKETS; i++) {
+        core->dcache_buckets[i] = -1;
+    }
+    // Корневая директория не является элементом какого-либо каталога
+    for (uint32_t i = 1; i < core->file_count; i++) {
+        core->dcache_next[i] = -1;
+        if (core->file_type[i] != FILE_TYPE_NONE) {
+            dcache_insert(i);
+        }
+    }
+}
+
+// Стоимость одного поиска, прибавляется к fs_stats по завершении
+typedef struct {
+    uint32_t lookups;
+    uint32_t probes;
+    uint32_t misses;
+    uint32_t name_reads;
+} lookup_cost_t;
+
+// Поиск имени в директории через кэш. Полное имя из file_t читается,
+// только если совпали хеш, родитель и префикс, а имя длиннее префикса.
+// Вызывается внутри чтения names: данные могут меняться на ходу, поэтому
+// индексы проверяются, цепочка ограничена MAX_FILES шагами, а имя
+// сравнивается не дальше MAX_FILENAME. Результат верен, только если
+// чтение не придется повторять.
+static int32_t dcache_find(const fs_core_t* c, uint32_t parent_index, const char* name,
+                           lookup_cost_t* cost) {
+    uint32_t hash = fs_name_hash(name);
+    int complete;
+    uint64_t prefix = fs_name_prefix(name, &complete);
+    int32_t i = c->dcache_buckets[dcache_bucket(parent_index, hash)];
+
+    cost->lookups++;
+    for (uint32_t steps = 0; i >= 0 && i < MAX_FILES && steps < MAX_FILES; steps++) {
+        cost->probes++;
+        if (c->file_hash[i] == hash && c->file_parent[i] == parent_index &&
+            c->file_prefix[i] == prefix) {
+            if (complete) {
+                return i;
+            }
+            cost->name_reads++;
+            if (strncmp(c->files[i].name, name, MAX_FILENAME) == 0) {
+                return i;
+            }
+        }
+        i = c->dcache_next[i];
+    }
+    cost->misses++;
+    return -1;
+}
+
+static void lookup_account(const lookup_cost_t* cost) {
+    __atomic_fetch_add(&fs_stats.lookups, cost->lookups, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&fs_stats.lookup_probes, cost->probes, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&fs_stats.lookup_misses, cost->misses, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&fs_stats.lookup_name_reads, cost->name_reads, __ATOMIC_RELAXED);
+}
+
+// Прерванное писателем чтение не учитывается: повторы считает seqlock
+int fs_lookup(uint32_t parent_index, const char* name) {
+    lookup_cost_t cost;
+    int32_t found;
+    uint32_t sequence;
+    do {
+        lookup_cost_t empty = {0};
+        cost = empty;
+        sequence = seq_read_begin(&names);
+        found = dcache_find(core, parent_index, name, &cost);
+    } while (seq_read_retry(&names, sequence));
+    lookup_account(&cost);
+    return found;
+}
+
+void fs_get_stats(fs_stats_t* stats) {
+    *stats = fs_stats;
+    stats->blocks_free = core->blocks_free;
+    stats->extents_free = core->extents_free;
+    stats->blocks_shared = core->blocks_shared;
+}
+
+void fs_reset_stats(void) {
+    fs_stats.lookups = 0;
+    fs_stats.lookup_probes = 0;
+    fs_stats.lookup_misses = 0;
+    fs_stats.lookup_name_reads = 0;
+}
+
+// Работа с битовыми картами
+static inline void bit_set(uint32_t* map, uint32_t n) {
+    map[n / 32] |= 1u << (n % 32);
+}
+
+static inline int bit_test(const uint32_t* map, uint32_t n) {
+    return (map[n / 32] >> (n % 32)) & 1;
+}
+
+static inline void meta_mark_dirty(uint32_t lba) {
+    uint32_t n = lba - FS_SUPERBLOCK_SECTOR;
+    if (!bit_test(meta_dirty, n)) {
+        bit_set(meta_dirty, n);
+        meta_dirty_count++;
+    }
+}
+
+static inline void inode_mark_dirty(uint32_t index) {
+    meta_mark_dirty(FS_INODE_START_SECTOR + index);
+}
+
+static inline void extent_mark_dirty(int32_t e) {
+    meta_mark_dirty(FS_EXTENT_START_SECTOR + e / FS_EXTENTS_PER_SECTOR);
+}
+
+static inline void bitmap_mark_dirty(uint32_t block) {
+    meta_mark_dirty(FS_BITMAP_START_SECTOR + block / (BLOCK_SECTOR_SIZE * 8));
+}
+
+static inline void hash_mark_dirty(uint32_t block) {
+    meta_mark_dirty(FS_HASH_START_SECTOR + block / (BLOCK_SECTOR_SIZE / 4));
+}
+
+// Проверка занятости блока (освобожденный до фиксации тоже занят)
+static inline int block_used(uint32_t block) {
+    return ((core->block_bitmap[block / 32] | block_pending[block / 32]) >> (block % 32)) & 1;
+}
+
+// Выделение непрерывной последовательности блоков.
+// Начинает с hint, если он свободен, иначе ищет первый свободный блок.
+// Возвращает первый блок и количество выделенных в *got, либо -1.
+static int block_alloc_run(uint32_t hint, uint32_t want, uint32_t* got) {
+    if (!core->blocks_free || !want) {
+        return -1;
+    }
+
+    uint32_t start = hint < FS_MAX_BLOCKS ? hint : 0;
+    if (block_used(start)) {
+        // Пропускаем полностью занятые слова битовой карты
+        uint32_t word = start / 32;
+        for (uint32_t n = 0; n < FS_MAX_BLOCKS / 32; n++) {
+            if ((core->block_bitmap[word] | block_pending[word]) != 0xFFFFFFFF) {
+                break;
+            }
+            word = (word + 1) % (FS_MAX_BLOCKS / 32);
+        }
+        start = word * 32;
+        while (block_used(start)) {
+            start++;
+        }
+    }
+
+    uint32_t count = 0;
+    while (count < want && start + count < FS_MAX_BLOCKS && !block_used(start + count)) {
+        core->block_bitmap[(start + count) / 32] |= 1u << ((start + count) % 32);
+        block_fresh[(start + count) / 32] |= 1u << ((start + count) % 32);
+        bitmap_mark_dirty(start + count);
+        core->block_refs[start + count] = 1;
+        count++;
+    }
+
+    core->blocks_free -= count;
+    core->block_hint = start + count;
+    *got = count;
+    return start;
+}
+
+// Выделение ровно want подряд идущих блоков (для кластеров сжатых файлов)
+static int block_alloc_contig(uint32_t hint, uint32_t want) {
+    uint32_t run = 0;
+    for (uint32_t n = 0; n < FS_MAX_BLOCKS; n++) {
+        uint32_t b = (hint + n) % FS_MAX_BLOCKS;
+        if (b == 0) {
+            run = 0;  // Последовательность не переходит через конец тома
+        }
+        run = block_used(b) ? 0 : run + 1;
+        if (run == want) {
+            uint32_t got;
+            return block_alloc_run(b + 1 - want, want, &got);
+        }
+    }
+    return -1;
+}
+
+// Хеш содержимого блока для индекса дедупликации (FNV-1a, 0 не используется)
+static uint32_t block_content_hash(const uint8_t* data) {
+    uint32_t hash = 2166136261u;
+    for (uint32_t i = 0; i < FS_BLOCK_SIZE; i++) {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+    return hash ? hash : 1;
+}
+
+static void dedup_insert(uint32_t block, uint32_t hash) {
+    uint32_t bucket = hash & (FS_DEDUP_BUCKETS - 1);
+    core->block_hash[block] = hash;
+    core->dedup_next[block] = core->dedup_buckets[bucket];
+    core->dedup_buckets[bucket] = block;
+    hash_mark_dirty(block);
+}
+
+// Исключение блока из индекса (перед изменением его содержимого)
+static void dedup_remove(uint32_t block) {
+    if (!core->block_hash[block]) {
+        return;
+    }
+    int32_t* link = &core->dedup_buckets[core->block_hash[block] & (FS_DEDUP_BUCKETS - 1)];
+    while (*link != -1) {
+        if ((uint32_t)*link == block) {
+            *link = core->dedup_next[block];
+            break;
+        }
+        link = &core->dedup_next[*link];
+    }
+    core->block_hash[block] = 0;
+    hash_mark_dirty(block);
+}
+
+// Поиск блока с тем же содержимым. Совпадение хеша проверяется
+// сравнением данных, поэтому коллизии не приводят к порче файлов.
+static int32_t dedup_find(const uint8_t* data, uint32_t hash) {
+    int32_t b = core->dedup_buckets[hash & (FS_DEDUP_BUCKETS - 1)];
+    for (; b != -1; b = core->dedup_next[b]) {
+        if (core->block_hash[b] != hash || core->block_refs[b] == 0xFFFF) {
+            continue;
+        }
+        bcache_buf_t* buf = bcache_get(fs_dev, FS_DATA_START_SECTOR + b);
+        if (!buf) {
+            return -1;
+        }
+        uint32_t i = 0;
+        while (i < FS_BLOCK_SIZE && buf->data[i] == data[i]) {
+            i++;
+        }
+        bcache_release(buf);
+        if (i == FS_BLOCK_SIZE) {
+            return b;
+        }
+        fs_stats.dedup_collisions++;
+    }
+    return -1;
+}
+
+static void block_ref(uint32_t block) {
+    if (++core->block_refs[block] == 2) {
+        core->blocks_shared++;
+    }
+}
+
+// Освобождение ссылок на последовательность блоков. Блок возвращается
+// в свободные, только когда на него не осталось ссылок.
+static void block_free_run(uint32_t start, uint32_t count) {
+    for (uint32_t b = start; b < start + count; b++) {
+        if (core->block_refs[b] > 1) {
+            if (--core->block_refs[b] == 1) {
+                core->blocks_shared--;
+            }
+            continue;
+        }
+        core->block_refs[b] = 0;
+        dedup_remove(b);
+        core->block_bitmap[b / 32] &= ~(1u << (b % 32));
+        bitmap_mark_dirty(b);
+        // Содержимое освобожденного блока больше не нужно записывать.
+        // Без устройства фиксаций нет, и блок свободен сразу.
+        if (fs_dev) {
+            bcache_invalidate(fs_dev, FS_DATA_START_SECTOR + b);
+        }
+        if (fs_dev && !bit_test(block_fresh, b)) {
+            block_pending[b / 32] |= 1u << (b % 32);
+            blocks_pending++;
+        } else {
+            core->blocks_free++;
+        }
+    }
+}
+
+// Возврат блоков, освобожденных зафиксированной транзакцией, в свободные.
+// Выделенные ею блоки с этого момента зафиксированы.
+static void block_release_pending(void) {
+    for (uint32_t i = 0; i < FS_MAX_BLOCKS / 32; i++) {
+        block_pending[i] = 0;
+        block_fresh[i] = 0;
+    }
+    core->blocks_free += blocks_pending;
+    blocks_pending = 0;
+}
+
+static int32_t extent_alloc(void) {
+    int32_t e = core->extent_free_head;
+    if (e != -1) {
+        core->extent_free_head = core->extents[e].next;
+        core->extents[e].next = -1;
+        core->extents[e].info = 0;
+        core->extents_free--;
+        extent_mark_dirty(e);
+    }
+    return e;
+}
+
+static void extent_free(int32_t e) {
+    if (zcache_extent == e) {
+        zcache_extent = -1;
+    }
+    core->extents[e].next = core->extent_free_head;
+    core->extent_free_head = e;
+    core->extents_free++;
+}
+
+// Усечение списка блоков файла до new_count блоков
+static void file_shrink(file_t* file, uint32_t new_count) {
+    uint32_t kept = 0;
+    int32_t prev = -1;
+    int32_t e = file->first_extent;
+
+    // Пропускаем экстенты, которые остаются целиком
+    while (e != -1 && kept + core->extents[e].count <= new_count) {
+        kept += core->extents[e].count;
+        prev = e;
+        e = core->extents[e].next;
+    }
+
+    // Частично остающийся экстент
+    if (e != -1 && kept < new_count) {
+        uint32_t keep = new_count - kept;
+        block_free_run(core->extents[e].start + keep, core->extents[e].count - keep);
+        core->extents[e].count = keep;
+        extent_mark_dirty(e);
+        prev = e;
+        e = core->extents[e].next;
+    }
+
+    // Остальные экстенты освобождаются полностью
+    while (e != -1) {
+        int32_t next = core->extents[e].next;
+        block_free_run(core->extents[e].start, core->extents[e].count);
+        extent_free(e);
+        e = next;
+    }
+
+    if (prev == -1) {
+        file->first_extent = -1;
+    } else {
+        core->extents[prev].next = -1;
+        extent_mark_dirty(prev);
+    }
+    file->last_extent = prev;
+    file->block_count = new_count;
+    if (!new_count) {
+        file->flags &= ~FS_FILE_COMPRESSED;
+    }
+}
+
+// Рост файла до new_count блоков без перемещения существующих данных.
+// При нехватке места файл возвращается к исходному размеру.
+static int file_grow(file_t* file, uint32_t new_count) {
+    uint32_t old_count = file->block_count;
+
+    while (file->block_count < new_count) {
+        uint32_t want = new_count - file->block_count;
+        int32_t last = file->last_extent;
+        uint32_t hint = last != -1 ? core->extents[last].start + core->extents[last].count : core->block_hint;
+        uint32_t got = 0;
+
+        int start = block_alloc_run(hint, want, &got);
+        if (start < 0) {
+            file_shrink(file, old_count);
+            return -1;
+        }
+
+        if (last != -1 && (uint32_t)start == hint) {
+            // Продолжение последнего экстента
+            core->extents[last].count += got;
+            extent_mark_dirty(last);
+        } else {
+            int32_t e = extent_alloc();
+            if (e == -1) {
+                block_free_run(start, got);
+                file_shrink(file, old_count);
+                return -1;
+            }
+            core->extents[e].start = start;
+            core->extents[e].count = got;
+            if (last == -1) {
+                file->first_extent = e;
+            } else {
+                core->extents[last].next = e;
+                extent_mark_dirty(last);
+            }
+            file->last_extent = e;
+        }
+        file->block_count += got;
+    }
+    return 0;
+}
+
+// Изменение количества блоков файла
+static int file_resize(file_t* file, uint32_t size) {
+    uint32_t needed = (size + FS_BLOCK_SIZE - 1) / FS_BLOCK_SIZE;
+    if (needed > file->block_count) {
+        return file_grow(file, needed);
+    }
+    if (needed < file->block_count) {
+        if (file->map_count) {
+            return -1;  // Блоки отображенного файла не освобождаются
+        }
+        file_shrink(file, needed);
+    }
+    return 0;
+}
+
+// Выделение слота: сначала из списка освобожденных, затем за границей
+static int32_t slot_alloc(void) {
+    int32_t index = core->slot_free_head;
+    if (index != -1) {
+        core->slot_free_head = core->slot_free_next[index];
+        return index;
+    }
+    if (core->file_count >= MAX_FILES) {
+        return -1;  // Нет свободного места
+    }
+    meta_mark_dirty(FS_SUPERBLOCK_SECTOR);
+    return core->file_count++;
+}
+
+// Освобождение слота. Поколение увеличивается, чтобы сохраненные
+// ранее индексы можно было распознать как устаревшие.
+static void slot_release(uint32_t index) {
+    core->files[index].name[0] = 0;
+    core->file_type[index] = FILE_TYPE_NONE;
+    core->files[index].size = 0;
+    core->files[index].flags = 0;
+    core->file_parent[index] = -1;
+    core->files[index].generation++;
+    inode_mark_dirty(index);
+    core->slot_free_next[index] = core->slot_free_head;
+    core->slot_free_head = index;
+}
+
+// Добавление элемента в конец списка родительской директории
+static void child_link(uint32_t index) {
+    file_t* parent = &core->files[core->file_parent[index]];
+    core->file_next_sibling[index] = -1;
+    core->files[index].prev_sibling = parent->last_child;
+    if (parent->last_child == -1) {
+        parent->first_child = index;
+    } else {
+        core->file_next_sibling[parent->last_child] = index;
+    }
+    parent->last_child = index;
+}
+
+// Удаление элемента из списка родительской директории
+static void child_unlink(uint32_t index) {
+    file_t* parent = &core->files[core->file_parent[index]];
+    int32_t prev = core->files[index].prev_sibling;
+    int32_t next = core->file_next_sibling[index];
+    if (prev == -1) {
+        parent->first_child = next;
+    } else {
+        core->file_next_sibling[prev] = next;
+    }
+    if (next == -1) {
+        parent->last_child = prev;
+    } else {
+        core->files[next].prev_sibling = prev;
+    }
+    core->file_next_sibling[index] = -1;
+    core->files[index].prev_sibling = -1;
+}
+
+uint32_t fs_generation(uint32_t index) {
+    return index < MAX_FILES ? core->files[index].generation : 0;
+}
+
+int fs_index_valid(uint32_t index, uint32_t generation) {
+    return index < core->file_count && core->file_type[index] != FILE_TYPE_NONE &&
+           core->files[index].generation == generation;
+}
+
+// Сброс всех признаков изменения
+static void fs_clear_dirty(void) {
+    for (uint32_t i = 0; i < (FS_META_SECTORS + 31) / 32; i++) {
+        meta_dirty[i] = 0;
+        meta_ckpt[i] = 0;
+    }
+    for (uint32_t i = 0; i < FS_MAX_BLOCKS / 32; i++) {
+        block_pending[i] = 0;
+        block_fresh[i] = 0;
+    }
+    blocks_pending = 0;
+    meta_dirty_count = 0;
+    journal_pending = 0;
+    journal_age = 0;
+}
+
+// Образ сектора метаданных по его адресу на диске
+static void meta_serialize(uint32_t lba, uint8_t* out) {
+    for (uint32_t j = 0; j < BLOCK_SECTOR_SIZE; j++) {
+        out[j] = 0;
+    }
+
+    if (lba == FS_SUPERBLOCK_SECTOR) {
+        superblock_t* sb = (superblock_t*)out;
+        sb->magic = FS_MAGIC;
+        sb->version = FS_VERSION;
+        sb->file_count = core->file_count;
+        sb->first_data_sector = FS_DATA_START_SECTOR;
+        sb->inode_start_sector = FS_INODE_START_SECTOR;
+        sb->extent_start_sector = FS_EXTENT_START_SECTOR;
+        sb->bitmap_start_sector = FS_BITMAP_START_SECTOR;
+        sb->block_count = FS_MAX_BLOCKS;
+        sb->journal_start_sector = FS_JOURNAL_START_SECTOR;
+        sb->journal_sectors = FS_JOURNAL_SECTORS;
+        sb->hash_start_sector = FS_HASH_START_SECTOR;
+    } else if (lba < FS_EXTENT_START_SECTOR) {
+        fs_disk_inode_t* in = (fs_disk_inode_t*)out;
+        uint32_t index = lba - FS_INODE_START_SECTOR;
+        const file_t* f = &core->files[index];
+        strcpy(in->name, f->name);
+        in->type = core->file_type[index];
+        in->size = f->size;
+        in->parent_index = core->file_parent[index];
+        in->block_count = f->block_count;
+        in->first_extent = f->first_extent;
+        in->generation = f->generation;
+        in->flags = f->flags;
+    } else if (lba < FS_BITMAP_START_SECTOR) {
+        fs_disk_extent_t* ex = (fs_disk_extent_t*)out;
+        uint32_t first = (lba - FS_EXTENT_START_SECTOR) * FS_EXTENTS_PER_SECTOR;
+        for (uint32_t i = 0; i < FS_EXTENTS_PER_SECTOR; i++) {
+            ex[i].start = core->extents[first + i].start;
+            ex[i].count = core->extents[first + i].count;
+            ex[i].next = core->extents[first + i].next;
+            ex[i].info = core->extents[first + i].info;
+        }
+    } else if (lba < FS_HASH_START_SECTOR) {
+        const uint8_t* src = (const uint8_t*)core->block_bitmap +
+                             (lba - FS_BITMAP_START_SECTOR) * BLOCK_SECTOR_SIZE;
+        for (uint32_t j = 0; j < BLOCK_SECTOR_SIZE; j++) {
+            out[j] = src[j];
+        }
+    } else {
+        const uint8_t* src = (const uint8_t*)core->block_hash +
+                             (lba - FS_HASH_START_SECTOR) * BLOCK_SECTOR_SIZE;
+        for (uint32_t j = 0; j < BLOCK_SECTOR_SIZE; j++) {
+            out[j] = src[j];
+        }
+    }
+}
+
+// Запись отмеченных в map секторов метаданных на их место.
+// Соседние сектора объединяются в один запрос.
+static int meta_write_home(uint32_t* map) {
+    uint32_t n = 0;
+    while (n < FS_META_SECTORS) {
+        if (!map[n / 32]) {
+            n = (n / 32 + 1) * 32;
+            continue;
+        }
+        if (!bit_test(map, n)) {
+            n++;
+            continue;
+        }
+        uint32_t run = 0;
+        while (n + run < FS_META_SECTORS && run < FS_JOURNAL_SECTORS - 1 &&
+               bit_test(map, n + run)) {
+            meta_serialize(FS_SUPERBLOCK_SECTOR + n + run, journal_buf + run * BLOCK_SECTOR_SIZE);
+            run++;
+        }
+        if (block_write(fs_dev, FS_SUPERBLOCK_SECTOR + n, run, journal_buf) < 0) {
+            return -1;
+        }
+        for (uint32_t k = n; k < n + run; k++) {
+            map[k / 32] &= ~(1u << (k % 32));
+        }
+        n += run;
+    }
+    return 0;
+}
+
+static int journal_write_header(void) {
+    fs_journal_header_t* hdr = (fs_journal_header_t*)sector_buf;
+    for (uint32_t j = 0; j < BLOCK_SECTOR_SIZE; j++) {
+        sector_buf[j] = 0;
+    }
+    hdr->magic = FS_JOURNAL_MAGIC;
+    hdr->sequence = journal_seq;
+    return block_write(fs_dev, FS_JOURNAL_START_SECTOR, 1, sector_buf);
+}
+
+// Перенос зафиксированных секторов на место и очистка журнала.
+// Вызывается только сразу после фиксации, когда состояние в памяти
+// совпадает с последней зафиксированной транзакцией.
+static int journal_checkpoint(void) {
+    if (meta_write_home(meta_ckpt) < 0 || block_flush(fs_dev) < 0) {
+        return -1;
+    }
+    // Новый номер в заголовке делает старые транзакции недействительными
+    if (journal_write_header() < 0) {
+        return -1;
+    }
+    journal_head = 1;
+    fs_stats.checkpoints++;
+    return 0;
+}
+
+// Контрольная сумма образов (FNV-1a), продолжается с hash
+#define JOURNAL_CHECKSUM_SEED 2166136261u
+
+static uint32_t journal_checksum(uint32_t hash, const uint8_t* data, uint32_t size) {
+    for (uint32_t i = 0; i < size; i++) {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static int journal_checkpoint_log(void);
+
+// Групповая фиксация: все накопленные изменения метаданных записываются
+// в журнал одной последовательной записью (дескриптор, образы, фиксация).
+// Блоки данных пишутся раньше, чтобы метаданные не ссылались на мусор.
+int fs_commit(void) {
+    if (!fs_dev) {
+        return -1;
+    }
+    if (bcache_flush(fs_dev) < 0) {
+        return -1;
+    }
+    if (!meta_dirty_count) {
+        journal_pending = 0;
+        journal_age = 0;
+        return 0;
+    }
+
+    // Пакет закрывается на FS_JOURNAL_BATCH_SECTORS, а одна операция
+    // меняет не больше суперблока, inode, битовой карты, хешей и
+    // экстентов одного файла, поэтому транзакция всегда помещается в
+    // пустой журнал. Метаданные мимо журнала не пишутся никогда.
+    uint32_t descs = (meta_dirty_count + FS_JOURNAL_DESC_LBAS - 1) / FS_JOURNAL_DESC_LBAS;
+    uint32_t sectors = meta_dirty_count + descs + 1;
+    if (meta_dirty_count > FS_JOURNAL_TXN_MAX) {
+        return -1;
+    }
+    if (journal_head + sectors > FS_JOURNAL_SECTORS && journal_checkpoint_log() < 0) {
+        return -1;
+    }
+
+    fs_journal_desc_t* desc = NULL;
+    uint32_t used = 0;       // Сектора транзакции в journal_buf
+    uint32_t count = 0;
+    uint32_t checksum = JOURNAL_CHECKSUM_SEED;
+    for (uint32_t n = 0; n < FS_META_SECTORS; n++) {
+        if (!meta_dirty[n / 32]) {
+            n = (n / 32 + 1) * 32 - 1;
+            continue;
+        }
+        if (!bit_test(meta_dirty, n)) {
+            continue;
+        }
+        if (!desc || desc->count == FS_JOURNAL_DESC_LBAS) {
+            desc = (fs_journal_desc_t*)(journal_buf + used * BLOCK_SECTOR_SIZE);
+            for (uint32_t j = 0; j < BLOCK_SECTOR_SIZE; j++) {
+                ((uint8_t*)desc)[j] = 0;
+            }
+            desc->magic = FS_JOURNAL_DESC_MAGIC;
+            desc->sequence = journal_seq;
+            used++;
+        }
+        uint8_t* image = journal_buf + used * BLOCK_SECTOR_SIZE;
+        desc->lba[desc->count++] = FS_SUPERBLOCK_SECTOR + n;
+        meta_serialize(FS_SUPERBLOCK_SECTOR + n, image);
+        checksum = journal_checksum(checksum, image, BLOCK_SECTOR_SIZE);
+        used++;
+        count++;
+    }
+
+    fs_journal_commit_t* commit = (fs_journal_commit_t*)(journal_buf + used * BLOCK_SECTOR_SIZE);
+    for (uint32_t j = 0; j < BLOCK_SECTOR_SIZE; j++) {
+        ((uint8_t*)commit)[j] = 0;
+    }
+    commit->magic = FS_JOURNAL_COMMIT_MAGIC;
+    commit->sequence = journal_seq;
+    commit->count = count;
+    commit->checksum = checksum;
+    used++;
+
+    // Барьеры: данные на носителе до транзакции, транзакция - до переноса
+    // секторов на место и до возврата из fs_commit
+    if (block_flush(fs_dev) < 0 ||
+        block_write(fs_dev, FS_JOURNAL_START_SECTOR + journal_head, used, journal_buf) < 0 ||
+        block_flush(fs_dev) < 0) {
+        return -1;
+    }
+
+    // Транзакция на диске: сектора переходят в ожидание переноса на место
+    for (uint32_t i = 0; i < (FS_META_SECTORS + 31) / 32; i++) {
+        meta_ckpt[i] |= meta_dirty[i];
+        meta_dirty[i] = 0;
+    }
+    meta_dirty_count = 0;
+    journal_head += used;
+    journal_seq++;
+    block_release_pending();
+    fs_stats.journal_ops += journal_pending;
+    fs_stats.journal_commits++;
+    fs_stats.journal_sectors += used;
+    journal_pending = 0;
+    journal_age = 0;
+
+    // Освобождаем журнал заранее, чтобы следующая транзакция поместилась
+    if (journal_head + FS_JOURNAL_RESERVE > FS_JOURNAL_SECTORS) {
+        return journal_checkpoint();
+    }
+    return 0;
+}
+
+// Учет изменяющей операции. Фиксация откладывается до накопления пакета.
+static void fs_journal_op(void) {
+    if (!fs_dev) {
+        return;
+    }
+    journal_pending++;
+    if (journal_pending >= FS_JOURNAL_BATCH_OPS || meta_dirty_count >= FS_JOURNAL_BATCH_SECTORS) {
+        fs_commit();
+    }
+}
+
+// Периодический вызов: фиксирует накопившиеся операции по истечении срока.
+// На полпути блоки данных заранее уходят в фоновую запись, чтобы
+// фиксация не ждала их целиком.
+void fs_sync_tick(void) {
+    if (!fs_dev || !journal_pending) {
+        return;
+    }
+    journal_age++;
+    if (journal_age == FS_JOURNAL_COMMIT_TICKS / 2) {
+        bcache_writeback(fs_dev);
+    } else if (journal_age >= FS_JOURNAL_COMMIT_TICKS) {
+        fs_commit();
+    }
+}
+
+// Воспроизведение журнала после сбоя: все полностью записанные
+// транзакции, начиная с номера из заголовка, переносятся на место
+static int journal_replay(void) {
+    fs_journal_header_t* hdr = (fs_journal_header_t*)sector_buf;
+    if (block_read(fs_dev, FS_JOURNAL_START_SECTOR, 1, sector_buf) < 0) {
+        return -1;
+    }
+    if (hdr->magic != FS_JOURNAL_MAGIC) {
+        return -1;  // Журнал не инициализирован
+    }
+    journal_seq = hdr->sequence;
+
+    uint32_t pos = 1;
+    uint32_t replayed = 0;
+    while (pos < FS_JOURNAL_SECTORS) {
+        // Транзакция читается в journal_buf целиком: дескрипторы с
+        // образами до первого сектора, который не является дескриптором
+        uint32_t start = pos;
+        uint32_t count = 0;
+        uint32_t checksum = JOURNAL_CHECKSUM_SEED;
+        int complete = 0;
+        while (pos < FS_JOURNAL_SECTORS) {
+            uint8_t* sector = journal_buf + (pos - start) * BLOCK_SECTOR_SIZE;
+            if (block_read(fs_dev, FS_JOURNAL_START_SECTOR + pos, 1, sector) < 0) {
+                return -1;
+            }
+            fs_journal_desc_t* desc = (fs_journal_desc_t*)sector;
+            uint32_t n = desc->count;
+            if (desc->magic == FS_JOURNAL_DESC_MAGIC && desc->sequence == journal_seq &&
+                n != 0 && n <= FS_JOURNAL_DESC_LBAS && pos + n + 2 <= FS_JOURNAL_SECTORS) {
+                uint8_t* images = sector + BLOCK_SECTOR_SIZE;
+                if (block_read(fs_dev, FS_JOURNAL_START_SECTOR + pos + 1, n, images) < 0) {
+                    return -1;
+                }
+                checksum = journal_checksum(checksum, images, n * BLOCK_SECTOR_SIZE);
+                count += n;
+                pos += n + 1;
+                continue;
+            }
+            fs_journal_commit_t* commit = (fs_journal_commit_t*)sector;
+            complete = count && commit->magic == FS_JOURNAL_COMMIT_MAGIC &&
+                       commit->sequence == journal_seq && commit->count == count &&
+                       commit->checksum == checksum;
+            break;
+        }
+        if (!complete) {
+            break;  // Транзакция записана не полностью
+        }
+
+        for (uint32_t at = 0; at < pos - start;) {
+            fs_journal_desc_t* desc = (fs_journal_desc_t*)(journal_buf + at * BLOCK_SECTOR_SIZE);
+            for (uint32_t i = 0; i < desc->count; i++) {
+                uint32_t lba = desc->lba[i];
+                if (lba < FS_SUPERBLOCK_SECTOR || lba >= FS_JOURNAL_START_SECTOR) {
+                    return -1;
+                }
+                if (block_write(fs_dev, lba, 1, journal_buf + (at + 1 + i) * BLOCK_SECTOR_SIZE) < 0) {
+                    return -1;
+                }
+            }
+            at += desc->count + 1;
+        }
+        pos++;  // Запись фиксации
+        journal_seq++;
+        replayed++;
+    }
+
+    journal_head = 1;
+    // Сектора на месте до того, как новый заголовок отменит журнал
+    if (replayed && (block_flush(fs_dev) < 0 || journal_write_header() < 0)) {
+        return -1;
+    }
+    return 0;
+}
+
+// Перенос на место по записям самого журнала, когда очередная
+// транзакция не помещается в остаток. В отличие от journal_checkpoint,
+// годится и тогда, когда в памяти уже есть незафиксированные изменения.
+static int journal_checkpoint_log(void) {
+    uint32_t seq = journal_seq;
+    if (block_flush(fs_dev) < 0 || journal_replay() < 0 || journal_seq != seq) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < (FS_META_SECTORS + 31) / 32; i++) {
+        meta_ckpt[i] = 0;
+    }
+    fs_stats.checkpoints++;
+    return 0;
+}
+
+// Сохранение файловой системы на диск: фиксация всех изменений
+// и перенос журнала на место
+int fs_save(void) {
+    if (fs_commit() < 0) {
+        return -1;
+    }
+    return journal_checkpoint();
+}
+
+// Суперблок с разметкой, которую понимает этот код
+static int superblock_valid(const superblock_t* sb) {
+    return sb->magic == FS_MAGIC && sb->version == FS_VERSION &&
+           sb->file_count != 0 && sb->file_count <= MAX_FILES &&
+           sb->inode_start_sector == FS_INODE_START_SECTOR &&
+           sb->extent_start_sector == FS_EXTENT_START_SECTOR &&
+           sb->bitmap_start_sector == FS_BITMAP_START_SECTOR &&
+           sb->first_data_sector == FS_DATA_START_SECTOR &&
+           sb->block_count == FS_MAX_BLOCKS &&
+           sb->journal_start_sector == FS_JOURNAL_START_SECTOR &&
+           sb->journal_sectors == FS_JOURNAL_SECTORS &&
+           sb->hash_start_sector == FS_HASH_START_SECTOR;
+}
+
+static void core_reset(void);
+
+// Загрузка состояния с диска, под записью names
+static int load_core(void) {
+    if (!fs_dev) {
+        return -1;
+    }
+
+    if (journal_replay() < 0) {
+        return -1;
+    }
+
+    superblock_t* sb = (superblock_t*)sector_buf;
+    if (block_read(fs_dev, FS_SUPERBLOCK_SECTOR, 1, sector_buf) < 0) {
+        return -1;
+    }
+    if (!superblock_valid(sb)) {
+        return -1;
+    }
+    uint32_t count = sb->file_count;
+
+    // Начинаем с чистого состояния в памяти
+    core_reset();
+    core->file_count = count;
+
+    // Inode
+    const fs_disk_inode_t* in = (const fs_disk_inode_t*)sector_buf;
+    for (uint32_t i = 0; i < core->file_count; i++) {
+        if (block_read(fs_dev, FS_INODE_START_SECTOR + i, 1, sector_buf) < 0) {
+            return -1;
+        }
+        // Неизвестный тип и корень не-директория - поврежденная таблица
+        if (in->type > FILE_TYPE_DIR || (i == 0 && in->type != FILE_TYPE_DIR)) {
+            return -1;
+        }
+        strncpy(core->files[i].name, in->name, MAX_FILENAME - 1);
+        core->file_type[i] = in->type;
+        core->files[i].size = in->size;
+        core->file_parent[i] = in->parent_index;
+        core->files[i].block_count = in->block_count;
+        core->files[i].first_extent = in->first_extent;
+        core->files[i].generation = in->generation;
+        core->files[i].flags = in->flags;
+    }
+
+    // Таблица экстентов
+    const fs_disk_extent_t* ex = (const fs_disk_extent_t*)sector_buf;
+    for (uint32_t sector = 0; sector < FS_EXTENT_SECTORS; sector++) {
+        if (block_read(fs_dev, FS_EXTENT_START_SECTOR + sector, 1, sector_buf) < 0) {
+            return -1;
+        }
+        for (uint32_t i = 0; i < FS_EXTENTS_PER_SECTOR; i++) {
+            fs_extent_t* e = &core->extents[sector * FS_EXTENTS_PER_SECTOR + i];
+            e->start = ex[i].start;
+            e->count = ex[i].count;
+            e->next = ex[i].next;
+            e->info = ex[i].info;
+        }
+    }
+
+    // Битовая карта блоков. Сами блоки читаются через кэш по мере обращения.
+    if (block_read(fs_dev, FS_BITMAP_START_SECTOR, FS_BITMAP_SECTORS, core->block_bitmap) < 0) {
+        return -1;
+    }
+    core->blocks_free = 0;
+    for (uint32_t b = 0; b < FS_MAX_BLOCKS; b++) {
+        if (!block_used(b)) {
+            core->blocks_free++;
+        }
+    }
+    if (block_read(fs_dev, FS_HASH_START_SECTOR, FS_HASH_SECTORS, core->block_hash) < 0) {
+        return -1;
+    }
+
+    // Восстанавливаем производные структуры: списки экстентов,
+    // свободные слоты, списки элементов директорий и кэш имен
+    static uint32_t extent_used[FS_MAX_EXTENTS / 32];
+    for (uint32_t i = 0; i < FS_MAX_EXTENTS / 32; i++) {
+        extent_used[i] = 0;
+    }
+    core->slot_free_head = -1;
+    for (uint32_t i = core->file_count; i-- > 1;) {
+        if (core->file_type[i] == FILE_TYPE_NONE) {
+            core->file_parent[i] = -1;
+            core->slot_free_next[i] = core->slot_free_head;
+            core->slot_free_head = i;
+        }
+    }
+    for (uint32_t i = 0; i < core->file_count; i++) {
+        if (core->file_type[i] == FILE_TYPE_NONE) {
+            continue;
+        }
+        core->files[i].last_extent = -1;
+        uint32_t steps = 0;
+        for (int32_t e = core->files[i].first_extent; e != -1; e = core->extents[e].next) {
+            if (e < 0 || e >= FS_MAX_EXTENTS || bit_test(extent_used, e) || ++steps > FS_MAX_EXTENTS ||
+                core->extents[e].start > FS_MAX_BLOCKS ||
+                core->extents[e].count > FS_MAX_BLOCKS - core->extents[e].start) {
+                return -1;  // Поврежденный список экстентов
+            }
+            bit_set(extent_used, e);
+            core->files[i].last_extent = e;
+            for (uint32_t b = core->extents[e].start; b < core->extents[e].start + core->extents[e].count; b++) {
+                if (!block_used(b)) {
+                    return -1;  // Экстент ссылается на свободный блок
+                }
+                block_ref(b);
+            }
+        }
+        if (i != 0) {
+            if (core->file_parent[i] >= core->file_count ||
+                core->file_type[core->file_parent[i]] != FILE_TYPE_DIR) {
+                return -1;
+            }
+            child_link(i);
+        }
+    }
+    core->extent_free_head = -1;
+    core->extents_free = 0;
+    for (int32_t e = FS_MAX_EXTENTS - 1; e >= 0; e--) {
+        if (!bit_test(extent_used, e)) {
+            extent_free(e);
+        }
+    }
+    dcache_rebuild();
+
+    // Индекс дедупликации по сохраненным хешам занятых блоков
+    for (uint32_t b = 0; b < FS_MAX_BLOCKS; b++) {
+        uint32_t hash = core->block_hash[b];
+        core->block_hash[b] = 0;
+        if (hash && core->block_refs[b]) {
+            dedup_insert(b, hash);
+        }
+    }
+
+    // Состояние в памяти совпадает с диском
+    fs_clear_dirty();
+    return 0;
+}
+
+// Загрузка файловой системы с диска
+int fs_load(void) {
+    seq_write_lock(&names);
+    int status = load_core();
+    seq_write_unlock(&names);
+    return status;
+}
+
+// Подключение устройства. Форматируется только устройство без
+// файловой системы (в суперблоке нет FS_MAGIC). Ошибка чтения, журнала
+// или поврежденные метаданные существующего тома возвращают -1, и
+// устройство остается нетронутым.
+int fs_mount(block_device_t* dev) {
+    if (!dev || dev->sector_count < FS_END_SECTOR) {
+        return -1;
+    }
+    if (block_read(dev, FS_SUPERBLOCK_SECTOR, 1, sector_buf) < 0) {
+        return -1;
+    }
+    fs_dev = dev;
+    if (((const superblock_t*)sector_buf)->magic == FS_MAGIC) {
+        if (fs_load() == 0) {
+            return 0;
+        }
+        // Частично загруженное состояние не должно попасть на диск
+        fs_dev = NULL;
+        fs_init();
+        return -1;
+    }
+
+    // Создаем пустую файловую систему и записываем ее целиком
+    fs_init();
+    journal_seq = 1;
+    journal_head = 1;
+    meta_mark_dirty(FS_SUPERBLOCK_SECTOR);
+    inode_mark_dirty(0);
+    for (uint32_t sector = 0; sector < FS_BITMAP_SECTORS + FS_HASH_SECTORS; sector++) {
+        meta_mark_dirty(FS_BITMAP_START_SECTOR + sector);
+    }
+    return fs_save();
+}
+
+// Сектор устройства совпадает с тем же сектором образа в памяти
+static int image_sector_matches(block_device_t* dev, const uint8_t* base, uint32_t lba) {
+    if (block_read(dev, lba, 1, sector_buf) < 0) {
+        return 0;
+    }
+    const uint8_t* expected = base + (lba - FS_SUPERBLOCK_SECTOR) * BLOCK_SECTOR_SIZE;
+    for (uint32_t j = 0; j < BLOCK_SECTOR_SIZE; j++) {
+        if (sector_buf[j] != expected[j]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Монтирование образа в памяти. dev должен хранить тот же том, что
+// и образ (суперблок, заголовок журнала и заголовок снимка совпадают),
+// иначе возвращается -1 и ничего не монтируется. Это может быть диск,
+// с которого образ загружен, или устройство над памятью самого образа.
+// Снимок состояния годится, только если том не менялся после его записи:
+// номер в заголовке журнала совпадает с номером снимка и в журнале нет
+// транзакций. Проверка и подключение не зависят от числа файлов;
+// без годного снимка том загружается с dev обычным образом.
+int fs_mount_image(block_device_t* dev, void* image, uint64_t size) {
+    if (!dev || !image || size < (FS_END_SECTOR - FS_SUPERBLOCK_SECTOR) * BLOCK_SECTOR_SIZE ||
+        dev->sector_count < FS_END_SECTOR) {
+        return -1;
+    }
+    uint8_t* base = (uint8_t*)image;
+    int has_snapshot = size >= FS_IMAGE_SIZE && dev->sector_count >= FS_IMAGE_END_SECTOR;
+    if (!image_sector_matches(dev, base, FS_SUPERBLOCK_SECTOR) ||
+        !image_sector_matches(dev, base, FS_JOURNAL_START_SECTOR) ||
+        (has_snapshot && !image_sector_matches(dev, base, FS_SNAPSHOT_START_SECTOR))) {
+        return -1;
+    }
+
+    const superblock_t* sb = (const superblock_t*)base;
+    const fs_journal_header_t* hdr = (const fs_journal_header_t*)
+        (base + (FS_JOURNAL_START_SECTOR - FS_SUPERBLOCK_SECTOR) * BLOCK_SECTOR_SIZE);
+    const fs_journal_desc_t* desc = (const fs_journal_desc_t*)((const uint8_t*)hdr + BLOCK_SECTOR_SIZE);
+    const fs_snapshot_header_t* snap = (const fs_snapshot_header_t*)
+        (base + (FS_SNAPSHOT_START_SECTOR - FS_SUPERBLOCK_SECTOR) * BLOCK_SECTOR_SIZE);
+    if (!has_snapshot || !superblock_valid(sb) || hdr->magic != FS_JOURNAL_MAGIC ||
+        snap->magic != FS_SNAPSHOT_MAGIC || snap->version != FS_VERSION ||
+        snap->core_size != sizeof(fs_core_t) || snap->journal_sequence != hdr->sequence ||
+        (desc->magic == FS_JOURNAL_DESC_MAGIC && desc->sequence == hdr->sequence)) {
+        return fs_mount(dev);
+    }
+
+    seq_write_lock(&names);
+    core_reset();
+    core = (fs_core_t*)((uint8_t*)snap + BLOCK_SECTOR_SIZE);
+    seq_write_unlock(&names);
+    fs_dev = dev;
+    journal_seq = hdr->sequence;
+    journal_head = 1;
+    return 0;
+}
+
+// Запись снимка состояния после тома. Вызывается, когда все изменения
+// сохранены (fs_save) и ни один файл не отображен.
+int fs_write_snapshot(void) {
+    if (!fs_dev || fs_dev->sector_count < FS_IMAGE_END_SECTOR || fs_save() < 0) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < core->file_count; i++) {
+        if (core->files[i].map_count) {
+            return -1;
+        }
+    }
+    fs_snapshot_header_t* snap = (fs_snapshot_header_t*)sector_buf;
+    for (uint32_t j = 0; j < BLOCK_SECTOR_SIZE; j++) {
+        sector_buf[j] = 0;
+    }
+    snap->magic = FS_SNAPSHOT_MAGIC;
+    snap->version = FS_VERSION;
+    snap->core_size = sizeof(fs_core_t);
+    snap->journal_sequence = journal_seq;
+
+    // Заголовок затирается до записи данных и пишется последним:
+    // прерванная запись оставляет снимок недействительным
+    const uint8_t* data = (const uint8_t*)core;
+    uint32_t full = sizeof(fs_core_t) / BLOCK_SECTOR_SIZE;
+    uint32_t tail = sizeof(fs_core_t) % BLOCK_SECTOR_SIZE;
+    uint32_t lba = FS_SNAPSHOT_START_SECTOR + 1;
+    for (uint32_t j = 0; j < BLOCK_SECTOR_SIZE; j++) {
+        journal_buf[j] = 0;
+    }
+    if (block_write(fs_dev, FS_SNAPSHOT_START_SECTOR, 1, journal_buf) < 0) {
+        return -1;
+    }
+    for (uint32_t done = 0; done < full; done += FS_JOURNAL_TXN_MAX) {
+        uint32_t count = full - done < FS_JOURNAL_TXN_MAX ? full - done : FS_JOURNAL_TXN_MAX;
+        if (block_write(fs_dev, lba + done, count, data + done * BLOCK_SECTOR_SIZE) < 0) {
+            return -1;
+        }
+    }
+    if (tail) {
+        for (uint32_t j = 0; j < BLOCK_SECTOR_SIZE; j++) {
+            journal_buf[j] = j < tail ? data[full * BLOCK_SECTOR_SIZE + j] : 0;
+        }
+        if (block_write(fs_dev, lba + full, 1, journal_buf) < 0) {
+            return -1;
+        }
+    }
+    return block_write(fs_dev, FS_SNAPSHOT_START_SECTOR, 1, sector_buf);
+}
+
+static void core_reset(void) {
+    // Снимок из образа больше не используется
+    core = &core_mem;
+    for (uint32_t i = 0; i < MAX_FILES; i++) {
+        core->file_type[i] = FILE_TYPE_NONE;
+        core->files[i].size = 0;
+        core->files[i].flags = 0;
+        core->files[i].name[0] = 0;
+        core->file_parent[i] = -1;
+        core->files[i].block_count = 0;
+        core->files[i].first_extent = -1;
+        core->files[i].last_extent = -1;
+        core->files[i].generation = 0;
+        core->files[i].first_child = -1;
+        core->files[i].last_child = -1;
+        core->file_next_sibling[i] = -1;
+        core->files[i].prev_sibling = -1;
+        core->files[i].map_count = 0;
+    }
+    core->slot_free_head = -1;
+    for (uint32_t i = 0; i < FS_MAX_OPEN; i++) {
+        open_files[i].index = -1;
+    }
+
+    // Все блоки и экстенты свободны
+    for (uint32_t i = 0; i < FS_MAX_BLOCKS / 32; i++) {
+        core->block_bitmap[i] = 0;
+    }
+    core->blocks_free = FS_MAX_BLOCKS;
+    core->block_hint = 0;
+    for (uint32_t b = 0; b < FS_MAX_BLOCKS; b++) {
+        core->block_refs[b] = 0;
+        core->block_hash[b] = 0;
+    }
+    for (uint32_t i = 0; i < FS_DEDUP_BUCKETS; i++) {
+        core->dedup_buckets[i] = -1;
+    }
+    core->blocks_shared = 0;
+
+    core->extent_free_head = -1;
+    core->extents_free = 0;
+    zcache_extent = -1;
+    for (int32_t i = FS_MAX_EXTENTS - 1; i >= 0; i--) {
+        extent_free(i);
+    }
+    fs_clear_dirty();
+    
+    // Создаем корневую директорию
+    core->files[0].name[0] = 0;  // Пустое имя для корневой директории
+    core->file_type[0] = FILE_TYPE_DIR;
+    core->files[0].size = 0;
+    core->file_parent[0] = 0;  // Корень является родителем для самого себя
+    core->file_count = 1;
+
+    dcache_rebuild();
+}
+
+void fs_init(void) {
+    seq_register(&names, "fs names");
+    seq_write_lock(&names);
+    core_reset();
+    seq_write_unlock(&names);
+}
+
+int fs_create_file(const char* name, file_type_t type, uint32_t parent_index) {
+    // Проверяем, что родительская директория существует и является директорией
+    if (parent_index >= MAX_FILES || core->file_type[parent_index] != FILE_TYPE_DIR) {
+        return -1;
+    }
+    
+    // Проверяем, что файл с таким именем не существует в этой директории
+    if (fs_lookup(parent_index, name) != -1) {
+        return -1;  // Файл уже существует
+    }
+    
+    // Создаем новый файл
+    seq_write_lock(&names);
+    int32_t index = slot_alloc();
+    if (index < 0) {
+        seq_write_unlock(&names);
+        return -1;  // Нет свободного места
+    }
+    strcpy(core->files[index].name, name);
+    core->file_type[index] = type;
+    core->files[index].size = 0;
+    core->files[index].flags = 0;
+    core->file_parent[index] = parent_index;
+    core->files[index].block_count = 0;
+    core->files[index].first_extent = -1;
+    core->files[index].last_extent = -1;
+    core->files[index].first_child = -1;
+    core->files[index].last_child = -1;
+    dcache_insert(index);
+    child_link(index);
+    seq_write_unlock(&names);
+    inode_mark_dirty(index);
+    
+    // Фиксируем изменения в журнале
+    fs_journal_op();
+    
+    return index;
+}
+
+// Весь путь разбирается за одно чтение names, поэтому результат
+// соответствует одному состоянию пространства имен
+int fs_parse_path(const char* path) {
+    char component[MAX_FILENAME];
+    
+    // Если путь пустой или это корень, возвращаем индекс корневой директории
+    if (!*path || (*path == '/' && !*(path + 1))) {
+        return 0;
+    }
+    
+    lookup_cost_t cost;
+    int32_t current_index;
+    uint32_t sequence;
+    do {
+        lookup_cost_t empty = {0};
+        cost = empty;
+        sequence = seq_read_begin(&names);
+        const fs_core_t* c = core;
+        const char* rest = path;
+        current_index = 0;  // Начинаем с корневой директории
+        
+        // Разбираем путь по компонентам
+        while (rest && current_index != -1) {
+            rest = get_next_path_component(rest, component);
+            if (!component[0]) continue;  // Пустой компонент
+            
+            // Ищем компонент в текущей директории
+            current_index = dcache_find(c, current_index, component, &cost);
+        }
+    } while (seq_read_retry(&names, sequence));
+    lookup_account(&cost);
+    
+    return current_index;
+}
+
+file_type_t fs_file_type(uint32_t index) {
+    return index < core->file_count ? (file_type_t)core->file_type[index] : FILE_TYPE_NONE;
+}
+
+file_t* fs_get_file(const char* path) {
+    int index = fs_parse_path(path);
+    if (index < 0) {
+        return NULL;
+    }
+    return &core->files[index];
+}
+
+// Распакованное содержимое кластера сжатого файла (экстента e).
+// Результат лежит в zcache_data до распаковки другого кластера.
+static const uint8_t* cluster_load(int32_t e) {
+    if (zcache_extent == e) {
+        return zcache_data;
+    }
+    uint32_t info = core->extents[e].info;
+    uint8_t* dst = (info & FS_EXTENT_COMPRESSED) ? zbuf : zcache_data;
+    uint32_t lba = FS_DATA_START_SECTOR + core->extents[e].start;
+    if (core->extents[e].count > 1) {
+        bcache_readahead(fs_dev, lba, core->extents[e].count);
+    }
+    for (uint32_t b = 0; b < core->extents[e].count; b++) {
+        bcache_buf_t* buf = bcache_get(fs_dev, lba + b);
+        if (!buf) {
+            return NULL;
+        }
+        for (uint32_t i = 0; i < FS_BLOCK_SIZE; i++) {
+            dst[b * FS_BLOCK_SIZE + i] = buf->data[i];
+        }
+        bcache_release(buf);
+    }
+    if (info & FS_EXTENT_COMPRESSED) {
+        int len = lz4_decompress(zbuf, FS_EXTENT_PACKED_LEN(info), zcache_data, FS_CLUSTER_SIZE);
+        if (len != (int)FS_EXTENT_RAW_LEN(info)) {
+            return NULL;  // Поврежденный кластер
+        }
+        fs_stats.clusters_unpacked++;
+    }
+    zcache_extent = e;
+    return zcache_data;
+}
+
+// Освобождение списка экстентов, уже отсоединенного от файла
+static void extent_list_free(int32_t e) {
+    while (e != -1) {
+        int32_t next = core->extents[e].next;
+        block_free_run(core->extents[e].start, core->extents[e].count);
+        extent_free(e);
+        e = next;
+    }
+}
+
+// Входит ли блок block в обычные экстенты списка, начиная с e
+static int extent_list_has(int32_t e, uint32_t block) {
+    for (; e != -1; e = core->extents[e].next) {
+        if (!core->extents[e].info && block >= core->extents[e].start &&
+            block < core->extents[e].start + core->extents[e].count) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Запись файла целиком в сжатом размещении. Для каждого кластера
+// решается отдельно: сжатый вариант берется, если экономит хотя бы блок.
+// Новое размещение строится рядом со старым, старое освобождается только
+// после успеха. Если не сжался ни один кластер или не хватило места,
+// файл не меняется и пишется обычным способом.
+static int file_write_packed(file_t* file, const uint8_t* data, uint32_t size) {
+    int32_t old_first = file->first_extent;
+    int32_t old_last = file->last_extent;
+    uint32_t old_count = file->block_count;
+    uint32_t old_flags = file->flags;
+    uint32_t packed_count = 0;
+    uint32_t raw_count = 0;
+
+    file->first_extent = -1;
+    file->last_extent = -1;
+    file->block_count = 0;
+    for (uint32_t done = 0; done < size; done += FS_CLUSTER_SIZE) {
+        uint32_t raw = size - done < FS_CLUSTER_SIZE ? size - done : FS_CLUSTER_SIZE;
+        uint32_t raw_blocks = (raw + FS_BLOCK_SIZE - 1) / FS_BLOCK_SIZE;
+        uint32_t packed = raw_blocks > 1 ?
+            lz4_compress(data + done, raw, zbuf, (raw_blocks - 1) * FS_BLOCK_SIZE) : 0;
+        const uint8_t* src = packed ? zbuf : data + done;
+        uint32_t len = packed ? packed : raw;
+        uint32_t count = (len + FS_BLOCK_SIZE - 1) / FS_BLOCK_SIZE;
+
+        int32_t last = file->last_extent;
+        int start = block_alloc_contig(last != -1 ? core->extents[last].start + core->extents[last].count : core->block_hint, count);
+        int32_t e = start < 0 ? -1 : extent_alloc();
+        if (e == -1) {
+            if (start >= 0) {
+                block_free_run(start, count);
+            }
+            goto fail;
+        }
+        core->extents[e].start = start;
+        core->extents[e].count = count;
+        core->extents[e].info = (packed ? FS_EXTENT_COMPRESSED : 0) | raw << 16 | len;
+        if (last == -1) {
+            file->first_extent = e;
+        } else {
+            core->extents[last].next = e;
+            extent_mark_dirty(last);
+        }
+        file->last_extent = e;
+        file->block_count += count;
+
+        for (uint32_t b = 0; b < count; b++) {
+            bcache_buf_t* buf = bcache_get_nofill(fs_dev, FS_DATA_START_SECTOR + start + b);
+            if (!buf) {
+                goto fail;
+            }
+            uint32_t chunk = len - b * FS_BLOCK_SIZE < FS_BLOCK_SIZE ? len - b * FS_BLOCK_SIZE : FS_BLOCK_SIZE;
+            for (uint32_t i = 0; i < chunk; i++) {
+                buf->data[i] = src[b * FS_BLOCK_SIZE + i];
+            }
+            bcache_mark_dirty(buf);
+            bcache_release(buf);
+        }
+        packed ? packed_count++ : raw_count++;
+    }
+
+    if (!packed_count) {
+        goto fail;
+    }
+    extent_list_free(old_first);
+    fs_stats.clusters_packed += packed_count;
+    fs_stats.clusters_raw += raw_count;
+    file->flags |= FS_FILE_COMPRESSED;
+    file->size = size;
+    inode_mark_dirty(file - core->files);
+    return size;
+
+fail:
+    file_shrink(file, 0);
+    file->first_extent = old_first;
+    file->last_extent = old_last;
+    file->block_count = old_count;
+    file->flags = old_flags;
+    return -1;
+}
+
+static int file_write_at(file_t* file, const uint8_t* data, uint32_t size, uint32_t offset);
+
+// Добавление блока в конец списка блоков файла
+static int file_append_block(file_t* file, uint32_t block) {
+    int32_t last = file->last_extent;
+    if (last != -1 && !core->extents[last].info && core->extents[last].start + core->extents[last].count == block) {
+        core->extents[last].count++;
+        extent_mark_dirty(last);
+    } else {
+        int32_t e = extent_alloc();
+        if (e == -1) {
+            return -1;
+        }
+        core->extents[e].start = block;
+        core->extents[e].count = 1;
+        if (last == -1) {
+            file->first_extent = e;
+        } else {
+            core->extents[last].next = e;
+            extent_mark_dirty(last);
+        }
+        file->last_extent = e;
+    }
+    file->block_count++;
+    return 0;
+}
+
+// Запись файла целиком с дедупликацией: полный блок, содержимое которого
+// уже есть на томе, записывается ссылкой на существующий блок. Собственный
+// (не общий) блок старого размещения на той же позиции переписывается на
+// месте, как в file_write_at, поэтому перезапись не требует двойного
+// места; остальные новые блоки выделяются последовательностями. Старые
+// блоки, не вошедшие в новое размещение, освобождаются в конце.
+// На месте пишется, только если свободных блоков заведомо хватит: блок
+// выделяется лишь на позиции без собственного блока. Совпадение с
+// собственным блоком, который еще не переписан, при этом не берется:
+// блок стал бы общим, и его позиции понадобился бы новый. Ошибка тогда
+// возможна лишь при нехватке экстентов или буферов, и файл сохраняет
+// старое размещение с частично новым содержимым. Иначе все пишется в
+// новые блоки, и при ошибке файл не меняется.
+static int file_write_dedup(file_t* file, const uint8_t* data, uint32_t size) {
+    int32_t old_first = file->first_extent;
+    int32_t old_last = file->last_extent;
+    uint32_t old_count = file->block_count;
+    uint32_t old_size = file->size;
+    uint32_t old_flags = file->flags;
+    uint32_t blocks = (size + FS_BLOCK_SIZE - 1) / FS_BLOCK_SIZE;
+    uint32_t hits = 0;
+
+    // Собственные блоки старого размещения в пределах нового размера
+    uint32_t own_count = 0;
+    uint32_t base = 0;
+    for (int32_t e = old_first; e != -1 && base < blocks; e = core->extents[e].next) {
+        for (uint32_t j = 0; j < core->extents[e].count && base + j < blocks; j++) {
+            if (!core->extents[e].info && core->block_refs[core->extents[e].start + j] == 1) {
+                own_count++;
+            }
+        }
+        base += core->extents[e].count;
+    }
+    int in_place = blocks - own_count <= core->blocks_free;
+
+    int32_t oe = old_first;      // Экстент старого размещения на позиции n
+    uint32_t obase = 0;          // Номер его первого блока в файле
+    uint32_t run_next = 0;       // Выделенные, но еще не занятые блоки
+    uint32_t run_end = 0;
+    file->first_extent = -1;
+    file->last_extent = -1;
+    file->block_count = 0;
+    for (uint32_t n = 0; n < blocks; n++) {
+        uint32_t done = n * FS_BLOCK_SIZE;
+        uint32_t len = size - done < FS_BLOCK_SIZE ? size - done : FS_BLOCK_SIZE;
+        while (oe != -1 && n >= obase + core->extents[oe].count) {
+            obase += core->extents[oe].count;
+            oe = core->extents[oe].next;
+        }
+        int32_t own = -1;
+        if (in_place && oe != -1 && !core->extents[oe].info &&
+            core->block_refs[core->extents[oe].start + n - obase] == 1) {
+            own = core->extents[oe].start + n - obase;
+        }
+
+        uint32_t hash = 0;
+        int32_t block = -1;
+        if (len == FS_BLOCK_SIZE) {
+            hash = block_content_hash(data + done);
+            block = dedup_find(data + done, hash);
+            if (in_place && block != -1 && core->block_refs[block] == 1 && extent_list_has(oe, block)) {
+                block = -1;
+            }
+        }
+
+        if (block != -1) {
+            block_ref(block);
+            hits++;
+        } else {
+            if (own != -1) {
+                // Ссылка нового размещения; старое отпустит ее в конце
+                block = own;
+                block_ref(block);
+                dedup_remove(block);
+            } else {
+                if (run_next == run_end) {
+                    // За концом старого размещения нужны все оставшиеся блоки
+                    uint32_t want = n < old_count ? 1 : blocks - n;
+                    int32_t last = file->last_extent;
+                    uint32_t hint = last != -1 ? core->extents[last].start + core->extents[last].count : core->block_hint;
+                    uint32_t got = want;
+                    int start = block_alloc_contig(hint, want);
+                    if (start < 0) {
+                        start = block_alloc_run(hint, want, &got);
+                    }
+                    if (start < 0) {
+                        goto fail;
+                    }
+                    run_next = start;
+                    run_end = start + got;
+                }
+                block = run_next++;
+            }
+            bcache_buf_t* buf = bcache_get_nofill(fs_dev, FS_DATA_START_SECTOR + block);
+            if (!buf) {
+                block_free_run(block, 1);
+                goto fail;
+            }
+            for (uint32_t i = 0; i < len; i++) {
+                buf->data[i] = data[done + i];
+            }
+            bcache_mark_dirty(buf);
+            bcache_release(buf);
+            if (hash) {
+                dedup_insert(block, hash);
+            }
+        }
+        if (file_append_block(file, block) < 0) {
+            block_free_run(block, 1);
+            goto fail;
+        }
+    }
+
+    if (run_next < run_end) {
+        block_free_run(run_next, run_end - run_next);
+    }
+    extent_list_free(old_first);
+    fs_stats.dedup_hits += hits;
+    file->size = size;
+    file->flags &= ~FS_FILE_COMPRESSED;
+    return size;
+
+fail:
+    if (run_next < run_end) {
+        block_free_run(run_next, run_end - run_next);
+    }
+    file_shrink(file, 0);
+    file->first_extent = old_first;
+    file->last_extent = old_last;
+    file->block_count = old_count;
+    file->size = old_size;
+    file->flags = old_flags;
+    return -1;
 }
 
-// Вспомогательная функция для сравнения строк
-int strcmp(const char* s1, const char* s2) {
-    while (*s1 && (*s1 == *s2)) {
-        s1++;
-        s2++;
+// Копирование при записи: блок файла block, общий с другими файлами,
+// заменяется собственной копией. Экстент *ep (начинается с блока файла
+// *basep) разбивается так, что копия оказывается в отдельном экстенте,
+// который и возвращается через *ep и *basep.
+static int file_cow_block(file_t* file, int32_t* ep, uint32_t* basep, uint32_t block) {
+    int32_t e = *ep;
+    uint32_t i = block - *basep;
+    uint32_t old = core->extents[e].start + i;
+    uint32_t tail = core->extents[e].count - i - 1;
+
+    // Все нужное выделяется до изменения списка экстентов
+    uint32_t got;
+    int copy = block_alloc_run(core->block_hint, 1, &got);
+    if (copy < 0) {
+        return -1;
     }
-    return *(const unsigned char*)s1 - *(const unsigned char*)s2;
-}
+    int32_t mid = e;
+    int32_t rest = -1;
+    if ((i > 0 && (mid = extent_alloc()) == -1) ||
+        (tail > 0 && (rest = extent_alloc()) == -1)) {
+        if (mid != -1 && mid != e) {
+            extent_free(mid);
+        }
+        block_free_run(copy, 1);
+        return -1;
+    }
+    bcache_buf_t* src = bcache_get(fs_dev, FS_DATA_START_SECTOR + old);
+    bcache_buf_t* dst = src ? bcache_get_nofill(fs_dev, FS_DATA_START_SECTOR + copy) : NULL;
+    if (!dst) {
+        if (src) {
+            bcache_release(src);
+        }
+        if (mid != e) {
+            extent_free(mid);
+        }
+        if (rest != -1) {
+            extent_free(rest);
+        }
+        block_free_run(copy, 1);
+        return -1;
+    }
+    for (uint32_t j = 0; j < FS_BLOCK_SIZE; j++) {
+        dst->data[j] = src->data[j];
+    }
+    bcache_mark_dirty(dst);
+    bcache_release(dst);
+    bcache_release(src);
 
-// Вспомогательная функция для получения длины строки
-uint32_t strlen(const char* str) {
-    const char* s = str;
-    while (*s) s++;
-    return s - str;
-}
+    // [e: i блоков] -> [mid: копия] -> [rest: оставшиеся tail блоков]
+    int32_t next = core->extents[e].next;
+    uint32_t start = core->extents[e].start;
+    if (i > 0) {
+        core->extents[e].count = i;
+        core->extents[e].next = mid;
+        extent_mark_dirty(e);
+    }
+    if (rest != -1) {
+        core->extents[rest].start = start + i + 1;
+        core->extents[rest].count = tail;
+        core->extents[rest].next = next;
+        extent_mark_dirty(rest);
+        next = rest;
+    }
+    core->extents[mid].start = copy;
+    core->extents[mid].count = 1;
+    core->extents[mid].next = next;
+    extent_mark_dirty(mid);
+    if (file->last_extent == e) {
+        file->last_extent = rest != -1 ? rest : mid;
+    }
 
-// Вспомогательная функция для конкатенации строк
-void strcat(char* dest, const char* src) {
-    dest += strlen(dest);
-    strcpy(dest, src);
+    block_free_run(old, 1);
+    fs_stats.cow_copies++;
+    *ep = mid;
+    *basep = block;
+    return 0;
 }
 
-// Вспомогательная функция для копирования n символов
-void strncpy(char* dest, const char* src, uint32_t n) {
-    uint32_t i;
-    for (i = 0; i < n && src[i]; i++) {
-        dest[i] = src[i];
+// Перевод сжатого файла в обычное размещение перед частичной записью.
+// При ошибке файл остается сжатым.
+static int file_unpack(file_t* file) {
+    if (file->map_count) {
+        return -1;  // Отображенный файл нельзя переразмещать
     }
-    for (; i < n; i++) {
-        dest[i] = 0;
+    int32_t old_first = file->first_extent;
+    int32_t old_last = file->last_extent;
+    uint32_t old_count = file->block_count;
+    uint32_t old_size = file->size;
+
+    file->first_extent = -1;
+    file->last_extent = -1;
+    file->block_count = 0;
+    file->size = 0;
+    file->flags &= ~FS_FILE_COMPRESSED;
+    for (int32_t e = old_first; e != -1; e = core->extents[e].next) {
+        const uint8_t* raw = cluster_load(e);
+        if (!raw || file_write_at(file, raw, FS_EXTENT_RAW_LEN(core->extents[e].info), file->size) < 0) {
+            file_shrink(file, 0);
+            file->first_extent = old_first;
+            file->last_extent = old_last;
+            file->block_count = old_count;
+            file->size = old_size;
+            file->flags |= FS_FILE_COMPRESSED;
+            return -1;
+        }
     }
+
+    extent_list_free(old_first);
+    inode_mark_dirty(file - core->files);
+    return 0;
 }
 
-// Вспомогательная функция для сравнения начала строки
-int strncmp(const char* s1, const char* s2, uint32_t n) {
-    while (n && *s1 && (*s1 == *s2)) {
-        s1++;
-        s2++;
-        n--;
+// Поиск экстента, содержащего блок файла block. В base возвращается
+// номер первого блока файла в найденном экстенте. Запись в конец
+// попадает в последний экстент без обхода списка.
+static int32_t file_find_extent(const file_t* file, uint32_t block, uint32_t* base) {
+    int32_t last = file->last_extent;
+    if (last != -1 && block >= file->block_count - core->extents[last].count) {
+        *base = file->block_count - core->extents[last].count;
+        return block < file->block_count ? last : -1;
     }
-    return n ? *(const unsigned char*)s1 - *(const unsigned char*)s2 : 0;
+    *base = 0;
+    for (int32_t e = file->first_extent; e != -1; e = core->extents[e].next) {
+        if (block < *base + core->extents[e].count) {
+            return e;
+        }
+        *base += core->extents[e].count;
+    }
+    return -1;
 }
 
-// Вспомогательная функция для поиска следующего компонента пути
-static const char* get_next_path_component(const char* path, char* component) {
-    // Пропускаем начальные слеши
-    while (*path == '/') path++;
-    
-    // Копируем символы до следующего слеша или конца строки
-    while (*path && *path != '/') {
-        *component++ = *path++;
+// Запись size байт с позиции offset. Промежуток между старым концом
+// файла и offset заполняется нулями. Блок читается с диска, только если
+// в нем остаются старые данные файла.
+static int file_write_at(file_t* file, const uint8_t* data, uint32_t size, uint32_t offset) {
+    if ((file->flags & FS_FILE_COMPRESSED) && file_unpack(file) < 0) {
+        return -1;
+    }
+    uint32_t old_size = file->size;
+    uint32_t end = offset + size;
+    if (end < offset) {
+        return -1;  // Переполнение
+    }
+    if (!size) {
+        return 0;
+    }
+    if (end > old_size && file_resize(file, end) < 0) {
+        return -1;
     }
-    *component = 0;
-    
-    return *path ? path : NULL;
-}
 
-// Сохранение файловой системы на диск
-int fs_save(void) {
-    
-    return 1;
-}
+    uint32_t first = (offset < old_size ? offset : old_size) / FS_BLOCK_SIZE;
+    uint32_t base;
+    int32_t e = file_find_extent(file, first, &base);
+    for (uint32_t pos = first * FS_BLOCK_SIZE; pos < end; pos += FS_BLOCK_SIZE) {
+        uint32_t block = pos / FS_BLOCK_SIZE;
+        if (block - base >= core->extents[e].count) {
+            base += core->extents[e].count;
+            e = core->extents[e].next;
+        }
+        uint32_t phys = core->extents[e].start + (block - base);
+        if (core->block_refs[phys] > 1) {
+            // Разбиение экстента сбило бы позицию отображений (fs_map_next)
+            if (file->map_count || file_cow_block(file, &e, &base, block) < 0) {
+                return -1;
+            }
+            phys = core->extents[e].start;
+        } else {
+            // Содержимое блока меняется, старый хеш больше не верен
+            dedup_remove(phys);
+        }
+        uint32_t lba = FS_DATA_START_SECTOR + phys;
 
-// Загрузка файловой системы с диска
-int fs_load(void) {
-    
-    return 1;
+        uint32_t keep_end = old_size < pos + FS_BLOCK_SIZE ? old_size : pos + FS_BLOCK_SIZE;
+        int fill = pos < old_size && (offset > pos || end < keep_end);
+        bcache_buf_t* buf = fill ? bcache_get(fs_dev, lba) : bcache_get_nofill(fs_dev, lba);
+        if (!buf) {
+            return -1;
+        }
+        for (uint32_t i = 0; i < FS_BLOCK_SIZE; i++) {
+            uint32_t p = pos + i;
+            if (p >= offset && p < end) {
+                buf->data[i] = data[p - offset];
+            } else if (p >= old_size && p < offset) {
+                buf->data[i] = 0;
+            }
+        }
+        bcache_mark_dirty(buf);
+        bcache_release(buf);
+    }
+
+    if (end > old_size) {
+        file->size = end;
+        inode_mark_dirty(file - core->files);
+    }
+    return size;
 }
 
-void fs_init(void) {
-    // Если не удалось, создаем новую
-    for (uint32_t i = 0; i < MAX_FILES; i++) {
-        files[i].type = FILE_TYPE_NONE;
-        files[i].size = 0;
-        files[i].name[0] = 0;
-        files[i].parent_index = -1;
+static void readahead_reset(fs_readahead_t* ra, uint32_t offset) {
+    if (ra->end > ra->start) {
+        fs_stats.readahead_wasted += ra->end - ra->start;
     }
-    
-    // Создаем корневую директорию
-    files[0].name[0] = 0;  // Пустое имя для корневой директории
-    files[0].type = FILE_TYPE_DIR;
-    files[0].size = 0;
-    files[0].parent_index = 0;  // Корень является родителем для самого себя
-    file_count = 1;
+    ra->offset = offset;
+    ra->window = 0;
+    ra->start = 0;
+    ra->end = 0;
 }
 
-int fs_create_file(const char* name, file_type_t type, uint32_t parent_index) {
-    if (file_count >= MAX_FILES) {
-        return -1;  // Нет свободного места
+// Опережающее чтение открытого файла после чтения size байт с offset.
+// Последовательное чтение продлевает упреждение, когда впереди остается
+// меньше половины окна, и окно при этом удваивается. Чтение не с места
+// окончания предыдущего сбрасывает окно. Блоки ставятся в очередь
+// устройства без ожидания. Сжатые файлы читаются целыми кластерами
+// и здесь не учитываются.
+static void file_readahead(const file_t* file, fs_readahead_t* ra, uint32_t offset, uint32_t size) {
+    if (!size || (file->flags & FS_FILE_COMPRESSED)) {
+        return;
     }
-    
-    // Проверяем, что родительская директория существует и является директорией
-    if (parent_index >= MAX_FILES || files[parent_index].type != FILE_TYPE_DIR) {
-        return -1;
+    if (offset != ra->offset) {
+        readahead_reset(ra, offset + size);
+        return;
     }
-    
-    // Проверяем, что файл с таким именем не существует в этой директории
-    for (uint32_t i = 0; i < file_count; i++) {
-        if (files[i].parent_index == parent_index && strcmp(files[i].name, name) == 0) {
-            return -1;  // Файл уже существует
+    ra->offset = offset + size;
+
+    // Прочитанная часть упреждения
+    uint32_t next = (offset + size - 1) / FS_BLOCK_SIZE + 1;
+    if (ra->start < ra->end && ra->start < next) {
+        uint32_t used = next < ra->end ? next : ra->end;
+        fs_stats.readahead_hits += used - ra->start;
+        ra->start = used;
+    }
+    if (ra->end > next && ra->end - next >= ra->window / 2) {
+        return;
+    }
+
+    ra->window = ra->window ? ra->window * 2 : FS_READAHEAD_MIN;
+    if (ra->window > FS_READAHEAD_MAX) {
+        ra->window = FS_READAHEAD_MAX;
+    }
+    uint32_t from = ra->end > next ? ra->end : next;
+    uint32_t to = next + ra->window;
+    uint32_t blocks = (file->size + FS_BLOCK_SIZE - 1) / FS_BLOCK_SIZE;
+    if (to > blocks) {
+        to = blocks;
+    }
+    if (from >= to) {
+        return;
+    }
+    if (ra->start >= ra->end) {
+        ra->start = from;
+    }
+    ra->end = to;
+    fs_stats.readahead_blocks += to - from;
+
+    uint32_t base;
+    int32_t e = file_find_extent(file, from, &base);
+    while (e != -1 && from < to) {
+        uint32_t in_extent = from - base;
+        uint32_t count = core->extents[e].count - in_extent;
+        if (count > to - from) {
+            count = to - from;
         }
+        bcache_readahead(fs_dev, FS_DATA_START_SECTOR + core->extents[e].start + in_extent, count);
+        from += count;
+        base += core->extents[e].count;
+        e = core->extents[e].next;
     }
-    
-    // Создаем новый файл
-    uint32_t index = file_count++;
-    strcpy(files[index].name, name);
-    files[index].type = type;
-    files[index].size = 0;
-    files[index].parent_index = parent_index;
-    
-    // Сохраняем изменения на диск
-    fs_save();
-    
-    return index;
 }
 
-int fs_parse_path(const char* path) {
-    char component[MAX_FILENAME];
-    uint32_t current_index = 0;  // Начинаем с корневой директории
-    
-    // Если путь пустой или это корень, возвращаем индекс корневой директории
-    if (!*path || (*path == '/' && !*(path + 1))) {
+// Чтение до size байт с позиции offset. Перед каждой порцией
+// непрерывные блоки экстента запрашиваются одним опережающим чтением.
+static int file_read_at(const file_t* file, uint8_t* buffer, uint32_t size, uint32_t offset) {
+    if (offset >= file->size) {
         return 0;
     }
-    
-    // Разбираем путь по компонентам
-    while (path) {
-        path = get_next_path_component(path, component);
-        if (!component[0]) continue;  // Пустой компонент
-        
-        // Ищем компонент в текущей директории
-        int found = -1;
-        for (uint32_t i = 0; i < file_count; i++) {
-            if (files[i].parent_index == current_index && strcmp(files[i].name, component) == 0) {
-                found = i;
-                break;
+    if (size > file->size - offset) {
+        size = file->size - offset;
+    }
+
+    if (file->flags & FS_FILE_COMPRESSED) {
+        // Кластеры до offset пропускаются, нужные распаковываются
+        uint32_t base = 0;
+        uint32_t done = 0;
+        for (int32_t e = file->first_extent; e != -1 && done < size; e = core->extents[e].next) {
+            uint32_t raw = FS_EXTENT_RAW_LEN(core->extents[e].info);
+            if (offset + done < base + raw) {
+                const uint8_t* data = cluster_load(e);
+                if (!data) {
+                    return -1;
+                }
+                uint32_t from = offset + done - base;
+                uint32_t chunk = raw - from < size - done ? raw - from : size - done;
+                for (uint32_t i = 0; i < chunk; i++) {
+                    buffer[done + i] = data[from + i];
+                }
+                done += chunk;
             }
+            base += raw;
         }
-        
-        if (found == -1) {
-            return -1;  // Компонент не найден
+        return size;
+    }
+
+    uint32_t base;
+    int32_t e = file_find_extent(file, offset / FS_BLOCK_SIZE, &base);
+    uint32_t done = 0;
+    while (done < size) {
+        uint32_t pos = offset + done;
+        uint32_t block = pos / FS_BLOCK_SIZE;
+        if (block - base >= core->extents[e].count) {
+            base += core->extents[e].count;
+            e = core->extents[e].next;
+        }
+        uint32_t in_extent = block - base;
+        uint32_t lba = FS_DATA_START_SECTOR + core->extents[e].start + in_extent;
+        if (done == 0 || in_extent % BCACHE_MAX_RUN == 0) {
+            uint32_t ahead = (pos % FS_BLOCK_SIZE + size - done + FS_BLOCK_SIZE - 1) / FS_BLOCK_SIZE;
+            if (ahead > core->extents[e].count - in_extent) {
+                ahead = core->extents[e].count - in_extent;
+            }
+            if (ahead > BCACHE_MAX_RUN) {
+                ahead = BCACHE_MAX_RUN;
+            }
+            if (ahead > 1) {
+                bcache_readahead(fs_dev, lba, ahead);
+            }
+        }
+
+        bcache_buf_t* buf = bcache_get(fs_dev, lba);
+        if (!buf) {
+            return -1;
         }
-        current_index = found;
+        uint32_t from = pos % FS_BLOCK_SIZE;
+        uint32_t chunk = FS_BLOCK_SIZE - from;
+        if (chunk > size - done) {
+            chunk = size - done;
+        }
+        for (uint32_t i = 0; i < chunk; i++) {
+            buffer[done + i] = buf->data[from + i];
+        }
+        bcache_release(buf);
+        done += chunk;
+    }
+    return size;
+}
+
+int fs_write(const char* path, const uint8_t* data, uint32_t size) {
+    int index = fs_parse_path(path);
+    if (index < 0 || core->file_type[index] != FILE_TYPE_FILE || !fs_dev) {
+        return -1;
+    }
+    file_t* file = &core->files[index];
+    if (file->map_count) {
+        return -1;  // Блоки отображенного файла не переразмещаются
+    }
+
+    // Файл пишется в новое размещение, старое освобождается после
+    // успешной записи: при ошибке файл сохраняет прежнее содержимое
+    int written = fs_compression ? file_write_packed(file, data, size) : -1;
+    if (written < 0) {
+        written = file_write_dedup(file, data, size);
     }
+    if (written < 0) {
+        return -1;
+    }
+    inode_mark_dirty(index);
     
-    return current_index;
+    // Фиксируем изменения в журнале
+    fs_journal_op();
+    
+    return written;
 }
 
-file_t* fs_get_file(const char* path) {
+int fs_read(const char* path, uint8_t* buffer, uint32_t size) {
     int index = fs_parse_path(path);
-    if (index < 0) {
+    if (index < 0 || core->file_type[index] != FILE_TYPE_FILE || !fs_dev) {
+        return -1;
+    }
+    file_t* file = &core->files[index];
+    return file_read_at(file, buffer, size, 0);
+}
+
+// Проверка дескриптора: файл не должен быть удален после открытия
+static fs_open_file_t* fd_get(int fd) {
+    if (fd < 0 || fd >= FS_MAX_OPEN || open_files[fd].index == -1) {
+        return NULL;
+    }
+    fs_open_file_t* of = &open_files[fd];
+    if (!fs_index_valid(of->index, of->generation)) {
         return NULL;
     }
-    return &files[index];
+    return of;
 }
 
-int fs_write(const char* path, const uint8_t* data, uint32_t size) {
-    file_t* file = fs_get_file(path);
-    if (!file || file->type != FILE_TYPE_FILE) {
+int fs_open(const char* path, uint32_t flags) {
+    if (!fs_dev) {
         return -1;
     }
-    
-    // Проверяем размер
-    if (size > MAX_FILE_SIZE) {
-        size = MAX_FILE_SIZE;
+    int index = fs_parse_path(path);
+    if (index < 0 && (flags & FS_O_CREATE)) {
+        index = fs_create(path);
     }
-    
-    // Копируем данные
-    for (uint32_t i = 0; i < size; i++) {
-        file->data[i] = data[i];
+    if (index < 0 || core->file_type[index] != FILE_TYPE_FILE) {
+        return -1;
     }
-    file->size = size;
-    
-    // Сохраняем изменения на диск
-    fs_save();
-    
-    return size;
+
+    for (int fd = 0; fd < FS_MAX_OPEN; fd++) {
+        if (open_files[fd].index != -1) {
+            continue;
+        }
+        if ((flags & FS_O_TRUNC) && core->files[index].size) {
+            if (file_resize(&core->files[index], 0) < 0) {
+                return -1;
+            }
+            core->files[index].size = 0;
+            inode_mark_dirty(index);
+            fs_journal_op();
+        }
+        open_files[fd].index = index;
+        open_files[fd].generation = core->files[index].generation;
+        open_files[fd].offset = 0;
+        open_files[fd].flags = flags;
+        fs_readahead_t fresh = {0};
+        open_files[fd].ra = fresh;
+        return fd;
+    }
+    return -1;  // Таблица открытых файлов заполнена
 }
 
-int fs_read(const char* path, uint8_t* buffer, uint32_t size) {
-    file_t* file = fs_get_file(path);
-    if (!file || file->type != FILE_TYPE_FILE) {
+int fs_close(int fd) {
+    if (fd < 0 || fd >= FS_MAX_OPEN || open_files[fd].index == -1) {
         return -1;
     }
-    
-    // Проверяем размер
-    if (size > file->size) {
-        size = file->size;
+    readahead_reset(&open_files[fd].ra, 0);
+    open_files[fd].index = -1;
+    return 0;
+}
+
+int fs_pread(int fd, uint8_t* buffer, uint32_t size, uint32_t offset) {
+    fs_open_file_t* of = fd_get(fd);
+    if (!of || !(of->flags & FS_O_READ)) {
+        return -1;
     }
-    
-    // Копируем данные
-    for (uint32_t i = 0; i < size; i++) {
-        buffer[i] = file->data[i];
+    file_t* file = &core->files[of->index];
+    int done = file_read_at(file, buffer, size, offset);
+    if (done > 0) {
+        file_readahead(file, &of->ra, offset, done);
+    }
+    return done;
+}
+
+int fs_pwrite(int fd, const uint8_t* data, uint32_t size, uint32_t offset) {
+    fs_open_file_t* of = fd_get(fd);
+    if (!of || !(of->flags & FS_O_WRITE)) {
+        return -1;
+    }
+    file_t* file = &core->files[of->index];
+    if (of->flags & FS_O_APPEND) {
+        offset = file->size;
+    }
+    int written = file_write_at(file, data, size, offset);
+    if (written > 0) {
+        fs_journal_op();
+    }
+    return written;
+}
+
+int fs_fread(int fd, uint8_t* buffer, uint32_t size) {
+    int done = fs_pread(fd, buffer, size, fd_get(fd) ? open_files[fd].offset : 0);
+    if (done > 0) {
+        open_files[fd].offset += done;
+    }
+    return done;
+}
+
+int fs_fwrite(int fd, const uint8_t* data, uint32_t size) {
+    fs_open_file_t* of = fd_get(fd);
+    if (!of) {
+        return -1;
+    }
+    int done = fs_pwrite(fd, data, size, of->offset);
+    if (done > 0) {
+        // При дозаписи позиция переходит в новый конец файла
+        of->offset = (of->flags & FS_O_APPEND) ? core->files[of->index].size : of->offset + done;
+    }
+    return done;
+}
+
+int fs_seek(int fd, uint32_t offset) {
+    fs_open_file_t* of = fd_get(fd);
+    if (!of) {
+        return -1;
+    }
+    of->offset = offset;
+    return offset;
+}
+
+int fs_stat(const char* path, fs_stat_t* st) {
+    int index = fs_parse_path(path);
+    if (index < 0) {
+        return -1;
+    }
+    st->type = core->file_type[index];
+    st->size = core->files[index].size;
+    st->blocks = core->files[index].block_count;
+    st->flags = core->files[index].flags;
+    return 0;
+}
+
+void fs_set_compression(int enabled) {
+    fs_compression = enabled;
+}
+
+int fs_map(const char* path, fs_map_t* map) {
+    map->index = -1;
+    map->buf = NULL;
+    int index = fs_parse_path(path);
+    if (index < 0 || core->file_type[index] != FILE_TYPE_FILE || !fs_dev) {
+        return -1;
+    }
+    core->files[index].map_count++;
+    map->index = index;
+    map->size = core->files[index].size;
+    map->offset = 0;
+    map->extent = core->files[index].first_extent;
+    map->extent_base = 0;
+    fs_readahead_t fresh = {0};
+    map->ra = fresh;
+    return map->size;
+}
+
+// Следующая порция отображения: указатель на данные блока в кэше.
+// Предыдущая порция освобождается. NULL - конец файла или ошибка.
+const uint8_t* fs_map_next(fs_map_t* map, uint32_t* len) {
+    if (map->buf) {
+        bcache_release(map->buf);
+        map->buf = NULL;
+    }
+    if (map->index == -1 || map->offset >= map->size) {
+        return NULL;
+    }
+
+    if (core->files[map->index].flags & FS_FILE_COMPRESSED) {
+        // Порция - распакованный кластер
+        const uint8_t* data = cluster_load(map->extent);
+        if (!data) {
+            return NULL;
+        }
+        *len = FS_EXTENT_RAW_LEN(core->extents[map->extent].info);
+        map->offset += *len;
+        map->extent = core->extents[map->extent].next;
+        return data;
+    }
+
+    uint32_t block = map->offset / FS_BLOCK_SIZE;
+    while (block - map->extent_base >= core->extents[map->extent].count) {
+        map->extent_base += core->extents[map->extent].count;
+        map->extent = core->extents[map->extent].next;
+    }
+    int32_t e = map->extent;
+    uint32_t in_extent = block - map->extent_base;
+    uint32_t lba = FS_DATA_START_SECTOR + core->extents[e].start + in_extent;
+    bcache_buf_t* buf = bcache_get(fs_dev, lba);
+    if (!buf) {
+        return NULL;
+    }
+    map->buf = buf;
+    *len = map->size - map->offset < FS_BLOCK_SIZE ? map->size - map->offset : FS_BLOCK_SIZE;
+    file_readahead(&core->files[map->index], &map->ra, map->offset, *len);
+    map->offset += *len;
+    return buf->data;
+}
+
+void fs_unmap(fs_map_t* map) {
+    if (map->buf) {
+        bcache_release(map->buf);
+        map->buf = NULL;
+    }
+    if (map->index != -1) {
+        readahead_reset(&map->ra, 0);
+        core->files[map->index].map_count--;
+        map->index = -1;
     }
-    
-    return size;
 }
 
 int fs_delete_file(const char* path) {
@@ -221,29 +2433,23 @@ int fs_delete_file(const char* path) {
     }
     
     // Проверяем, что это не директория с файлами
-    if (files[index].type == FILE_TYPE_DIR) {
-        for (uint32_t i = 0; i < file_count; i++) {
-            if (files[i].parent_index == index) {
-                return -1;  // Директория не пуста
-            }
-        }
+    if (core->file_type[index] == FILE_TYPE_DIR && core->files[index].first_child != -1) {
+        return -1;  // Директория не пуста
     }
-    
-    // Удаляем файл, сдвигая все последующие файлы
-    for (uint32_t i = index; i < file_count - 1; i++) {
-        files[i] = files[i + 1];
-        // Обновляем parent_index для файлов, которые ссылались на сдвинутые файлы
-        for (uint32_t j = 0; j < file_count; j++) {
-            if (files[j].parent_index > i) {
-                files[j].parent_index--;
-            }
-        }
+    if (core->files[index].map_count) {
+        return -1;  // Файл отображен
     }
     
-    file_count--;
+    // Освобождаем блоки данных и слот, остальные записи не перемещаются
+    file_shrink(&core->files[index], 0);
+    seq_write_lock(&names);
+    dcache_remove(index);
+    child_unlink(index);
+    slot_release(index);
+    seq_write_unlock(&names);
     
-    // Сохраняем изменения на диск
-    fs_save();
+    // Фиксируем изменения в журнале
+    fs_journal_op();
     
     return 0;
 }
@@ -280,42 +2486,33 @@ int fs_mkdir(const char* path) {
     }
     
     // Создаем новую директорию
-    int result = fs_create_file(dir_name, FILE_TYPE_DIR, parent_index);
-    if (result >= 0) {
-        fs_save(); // Сохраняем изменения на диск
-    }
-    return result;
+    return fs_create_file(dir_name, FILE_TYPE_DIR, parent_index);
 }
 
 int fs_list_dir(const char* path, char* buffer, uint32_t buffer_size) {
     int dir_index = fs_parse_path(path);
-    if (dir_index < 0 || dir_index >= MAX_FILES || files[dir_index].type != FILE_TYPE_DIR) {
+    if (dir_index < 0 || dir_index >= MAX_FILES || core->file_type[dir_index] != FILE_TYPE_DIR) {
         return -1;
     }
     
     char* current_pos = buffer;
     int count = 0;
     
-    // Перебираем все файлы, ищем те, которые находятся в данной директории
-    for (uint32_t i = 0; i < file_count; i++) {
-        // Пропускаем корневую директорию
-        if (i == 0) continue;
+    // Обходим только элементы данной директории
+    for (int32_t i = core->files[dir_index].first_child; i != -1; i = core->file_next_sibling[i]) {
+        uint32_t remaining = buffer_size - (current_pos - buffer);
+        if (remaining < MAX_FILENAME + 3) {  // +3 для возможного добавления "/\n"
+            break;
+        }
         
-        if (files[i].parent_index == dir_index) {
-            uint32_t remaining = buffer_size - (current_pos - buffer);
-            if (remaining < MAX_FILENAME + 3) {  // +3 для возможного добавления "/\n"
-                break;
-            }
-            
-            strcpy(current_pos, files[i].name);
-            current_pos += strlen(files[i].name);
-            
-            if (files[i].type == FILE_TYPE_DIR) {
-                *current_pos++ = '/';
-            }
-            *current_pos++ = '\n';
-            count++;
+        strcpy(current_pos, core->files[i].name);
+        current_pos += strlen(core->files[i].name);
+        
+        if (core->file_type[i] == FILE_TYPE_DIR) {
+            *current_pos++ = '/';
         }
+        *current_pos++ = '\n';
+        count++;
     }
     
     *current_pos = 0;  // Завершающий ноль
@@ -354,30 +2551,9 @@ int fs_create(const char* path) {
     }
     
     // Создаем новый файл
-    int result = fs_create_file(file_name, FILE_TYPE_FILE, parent_index);
-    if (result >= 0) {
-        fs_save(); // Сохраняем изменения на диск
-    }
-    return result;
+    return fs_create_file(file_name, FILE_TYPE_FILE, parent_index);
 }
 
 int fs_delete(const char* path) {
-    int idx = fs_parse_path(path);
-    if (idx < 0) {
-        return -1;
-    }
-    
-    // Нельзя удалить корневую директорию
-    if (idx == 0) {
-        return -1;
-    }
-    
-    // Очищаем файл/директорию
-    files[idx].name[0] = 0;
-    files[idx].type = FILE_TYPE_NONE;
-    files[idx].size = 0;
-    files[idx].parent_index = -1;
-    
-    fs_save(); // Сохраняем изменения на диск
-    return 0;
-} 
\ No newline at end of file
+    return fs_delete_file(path);
+}
\ No newline at end of file
@@ -2,13 +2,45 @@
 #define FS_H
 
 #include "stdint.h"
+#include "block.h"
+#include "bcache.h"
 
 // Максимальная длина имени файла
 #define MAX_FILENAME 256
-// Максимальный размер файла
-#define MAX_FILE_SIZE 4096
+// Размер блока данных (равен размеру сектора)
+#define FS_BLOCK_SIZE 512
+// Количество блоков данных в томе
+#define FS_MAX_BLOCKS 4096
+// Количество корзин индекса дедупликации (хеш содержимого -> блок)
+#define FS_DEDUP_BUCKETS 4096
+// Количество экстентов в общей таблице
+#define FS_MAX_EXTENTS 4096
 // Максимальное количество файлов
-#define MAX_FILES 256
+#define MAX_FILES 4096
+// Количество корзин хеш-таблицы кэша записей каталогов (степень двойки)
+#define FS_DCACHE_BUCKETS 4096
+// Длина префикса имени, хранимого рядом с хешем
+#define FS_NAME_PREFIX 8
+
+// Сжатие: файл делится на кластеры по FS_CLUSTER_BLOCKS блоков,
+// каждый кластер хранится в одном экстенте, сжатым или как есть
+#define FS_CLUSTER_BLOCKS 8
+#define FS_CLUSTER_SIZE (FS_CLUSTER_BLOCKS * FS_BLOCK_SIZE)
+
+// Максимальное количество одновременно открытых файлов
+#define FS_MAX_OPEN 64
+
+// Опережающее чтение открытого файла: окно в блоках растет вдвое при
+// каждом продлении, пока чтение последовательное
+#define FS_READAHEAD_MIN 4
+#define FS_READAHEAD_MAX 128
+
+// Флаги fs_open
+#define FS_O_READ   0x01
+#define FS_O_WRITE  0x02
+#define FS_O_APPEND 0x04  // Каждая запись идет в конец файла
+#define FS_O_CREATE 0x08  // Создать файл, если его нет
+#define FS_O_TRUNC  0x10  // Обнулить размер при открытии
 
 // Тип файла
 typedef enum {
@@ -17,31 +49,206 @@ typedef enum {
     FILE_TYPE_DIR = 2
 } file_type_t;
 
-// Структура файла
+// Экстент - непрерывная последовательность блоков файла
+typedef struct {
+    uint32_t start;     // Первый блок
+    uint32_t count;     // Количество блоков
+    int32_t next;       // Следующий экстент файла (-1 - конец списка)
+    uint32_t info;      // Для кластеров сжатого файла: флаг и длины
+} fs_extent_t;
+
+// Поле info экстента сжатого файла
+#define FS_EXTENT_COMPRESSED 0x80000000u      // Данные сжаты LZ4
+#define FS_EXTENT_RAW_LEN(info) (((info) >> 16) & 0x7FFF)  // Байт в кластере
+#define FS_EXTENT_PACKED_LEN(info) ((info) & 0xFFFF)       // Байт на диске
+
+// Флаги файла
+#define FS_FILE_COMPRESSED 0x01  // Данные разбиты на сжатые кластеры
+
+// Холодная часть inode. Тип, родитель, хеш и префикс имени и ссылка
+// на следующий элемент директории хранятся в fs.c отдельными массивами.
 typedef struct {
     char name[MAX_FILENAME];
-    file_type_t type;
     uint32_t size;
-    uint32_t parent_index;
-    uint8_t data[MAX_FILE_SIZE];
+    uint32_t flags;         // FS_FILE_*
+    uint32_t block_count;   // Количество выделенных блоков
+    int32_t first_extent;   // Первый экстент (-1 - нет данных)
+    int32_t last_extent;    // Последний экстент (для роста без обхода)
+    uint32_t generation;    // Поколение слота, растет при каждом удалении
+    int32_t first_child;    // Первый элемент директории (-1 - пуста)
+    int32_t last_child;     // Последний элемент директории
+    int32_t prev_sibling;   // Предыдущий элемент родительской директории
+    uint32_t map_count;     // Активные отображения (только в памяти)
 } file_t;
 
+// Состояние опережающего чтения открытого файла
+typedef struct {
+    uint32_t offset;        // Где должно начаться следующее последовательное чтение
+    uint32_t window;        // Текущее окно (0 - последовательность не замечена)
+    uint32_t start;         // Первый заранее запрошенный и еще не прочитанный блок
+    uint32_t end;           // Блок за последним заранее запрошенным
+} fs_readahead_t;
+
+// Отображение файла только для чтения. Данные выдаются порциями по блоку
+// прямо из буферов кэша, текущий буфер закреплен до следующей порции.
+// Сжатый файл выдается распакованными кластерами из внутреннего буфера,
+// такая порция действительна до следующего вызова файловой системы.
+// Пока файл отображен, его нельзя удалить, уменьшить или переразместить.
+typedef struct {
+    int32_t index;          // Индекс inode (-1 - не отображен)
+    uint32_t size;          // Размер файла на момент отображения
+    uint32_t offset;        // Смещение следующей порции
+    int32_t extent;         // Экстент следующей порции
+    uint32_t extent_base;   // Номер первого блока файла в экстенте
+    bcache_buf_t* buf;      // Закрепленный буфер кэша
+    fs_readahead_t ra;
+} fs_map_t;
+
 // Структура суперблока
 typedef struct {
     uint32_t magic;          // Магическое число для проверки
     uint32_t version;        // Версия файловой системы
     uint32_t file_count;     // Количество файлов
     uint32_t first_data_sector; // Первый сектор данных
+    uint32_t inode_start_sector;  // Первый сектор таблицы inode
+    uint32_t extent_start_sector; // Первый сектор таблицы экстентов
+    uint32_t bitmap_start_sector; // Первый сектор битовой карты блоков
+    uint32_t block_count;    // Количество блоков данных
+    uint32_t journal_start_sector; // Первый сектор журнала
+    uint32_t journal_sectors;      // Размер журнала
+    uint32_t hash_start_sector;    // Первый сектор таблицы хешей блоков
 } __attribute__((packed)) superblock_t;
 
+// Inode на диске, ровно один сектор
+typedef struct {
+    char name[MAX_FILENAME];
+    uint32_t type;
+    uint32_t size;
+    uint32_t parent_index;
+    uint32_t block_count;
+    int32_t first_extent;
+    uint32_t generation;
+    uint32_t flags;
+    uint8_t reserved[BLOCK_SECTOR_SIZE - MAX_FILENAME - 28];
+} __attribute__((packed)) fs_disk_inode_t;
+
+// Экстент на диске
+typedef struct {
+    uint32_t start;
+    uint32_t count;
+    int32_t next;
+    uint32_t info;
+} __attribute__((packed)) fs_disk_extent_t;
+
+// Счетчики стоимости операций файловой системы
+typedef struct {
+    uint64_t lookups;        // Поиски компонентов пути
+    uint64_t lookup_probes;  // Просмотренные записи цепочек кэша
+    uint64_t lookup_misses;  // Компонент не найден
+    uint64_t lookup_name_reads; // Сравнения полного имени (чтения file_t)
+    uint32_t blocks_free;    // Свободные блоки данных
+    uint32_t extents_free;   // Свободные экстенты
+    uint64_t journal_ops;      // Операции, попавшие в журнал
+    uint64_t journal_commits;  // Записанные транзакции
+    uint64_t journal_sectors;  // Сектора, записанные в журнал
+    uint64_t checkpoints;      // Переносы журнала на место
+    uint64_t clusters_packed;  // Кластеры, записанные сжатыми
+    uint64_t clusters_raw;     // Кластеры, которые не удалось сжать
+    uint64_t clusters_unpacked; // Распаковки при чтении
+    uint64_t dedup_hits;       // Блоки, записанные ссылкой на существующий
+    uint64_t dedup_collisions; // Совпал хеш, но не содержимое
+    uint64_t cow_copies;       // Копирования общего блока при записи
+    uint32_t blocks_shared;    // Блоки, на которые ссылается больше одного места
+    uint64_t readahead_blocks; // Блоки, запрошенные опережающим чтением файлов
+    uint64_t readahead_hits;   // Из них затем прочитанные
+    uint64_t readahead_wasted; // Брошенные при случайном доступе или закрытии
+} fs_stats_t;
+
+// Сведения о файле
+typedef struct {
+    file_type_t type;
+    uint32_t size;          // Размер в байтах
+    uint32_t blocks;        // Занятые блоки на диске
+    uint32_t flags;         // FS_FILE_*
+} fs_stat_t;
+
 #define FS_MAGIC 0x534F584F  // "FOXS" в hex
-#define FS_VERSION 1
-#define FS_SUPERBLOCK_SECTOR 2048  // После загрузчика и ядра
-#define FS_DATA_START_SECTOR 2049   // Сразу после суперблока
+#define FS_VERSION 4
+
+// Заголовок журнала (первый сектор области журнала)
+typedef struct {
+    uint32_t magic;
+    uint32_t sequence;       // Номер первой непримененной транзакции
+} __attribute__((packed)) fs_journal_header_t;
+
+// Номера секторов в одном дескрипторе (дескриптор занимает сектор)
+#define FS_JOURNAL_DESC_LBAS ((BLOCK_SECTOR_SIZE - 12) / 4)
+// Максимум секторов метаданных в одной транзакции: весь журнал без
+// заголовка, дескрипторов и записи фиксации
+#define FS_JOURNAL_TXN_MAX (FS_JOURNAL_SECTORS - 2 - \
+    (FS_JOURNAL_SECTORS + FS_JOURNAL_DESC_LBAS - 1) / FS_JOURNAL_DESC_LBAS)
+
+// Дескриптор транзакции: куда записать следующие за ним образы секторов.
+// Транзакция больше FS_JOURNAL_DESC_LBAS секторов - цепочка дескрипторов,
+// каждый со своими образами; запись фиксации одна, в конце.
+typedef struct {
+    uint32_t magic;
+    uint32_t sequence;
+    uint32_t count;
+    uint32_t lba[FS_JOURNAL_DESC_LBAS];
+} __attribute__((packed)) fs_journal_desc_t;
+
+// Запись фиксации, завершает транзакцию
+typedef struct {
+    uint32_t magic;
+    uint32_t sequence;
+    uint32_t count;          // Образов во всех дескрипторах транзакции
+    uint32_t checksum;       // Контрольная сумма образов секторов по порядку
+} __attribute__((packed)) fs_journal_commit_t;
+
+#define FS_JOURNAL_MAGIC 0x4C4E524A         // "JRNL"
+#define FS_JOURNAL_DESC_MAGIC 0x4353454A    // "JDSC"
+#define FS_JOURNAL_COMMIT_MAGIC 0x544D434A  // "JCMT"
+
+// Групповая фиксация: транзакция закрывается по числу операций,
+// по числу измененных секторов или по таймеру (в тиках fs_sync_tick,
+// которые ядро вызывает раз в FS_SYNC_TICK_MS)
+#define FS_JOURNAL_BATCH_OPS 64
+#define FS_JOURNAL_BATCH_SECTORS 48
+#define FS_SYNC_TICK_MS 10
+#define FS_JOURNAL_COMMIT_TICKS 50
+// Если после фиксации в журнале осталось меньше секторов, он сразу
+// переносится на место, пока состояние в памяти совпадает с журналом
+#define FS_JOURNAL_RESERVE 66
+
+// Разметка тома на диске (в секторах). Ядро занимает сектора 2048-4095.
+#define FS_SUPERBLOCK_SECTOR 4096
+#define FS_INODE_START_SECTOR (FS_SUPERBLOCK_SECTOR + 1)
+#define FS_EXTENTS_PER_SECTOR (BLOCK_SECTOR_SIZE / 16)
+#define FS_EXTENT_SECTORS (FS_MAX_EXTENTS / FS_EXTENTS_PER_SECTOR)
+#define FS_EXTENT_START_SECTOR (FS_INODE_START_SECTOR + MAX_FILES)
+#define FS_BITMAP_SECTORS (FS_MAX_BLOCKS / (BLOCK_SECTOR_SIZE * 8))
+#define FS_BITMAP_START_SECTOR (FS_EXTENT_START_SECTOR + FS_EXTENT_SECTORS)
+#define FS_HASH_SECTORS (FS_MAX_BLOCKS * 4 / BLOCK_SECTOR_SIZE)
+#define FS_HASH_START_SECTOR (FS_BITMAP_START_SECTOR + FS_BITMAP_SECTORS)
+#define FS_JOURNAL_START_SECTOR (FS_HASH_START_SECTOR + FS_HASH_SECTORS)
+#define FS_JOURNAL_SECTORS 256
+#define FS_DATA_START_SECTOR (FS_JOURNAL_START_SECTOR + FS_JOURNAL_SECTORS)
+#define FS_END_SECTOR (FS_DATA_START_SECTOR + FS_MAX_BLOCKS)
+// Снимок состояния тома в памяти для монтирования образа на месте
+// (пишет mkfs.foxfs, необязателен). Образ, который загрузчик передает
+// ядру, занимает сектора с FS_SUPERBLOCK_SECTOR по FS_IMAGE_END_SECTOR.
+#define FS_SNAPSHOT_START_SECTOR FS_END_SECTOR
+#define FS_SNAPSHOT_SECTORS 3072
+#define FS_IMAGE_END_SECTOR (FS_SNAPSHOT_START_SECTOR + FS_SNAPSHOT_SECTORS)
+#define FS_IMAGE_SIZE ((FS_IMAGE_END_SECTOR - FS_SUPERBLOCK_SECTOR) * BLOCK_SECTOR_SIZE)
+// Сектора метаданных (суперблок, inode, экстенты, битовая карта) идут подряд
+#define FS_META_SECTORS (FS_JOURNAL_START_SECTOR - FS_SUPERBLOCK_SECTOR)
 
 // Функции файловой системы
 void fs_init(void);
 int fs_create_file(const char* name, file_type_t type, uint32_t parent_index);
+int fs_create(const char* path);
 file_t* fs_get_file(const char* path);
 int fs_write(const char* path, const uint8_t* data, uint32_t size);
 int fs_read(const char* path, uint8_t* buffer, uint32_t size);
@@ -49,11 +256,52 @@ int fs_delete_file(const char* path);
 int fs_mkdir(const char* path);
 int fs_list_dir(const char* path, char* buffer, uint32_t buffer_size);
 
+// Открытые файлы. Дескриптор хранит индекс и поколение inode,
+// поэтому путь разбирается только в fs_open.
+int fs_open(const char* path, uint32_t flags);
+int fs_close(int fd);
+int fs_pread(int fd, uint8_t* buffer, uint32_t size, uint32_t offset);
+int fs_pwrite(int fd, const uint8_t* data, uint32_t size, uint32_t offset);
+// Чтение и запись с текущей позиции дескриптора
+int fs_fread(int fd, uint8_t* buffer, uint32_t size);
+int fs_fwrite(int fd, const uint8_t* data, uint32_t size);
+int fs_seek(int fd, uint32_t offset);
+int fs_stat(const char* path, fs_stat_t* st);
+
+// Сжатие при записи через fs_write (по умолчанию выключено)
+void fs_set_compression(int enabled);
+
+// Отображение содержимого файла без копирования
+int fs_map(const char* path, fs_map_t* map);
+const uint8_t* fs_map_next(fs_map_t* map, uint32_t* len);
+void fs_unmap(fs_map_t* map);
+
 // Новые функции для работы с диском
+int fs_mount(block_device_t* dev);
+// Монтирование образа тома, уже загруженного в память (image - сектор
+// FS_SUPERBLOCK_SECTOR). dev - диск с тем же томом или устройство над той
+// же памятью; если том на dev другой, возвращается -1. Действительный
+// снимок состояния из образа используется на месте.
+int fs_mount_image(block_device_t* dev, void* image, uint64_t size);
+int fs_write_snapshot(void);
 int fs_save(void);
 int fs_load(void);
+int fs_commit(void);
+void fs_sync_tick(void);
 
 // Вспомогательные функции
+// Разрешение пути и поиск имени не берут блокировок и безопасны
+// параллельно с любыми вызовами fs_*; остальные функции вызывающий
+// сериализует сам (в ядре - io_lock). Индекс может устареть сразу
+// после возврата, если другой поток удалит файл.
 int fs_parse_path(const char* path);
+int fs_lookup(uint32_t parent_index, const char* name);
+uint32_t fs_generation(uint32_t index);
+int fs_index_valid(uint32_t index, uint32_t generation);
+file_type_t fs_file_type(uint32_t index);
+
+// Статистика
+void fs_get_stats(fs_stats_t* stats);
+void fs_reset_stats(void);
 
 #endif 
\ No newline at end of file
@@ -0,0 +1,180 @@
+#include "idt.h"
+#include "pic.h"
+#include "vga.h"
+#include "thread.h"
+
+// Шлюз прерывания в IDT
+typedef struct {
+    uint16_t offset_low;
+    uint16_t selector;
+    uint8_t ist;
+    uint8_t type_attr;
+    uint16_t offset_mid;
+    uint32_t offset_high;
+    uint32_t reserved;
+} __attribute__((packed)) idt_entry_t;
+
+typedef struct {
+    uint16_t limit;
+    uint64_t base;
+} __attribute__((packed)) idt_pointer_t;
+
+// Присутствует, кольцо 0, 64-битный шлюз прерывания (IF сбрасывается)
+#define IDT_INTERRUPT_GATE 0x8E
+// Размер точки входа в isr_stubs
+#define IDT_STUB_SIZE 16
+
+static idt_entry_t idt[256] __attribute__((aligned(16)));
+static irq_handler_t irq_handlers[PIC_IRQ_COUNT][IRQ_MAX_HANDLERS];
+static irq_handler_t local_handlers[IDT_VECTORS - IDT_LOCAL_VECTOR];
+
+void interrupt_dispatch(interrupt_frame_t* frame);
+
+// Точки входа, по IDT_STUB_SIZE байт на вектор. Для векторов без кода
+// ошибки вместо него кладется 0, затем номер вектора, чтобы isr_common
+// получал одинаковый кадр. Сохраняются только регистры, которые
+// interrupt_dispatch может испортить по соглашению о вызовах.
+// Стек выровнен: процессор выравнивает RSP на 16 перед кадром, и вместе
+// с двумя словами и девятью регистрами кадр занимает 128 байт.
+asm(
+    ".pushsection .text\n"
+    ".align 16\n"
+    "isr_stubs:\n"
+    ".set isr_vector, 0\n"
+    ".rept 64\n"
+    "    .align 16\n"
+    "    .if !(isr_vector == 8 || (isr_vector >= 10 && isr_vector <= 14) || isr_vector == 17 || isr_vector == 21 || isr_vector == 29 || isr_vector == 30)\n"
+    "    pushq $0\n"
+    "    .endif\n"
+    "    pushq $isr_vector\n"
+    "    jmp isr_common\n"
+    "    .set isr_vector, isr_vector + 1\n"
+    ".endr\n"
+    "isr_common:\n"
+    "    pushq %rax\n"
+    "    pushq %rcx\n"
+    "    pushq %rdx\n"
+    "    pushq %rsi\n"
+    "    pushq %rdi\n"
+    "    pushq %r8\n"
+    "    pushq %r9\n"
+    "    pushq %r10\n"
+    "    pushq %r11\n"
+    "    movq %rsp, %rdi\n"
+    "    cld\n"
+    "    call interrupt_dispatch\n"
+    "    popq %r11\n"
+    "    popq %r10\n"
+    "    popq %r9\n"
+    "    popq %r8\n"
+    "    popq %rdi\n"
+    "    popq %rsi\n"
+    "    popq %rdx\n"
+    "    popq %rcx\n"
+    "    popq %rax\n"
+    "    addq $16, %rsp\n"
+    "    iretq\n"
+    ".popsection\n"
+);
+
+extern char isr_stubs[];
+
+static void idt_set(uint8_t vector, uint64_t handler, uint16_t selector) {
+    idt[vector].offset_low = handler & 0xFFFF;
+    idt[vector].selector = selector;
+    idt[vector].ist = 0;
+    idt[vector].type_attr = IDT_INTERRUPT_GATE;
+    idt[vector].offset_mid = (handler >> 16) & 0xFFFF;
+    idt[vector].offset_high = handler >> 32;
+    idt[vector].reserved = 0;
+}
+
+void idt_init(void) {
+    // Селектор кода берется текущий: GDT ставит загрузчик (BIOS или UEFI)
+    uint16_t cs;
+    asm volatile("mov %%cs, %0" : "=r"(cs));
+
+    for (uint32_t i = 0; i < 256; i++) {
+        idt[i].type_attr = 0;
+    }
+    for (uint32_t v = 0; v < IDT_VECTORS; v++) {
+        idt_set(v, (uint64_t)isr_stubs + v * IDT_STUB_SIZE, cs);
+    }
+    for (uint32_t irq = 0; irq < PIC_IRQ_COUNT; irq++) {
+        for (uint32_t h = 0; h < IRQ_MAX_HANDLERS; h++) {
+            irq_handlers[irq][h] = NULL;
+        }
+    }
+    for (uint32_t v = 0; v < IDT_VECTORS - IDT_LOCAL_VECTOR; v++) {
+        local_handlers[v] = NULL;
+    }
+
+    idt_load();
+    pic_init();
+}
+
+void idt_load(void) {
+    idt_pointer_t pointer = { sizeof(idt) - 1, (uint64_t)idt };
+    asm volatile("lidt %0" : : "m"(pointer));
+}
+
+int irq_register(uint8_t irq, irq_handler_t handler) {
+    if (irq >= PIC_IRQ_COUNT || irq == PIC_CASCADE_IRQ) {
+        return -1;
+    }
+    for (uint32_t h = 0; h < IRQ_MAX_HANDLERS; h++) {
+        if (irq_handlers[irq][h] == handler) {
+            return 0;
+        }
+        if (!irq_handlers[irq][h]) {
+            irq_handlers[irq][h] = handler;
+            pic_unmask(irq);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int idt_register(uint8_t vector, irq_handler_t handler) {
+    if (vector < IDT_LOCAL_VECTOR || vector >= IDT_VECTORS) {
+        return -1;
+    }
+    local_handlers[vector - IDT_LOCAL_VECTOR] = handler;
+    return 0;
+}
+
+// Исключение в ядре не обрабатывается: сообщение и остановка
+static void exception_halt(const interrupt_frame_t* frame) {
+    vga_printf("\nException %d (error %x) at %x\n",
+               (int)frame->vector, frame->error, frame->rip);
+    for (;;) {
+        asm volatile("cli; hlt");
+    }
+}
+
+// Вызывается из isr_common с запрещенными прерываниями. Переключение
+// потока происходит после EOI, иначе контроллер не выдаст прерывания
+// этой линии и линий ниже по приоритету, пока поток не вернется.
+void interrupt_dispatch(interrupt_frame_t* frame) {
+    if (frame->vector < IDT_EXCEPTIONS) {
+        exception_halt(frame);
+    }
+    // Ложное прерывание APIC не подтверждается и не имеет обработчика
+    if (frame->vector >= IDT_LOCAL_VECTOR) {
+        irq_handler_t handler = local_handlers[frame->vector - IDT_LOCAL_VECTOR];
+        if (handler) {
+            handler();
+        }
+        thread_preempt();
+        return;
+    }
+    uint8_t irq = frame->vector - PIC_MASTER_VECTOR;
+    if (pic_spurious(irq)) {
+        return;
+    }
+    for (uint32_t h = 0; h < IRQ_MAX_HANDLERS && irq_handlers[irq][h]; h++) {
+        irq_handlers[irq][h]();
+    }
+    pic_eoi(irq);
+    thread_preempt();
+}
@@ -0,0 +1,59 @@
+#ifndef IDT_H
+#define IDT_H
+
+#include "stdint.h"
+
+// Векторы с обработчиками: исключения процессора, линии PIC и
+// локальные прерывания процессора (APIC)
+#define IDT_EXCEPTIONS 32
+#define IDT_LOCAL_VECTOR 0x30
+#define IDT_VECTORS 64
+// Обработчиков на одной линии (линии PCI бывают общими)
+#define IRQ_MAX_HANDLERS 4
+
+// Сохраненное состояние прерванного кода. Порядок полей совпадает
+// с порядком помещения в стек (isr_common в idt.c).
+typedef struct {
+    uint64_t r11, r10, r9, r8, rdi, rsi, rdx, rcx, rax;
+    uint64_t vector;
+    uint64_t error;          // Код ошибки исключения или 0
+    uint64_t rip, cs, rflags, rsp, ss;
+} interrupt_frame_t;
+
+typedef void (*irq_handler_t)(void);
+
+// Загрузка IDT и переназначение PIC. Прерывания остаются запрещены.
+void idt_init(void);
+// Загрузка уже готовой IDT на процессоре приложений
+void idt_load(void);
+// Подключение обработчика к линии PIC и разрешение линии.
+// Обработчик вызывается с запрещенными прерываниями и должен снять
+// запрос устройства. Возвращает -1, если линия неверна или занята.
+int irq_register(uint8_t irq, irq_handler_t handler);
+// Обработчик локального вектора (IDT_LOCAL_VECTOR..IDT_VECTORS-1).
+// Подтверждение APIC - дело обработчика. Возвращает -1, если вектор
+// неверен.
+int idt_register(uint8_t vector, irq_handler_t handler);
+
+static inline void interrupts_enable(void) {
+    asm volatile("sti" : : : "memory");
+}
+
+static inline void interrupts_disable(void) {
+    asm volatile("cli" : : : "memory");
+}
+
+// Запрет прерываний с сохранением прежнего состояния флага IF
+static inline uint64_t interrupts_save(void) {
+    uint64_t flags;
+    asm volatile("pushfq; popq %0; cli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+static inline void interrupts_restore(uint64_t flags) {
+    if (flags & 0x200) {
+        interrupts_enable();
+    }
+}
+
+#endif
@@ -39,4 +39,34 @@ static inline void outl(uint16_t port, uint32_t value) {
     asm volatile("outl %0, %1" : : "a"(value), "Nd"(port));
 }
 
+// Чтение count слов из порта в память одной инструкцией (rep insw)
+static inline void insw(uint16_t port, void* buffer, uint32_t count) {
+    uint64_t n = count;
+    asm volatile("rep insw" : "+D"(buffer), "+c"(n) : "d"(port) : "memory");
+}
+
+// Запись count слов из памяти в порт (rep outsw)
+static inline void outsw(uint16_t port, const void* buffer, uint32_t count) {
+    uint64_t n = count;
+    asm volatile("rep outsw" : "+S"(buffer), "+c"(n) : "d"(port) : "memory");
+}
+
+// Счетчик тактов процессора
+static inline uint64_t rdtsc(void) {
+    uint32_t low, high;
+    asm volatile("rdtsc" : "=a"(low), "=d"(high));
+    return (uint64_t)high << 32 | low;
+}
+
+// Модельно-специфичные регистры
+static inline uint64_t rdmsr(uint32_t msr) {
+    uint32_t low, high;
+    asm volatile("rdmsr" : "=a"(low), "=d"(high) : "c"(msr));
+    return (uint64_t)high << 32 | low;
+}
+
+static inline void wrmsr(uint32_t msr, uint64_t value) {
+    asm volatile("wrmsr" : : "c"(msr), "a"((uint32_t)value), "d"((uint32_t)(value >> 32)));
+}
+
 #endif 
\ No newline at end of file
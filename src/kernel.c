@@ -5,43 +5,233 @@ __attribute__((section(".magic"))) unsigned long long kernel_magic = 0x4B45524E4
 #include "keyboard.h"
 #include "terminal.h"
 #include "fs.h"
+#include "block.h"
+#include "bcache.h"
+#include "ramdisk.h"
+#include "ata.h"
+#include "pci.h"
+#include "ahci.h"
+#include "virtio_blk.h"
+#include "idt.h"
+#include "clock.h"
+#include "thread.h"
+#include "smp.h"
 
-void _start(void) {
+// Тела потоков ядра (ниже _start, который должен идти первым)
+static void terminal_thread(void* arg);
+static void fsync_thread(void* arg);
+static void io_thread(void* arg);
+static void timer_thread(void* arg);
+static void disk_sleep(volatile uint32_t* events, uint32_t seen);
+static void disk_wake(void);
+static void disk_watchdog(void);
+static uint32_t disk_irq_wait(uint32_t seen);
+
+// Поток, ждущий диск, просыпается не реже чем раз в столько тиков,
+// даже если прерывание потеряно: тогда опрос находит завершение сам
+// (или отсчитывает зависание устройства)
+#define DISK_WATCHDOG_TICKS 10
+
+// Загрузчик передает адрес и размер образа тома FoxFS в памяти
+// (сектора с FS_SUPERBLOCK_SECTOR), либо нули, если образа нет.
+// stage2 переходит на 0x100000, поэтому _start лежит в .text.entry,
+// которую linker.ld ставит сразу за kernel_magic.
+__attribute__((section(".text.entry")))
+void _start(uint64_t initrd_base, uint64_t initrd_size) {
     // Инициализация VGA
     vga_init();
     vga_puts("FoxOS starting... ");
     vga_puts("OK\n");
 
-    // // Инициализация PCI
-    // vga_puts("Initializing PCI... ");
-    // pci_init();
-    // vga_puts("OK\n");
-    
-    // // Инициализация AHCI
-    // vga_puts("Initializing AHCI... ");
-    // if (ahci_init() != 0) {
-    //     vga_puts("Failed!\n");
-    // } else {
-    //     vga_puts("OK\n");
-    // }
-    
+    // Таблица прерываний; прерывания разрешаются после настройки устройств
+    idt_init();
+
+    // Калибровка TSC и тик таймера
+    vga_puts("Calibrating clock... ");
+    vga_put_dec(clock_init() / 1000000);
+    vga_puts(clock_tsc_invariant() ? " MHz, invariant TSC\n" : " MHz\n");
+
+    // Данные загрузочного процессора (GS), MADT и локальный APIC
+    vga_puts("Detecting CPUs... ");
+    vga_put_dec(smp_init());
+    vga_puts(" in MADT\n");
+
+    // Инициализация PCI
+    vga_puts("Initializing PCI... ");
+    vga_put_dec(pci_init());
+    vga_puts(" functions\n");
+
     // Инициализация файловой системы
     vga_puts("Initializing filesystem... ");
+    bcache_init();
     fs_init();
     vga_puts("OK\n");
+
+    // Поиск дисков
+    vga_puts("Detecting ATA drives... ");
+    vga_put_dec(ata_init());
+    vga_puts(" found\n");
+    vga_puts("Initializing AHCI... ");
+    int ahci_disks = ahci_init();
+    if (ahci_disks < 0) {
+        vga_puts("no controller\n");
+    } else {
+        vga_put_dec(ahci_disks);
+        vga_puts(" disks\n");
+    }
+    vga_puts("Initializing virtio-blk... ");
+    vga_put_dec(virtio_blk_init());
+    vga_puts(" found\n");
+
+    // Образ, загруженный загрузчиком, монтируется на месте. Если тот же том
+    // есть на одном из дисков, изменения пишутся на диск, иначе - в память
+    // образа. Без образа том монтируется с первого диска, а без дисков
+    // создается на RAM-диске.
+    void* image = (void*)initrd_base;
+    block_device_t* disk = block_get(0);
+    int mounted = -1;
+    if (initrd_base && initrd_size >= (FS_END_SECTOR - FS_SUPERBLOCK_SECTOR) * BLOCK_SECTOR_SIZE) {
+        uint32_t disks = block_device_count();
+        for (uint32_t i = 0; i < disks && mounted != 0; i++) {
+            disk = block_get(i);
+            mounted = fs_mount_image(disk, image, initrd_size);
+        }
+        if (mounted != 0) {
+            disk = ramdisk_attach(image, FS_SUPERBLOCK_SECTOR,
+                                  FS_SUPERBLOCK_SECTOR + initrd_size / BLOCK_SECTOR_SIZE);
+            block_register(disk);
+            mounted = fs_mount_image(disk, image, initrd_size);
+        }
+    } else {
+        if (!disk) {
+            disk = ramdisk_init(FS_SUPERBLOCK_SECTOR, FS_END_SECTOR);
+            block_register(disk);
+        }
+        mounted = fs_mount(disk);
+    }
+    vga_puts("Mounting ");
+    vga_puts(disk->name);
+    vga_puts("... ");
+    if (mounted != 0) {
+        vga_puts("Failed!\n");
+    } else {
+        vga_puts("OK\n");
+    }
     
     // Инициализация клавиатуры
     vga_puts("Initializing keyboard... ");
     keyboard_init();
     vga_puts("OK\n");
+
+    // Планировщик; процессоры приложений сразу уходят в свои потоки
+    // простоя и забирают работу из чужих очередей
+    thread_init();
+    block_set_sleep(disk_sleep, disk_wake);
+    irq_register(PIT_IRQ, disk_watchdog);
+    vga_puts("Starting CPUs... ");
+    vga_put_dec(smp_boot_aps());
+    vga_puts(" online\n");
     
     vga_puts("\nWelcome to FoxOS!\n");
     vga_puts("Type 'help' for list of commands.\n\n");
     
-    // Запуск терминала
+    // Запуск терминала и потоков ядра. Поток загрузки становится
+    // потоком простоя и получает процессор, только когда остальные ждут.
     terminal_init();
-    
-    while(1) {
+    thread_create("terminal", THREAD_PRIORITY_HIGH, terminal_thread, NULL);
+    thread_create("io", THREAD_PRIORITY_HIGH, io_thread, NULL);
+    thread_create("timer", THREAD_PRIORITY_HIGH, timer_thread, NULL);
+    thread_create("fsync", THREAD_PRIORITY_NORMAL, fsync_thread, NULL);
+    interrupts_enable();
+    thread_idle();
+}
+
+// Терминал: спит до нажатия клавиши; команды выполняются под io_lock
+static void terminal_thread(void* arg) {
+    while (1) {
+        keyboard_wait();
         terminal_run();
-    };
-}
\ No newline at end of file
+    }
+}
+
+// Фиксация журнала и фоновая запись грязных буферов
+static void fsync_thread(void* arg) {
+    while (1) {
+        thread_sleep(FS_SYNC_TICK_MS * 1000000ull);
+        mutex_lock(&io_lock);
+        fs_sync_tick();
+        mutex_unlock(&io_lock);
+    }
+}
+
+// Завершения запросов к дискам, которых никто не ждет (опережающее
+// чтение, фоновая запись), и выдача оставшихся в очереди. Пока есть
+// работа у устройства без прерываний (ATA PIO, ramdisk), поток
+// опрашивает раз в тик: синхронный драйвер за один block_poll
+// выполняет одну цепочку. Иначе спит до прерывания диска; тот, кому
+// нужны данные, ждет свой запрос сам в block_wait.
+static void io_thread(void* arg) {
+    uint32_t seen = 0;
+    while (1) {
+        mutex_lock(&io_lock);
+        block_poll();
+        int sync = block_sync_pending();
+        mutex_unlock(&io_lock);
+        if (sync) {
+            thread_sleep(CLOCK_TICK_NS);
+        } else {
+            seen = disk_irq_wait(seen);
+        }
+    }
+}
+
+// Таймеры раз в тик; io_lock не нужна
+static void timer_thread(void* arg) {
+    while (1) {
+        clock_run_timers();
+        thread_sleep(CLOCK_TICK_NS);
+    }
+}
+
+// Потоки, ждущие прерывания дисков: в block_poll_wait и поток io
+static wait_queue_t disk_waiters = WAIT_QUEUE_INIT;
+// Прерываний дисков с запуска (под disk_waiters.lock)
+static uint32_t disk_irqs = 0;
+
+static void disk_sleep(volatile uint32_t* events, uint32_t seen) {
+    uint64_t flags = spin_lock_irqsave(&disk_waiters.lock);
+    if (*events == seen) {
+        thread_wait(&disk_waiters);
+    }
+    spin_unlock_irqrestore(&disk_waiters.lock, flags);
+}
+
+// Ожидание прерывания после seen-го, возвращает новый счет. Сторож
+// будит и поток io; тот снова засыпает, если прерывания не было и
+// устройствам без прерываний нечего опрашивать (работу им могли
+// поставить в очередь, пока поток спал).
+static uint32_t disk_irq_wait(uint32_t seen) {
+    uint64_t flags = spin_lock_irqsave(&disk_waiters.lock);
+    while (disk_irqs == seen && !block_sync_pending()) {
+        thread_wait(&disk_waiters);
+    }
+    seen = disk_irqs;
+    spin_unlock_irqrestore(&disk_waiters.lock, flags);
+    return seen;
+}
+
+// Из обработчика прерывания диска (прерывания уже запрещены)
+static void disk_wake(void) {
+    spin_lock(&disk_waiters.lock);
+    disk_irqs++;
+    thread_wake_all(&disk_waiters);
+    spin_unlock(&disk_waiters.lock);
+}
+
+static void disk_watchdog(void) {
+    if (clock_ticks() % DISK_WATCHDOG_TICKS == 0) {
+        spin_lock(&disk_waiters.lock);
+        thread_wake_all(&disk_waiters);
+        spin_unlock(&disk_waiters.lock);
+    }
+}
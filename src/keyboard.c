@@ -1,5 +1,7 @@
 #include "keyboard.h"
 #include "io.h"
+#include "idt.h"
+#include "thread.h"
 
 // Карта символов (без shift)
 static const char scancode_to_char[] = {
@@ -26,35 +28,102 @@ static const char scancode_to_char_shift[] = {
 #define CHAR_RIGHT 4  // Ctrl-D
 #define CHAR_DEL   5  // Ctrl-E
 
+// Порты контроллера 8042
+#define KEYBOARD_DATA    0x60
+#define KEYBOARD_STATUS  0x64
+#define KEYBOARD_COMMAND 0x64
+#define KEYBOARD_STATUS_OUTPUT 0x01  // Есть байт для чтения
+#define KEYBOARD_STATUS_INPUT  0x02  // Контроллер еще не принял байт
+#define KEYBOARD_READ_CONFIG   0x20
+#define KEYBOARD_WRITE_CONFIG  0x60
+#define KEYBOARD_CONFIG_IRQ1   0x01
+#define KEYBOARD_IRQ 1
+
 static uint8_t shift_pressed = 0;
 
-// Ожидание готовности клавиатуры
-void keyboard_wait(void) {
-    while (inb(0x64) & 2);
+// Кольцо: пишет только обработчик прерывания, читает только
+// keyboard_read, поэтому блокировка не нужна. Индексы растут непрерывно,
+// каждый меняет только одна сторона; байт записывается до публикации
+// индекса записи.
+static volatile uint8_t ring[KEYBOARD_RING_SIZE];
+static volatile uint32_t ring_head = 0;   // Следующая запись (обработчик)
+static volatile uint32_t ring_tail = 0;   // Следующее чтение
+// Потоки, ждущие скан-кода
+static wait_queue_t ring_waiters = WAIT_QUEUE_INIT;
+
+static void controller_wait_input(void) {
+    while (inb(KEYBOARD_STATUS) & KEYBOARD_STATUS_INPUT);
 }
 
-// Чтение скан-кода
-uint8_t keyboard_get_scancode(void) {
-    keyboard_wait();
-    return inb(0x60);
+static void controller_wait_output(void) {
+    while (!(inb(KEYBOARD_STATUS) & KEYBOARD_STATUS_OUTPUT));
+}
+
+// Обработчик IRQ1: скан-коды из контроллера в кольцо. При переполнении
+// новые коды теряются, уже принятые не затираются.
+static void keyboard_irq(void) {
+    while (inb(KEYBOARD_STATUS) & KEYBOARD_STATUS_OUTPUT) {
+        uint8_t scancode = inb(KEYBOARD_DATA);
+        uint32_t head = ring_head;
+        if (head - ring_tail == KEYBOARD_RING_SIZE) {
+            continue;
+        }
+        ring[head & (KEYBOARD_RING_SIZE - 1)] = scancode;
+        ring_head = head + 1;
+    }
+    spin_lock(&ring_waiters.lock);
+    thread_wake_all(&ring_waiters);
+    spin_unlock(&ring_waiters.lock);
 }
 
 // Инициализация клавиатуры
 void keyboard_init(void) {
     // Очищаем буфер клавиатуры
-    while (inb(0x64) & 1) {
-        inb(0x60);
+    while (inb(KEYBOARD_STATUS) & KEYBOARD_STATUS_OUTPUT) {
+        inb(KEYBOARD_DATA);
+    }
+    ring_head = 0;
+    ring_tail = 0;
+    spin_init(&ring_waiters.lock);
+    ring_waiters.head = NULL;
+    ring_waiters.tail = NULL;
+
+    // Прерывание первого порта может быть выключено прошивкой
+    controller_wait_input();
+    outb(KEYBOARD_COMMAND, KEYBOARD_READ_CONFIG);
+    controller_wait_output();
+    uint8_t config = inb(KEYBOARD_DATA);
+    controller_wait_input();
+    outb(KEYBOARD_COMMAND, KEYBOARD_WRITE_CONFIG);
+    controller_wait_input();
+    outb(KEYBOARD_DATA, config | KEYBOARD_CONFIG_IRQ1);
+
+    irq_register(KEYBOARD_IRQ, keyboard_irq);
+}
+
+int keyboard_pending(void) {
+    return ring_tail != ring_head;
+}
+
+// Кольцо проверяется под блокировкой очереди, которую берет и
+// обработчик перед пробуждением, поэтому пробуждение не теряется
+void keyboard_wait(void) {
+    uint64_t flags = spin_lock_irqsave(&ring_waiters.lock);
+    while (!keyboard_pending()) {
+        thread_wait(&ring_waiters);
     }
+    spin_unlock_irqrestore(&ring_waiters.lock, flags);
 }
 
 // Чтение символа с клавиатуры
 char keyboard_read(void) {
-    uint8_t scancode;
     char c = 0;
-    static uint8_t last_scancode = 0;
-    static uint8_t key_held = 0;
-
-    scancode = keyboard_get_scancode();
+    uint32_t tail = ring_tail;
+    if (tail == ring_head) {
+        return 0;
+    }
+    uint8_t scancode = ring[tail & (KEYBOARD_RING_SIZE - 1)];
+    ring_tail = tail + 1;
 
     // Обработка shift
     if (scancode == KEY_LSHIFT || scancode == KEY_RSHIFT) {
@@ -66,13 +135,8 @@ char keyboard_read(void) {
         return 0;
     }
 
-    // Если это отпускание клавиши
+    // Отпускание клавиши
     if (scancode & 0x80) {
-        // Сбрасываем флаги для этой клавиши
-        if ((scancode & 0x7F) == last_scancode) {
-            last_scancode = 0;
-            key_held = 0;
-        }
         return 0;
     }
 
@@ -102,12 +166,5 @@ char keyboard_read(void) {
             break;
     }
 
-    // Если клавиша уже нажата, игнорируем повторы
-    if (scancode == last_scancode && key_held) {
-        return 0;
-    }
-    last_scancode = scancode;
-    key_held = 1;
-
     return c;
 } 
\ No newline at end of file
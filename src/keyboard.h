@@ -16,10 +16,17 @@
 #define KEY_RIGHT       0x4D
 #define KEY_DELETE      0x53
 
+// Кольцо скан-кодов между обработчиком IRQ1 и keyboard_read (степень двойки)
+#define KEYBOARD_RING_SIZE 256
+
 // Функции
+// Подключает обработчик IRQ1 (после idt_init)
 void keyboard_init(void);
+// Символ из кольца без ожидания, 0 - символа нет
 char keyboard_read(void);
-uint8_t keyboard_get_scancode(void);
+// В кольце есть необработанные скан-коды
+int keyboard_pending(void);
+// Сон потока до появления скан-кода в кольце
 void keyboard_wait(void);
 
 #endif 
\ No newline at end of file
@@ -0,0 +1,165 @@
+#include "lz4.h"
+
+// Таблица последних позиций четырехбайтовых последовательностей (позиция + 1)
+#define LZ4_HASH_BITS 12
+static uint16_t lz4_table[1 << LZ4_HASH_BITS];
+
+// Ограничения формата: последние 5 байт всегда литералы,
+// последнее совпадение начинается не ближе 12 байт к концу
+#define LZ4_LAST_LITERALS 5
+#define LZ4_MATCH_LIMIT 12
+#define LZ4_MIN_MATCH 4
+
+static uint32_t read32(const uint8_t* p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint32_t lz4_hash(uint32_t v) {
+    return (v * 2654435761u) >> (32 - LZ4_HASH_BITS);
+}
+
+// Запись последовательности: литералы и (если match_len != 0) совпадение.
+// Возвращает новую позицию в dst или -1 при нехватке места.
+static int lz4_emit(uint8_t* dst, uint32_t capacity, uint32_t op,
+                    const uint8_t* literals, uint32_t literal_len,
+                    uint32_t offset, uint32_t match_len) {
+    uint32_t need = 1 + literal_len + literal_len / 255 + 1;
+    if (match_len) {
+        need += 2 + match_len / 255 + 1;
+    }
+    if (op + need > capacity) {
+        return -1;
+    }
+
+    uint32_t token = op++;
+    if (literal_len >= 15) {
+        dst[token] = 15 << 4;
+        uint32_t rest = literal_len - 15;
+        for (; rest >= 255; rest -= 255) {
+            dst[op++] = 255;
+        }
+        dst[op++] = rest;
+    } else {
+        dst[token] = literal_len << 4;
+    }
+    for (uint32_t i = 0; i < literal_len; i++) {
+        dst[op++] = literals[i];
+    }
+    if (!match_len) {
+        return op;
+    }
+
+    dst[op++] = offset & 0xFF;
+    dst[op++] = offset >> 8;
+    uint32_t ml = match_len - LZ4_MIN_MATCH;
+    if (ml >= 15) {
+        dst[token] |= 15;
+        uint32_t rest = ml - 15;
+        for (; rest >= 255; rest -= 255) {
+            dst[op++] = 255;
+        }
+        dst[op++] = rest;
+    } else {
+        dst[token] |= ml;
+    }
+    return op;
+}
+
+uint32_t lz4_compress(const uint8_t* src, uint32_t size, uint8_t* dst, uint32_t capacity) {
+    if (size > LZ4_MAX_INPUT) {
+        return 0;
+    }
+    for (uint32_t i = 0; i < (1 << LZ4_HASH_BITS); i++) {
+        lz4_table[i] = 0;
+    }
+
+    uint32_t ip = 0;
+    uint32_t anchor = 0;
+    int op = 0;
+    if (size > LZ4_MATCH_LIMIT) {
+        uint32_t limit = size - LZ4_MATCH_LIMIT;
+        while (ip < limit) {
+            uint32_t seq = read32(src + ip);
+            uint32_t h = lz4_hash(seq);
+            uint32_t ref = lz4_table[h];
+            lz4_table[h] = ip + 1;
+            if (!ref || read32(src + ref - 1) != seq) {
+                ip++;
+                continue;
+            }
+            ref--;
+
+            uint32_t len = LZ4_MIN_MATCH;
+            while (ip + len < size - LZ4_LAST_LITERALS && src[ref + len] == src[ip + len]) {
+                len++;
+            }
+            op = lz4_emit(dst, capacity, op, src + anchor, ip - anchor, ip - ref, len);
+            if (op < 0) {
+                return 0;
+            }
+            ip += len;
+            anchor = ip;
+        }
+    }
+
+    // Оставшиеся литералы
+    op = lz4_emit(dst, capacity, op, src + anchor, size - anchor, 0, 0);
+    return op < 0 ? 0 : op;
+}
+
+int lz4_decompress(const uint8_t* src, uint32_t size, uint8_t* dst, uint32_t capacity) {
+    uint32_t ip = 0;
+    uint32_t op = 0;
+    while (ip < size) {
+        uint32_t token = src[ip++];
+
+        uint32_t literal_len = token >> 4;
+        if (literal_len == 15) {
+            uint32_t b;
+            do {
+                if (ip >= size) {
+                    return -1;
+                }
+                b = src[ip++];
+                literal_len += b;
+            } while (b == 255);
+        }
+        if (literal_len > size - ip || literal_len > capacity - op) {
+            return -1;
+        }
+        for (uint32_t i = 0; i < literal_len; i++) {
+            dst[op++] = src[ip++];
+        }
+        if (ip == size) {
+            break;  // Последняя последовательность без совпадения
+        }
+
+        if (size - ip < 2) {
+            return -1;
+        }
+        uint32_t offset = src[ip] | (uint32_t)src[ip + 1] << 8;
+        ip += 2;
+        if (!offset || offset > op) {
+            return -1;
+        }
+        uint32_t match_len = (token & 15) + LZ4_MIN_MATCH;
+        if ((token & 15) == 15) {
+            uint32_t b;
+            do {
+                if (ip >= size) {
+                    return -1;
+                }
+                b = src[ip++];
+                match_len += b;
+            } while (b == 255);
+        }
+        if (match_len > capacity - op) {
+            return -1;
+        }
+        // Побайтовое копирование: совпадение может перекрывать само себя
+        for (uint32_t i = 0; i < match_len; i++, op++) {
+            dst[op] = dst[op - offset];
+        }
+    }
+    return op;
+}
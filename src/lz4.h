@@ -0,0 +1,15 @@
+#ifndef LZ4_H
+#define LZ4_H
+
+#include "stdint.h"
+
+// Сжатие в блочном формате LZ4. Смещения совпадений 16-битные,
+// поэтому вход ограничен 64 КБ.
+#define LZ4_MAX_INPUT 65535
+
+// Возвращает размер сжатых данных или 0, если они не помещаются в capacity
+uint32_t lz4_compress(const uint8_t* src, uint32_t size, uint8_t* dst, uint32_t capacity);
+// Возвращает размер распакованных данных или -1 при поврежденном входе
+int lz4_decompress(const uint8_t* src, uint32_t size, uint8_t* dst, uint32_t capacity);
+
+#endif
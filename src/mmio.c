@@ -0,0 +1,47 @@
+#include "mmio.h"
+
+#define PAGE_PRESENT  0x01
+#define PAGE_WRITE    0x02
+#define PAGE_PWT      0x08
+#define PAGE_PCD      0x10
+#define PAGE_HUGE     0x80
+#define PAGE_ADDRESS  0x000FFFFFFFFFF000ull
+#define HUGE_PAGE_SIZE 0x200000ull
+
+// Запас каталогов страниц: каждый покрывает 1 ГБ адресов
+#define MMIO_MAX_TABLES 4
+
+static uint64_t tables[MMIO_MAX_TABLES][512] __attribute__((aligned(4096)));
+static uint32_t tables_used = 0;
+
+void* mmio_map(uint64_t phys, uint64_t size) {
+    if (!size || phys + size > (1ull << 39)) {
+        return NULL;
+    }
+    uint64_t cr3;
+    asm volatile("mov %%cr3, %0" : "=r"(cr3));
+    // Таблицы загрузчика лежат в первом гигабайте, адрес равен физическому
+    uint64_t* pml4 = (uint64_t*)(cr3 & PAGE_ADDRESS);
+    uint64_t* pdpt = (uint64_t*)(pml4[0] & PAGE_ADDRESS);
+
+    for (uint64_t page = phys & ~(HUGE_PAGE_SIZE - 1); page < phys + size; page += HUGE_PAGE_SIZE) {
+        uint64_t* entry = &pdpt[page >> 30];
+        if (!(*entry & PAGE_PRESENT)) {
+            if (tables_used >= MMIO_MAX_TABLES) {
+                return NULL;
+            }
+            uint64_t* table = tables[tables_used++];
+            for (int i = 0; i < 512; i++) {
+                table[i] = 0;
+            }
+            *entry = (uint64_t)table | PAGE_PRESENT | PAGE_WRITE;
+        }
+        uint64_t* pd = (uint64_t*)(*entry & PAGE_ADDRESS);
+        uint64_t* pde = &pd[(page >> 21) & 511];
+        if (!(*pde & PAGE_PRESENT)) {
+            *pde = page | PAGE_PRESENT | PAGE_WRITE | PAGE_HUGE | PAGE_PWT | PAGE_PCD;
+            asm volatile("invlpg (%0)" : : "r"(page) : "memory");
+        }
+    }
+    return (void*)phys;
+}
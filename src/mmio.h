@@ -0,0 +1,13 @@
+#ifndef MMIO_H
+#define MMIO_H
+
+#include "stdint.h"
+
+// Загрузчик отображает один к одному только первый гигабайт памяти.
+// Регистры устройств (BAR PCI, APIC) обычно лежат выше, у 4 ГБ, и
+// отображаются по требованию тоже один к одному, страницами по 2 МБ
+// без кэширования. Поддерживаются физические адреса до 512 ГБ.
+// Возвращает указатель на phys или NULL, если не хватило таблиц страниц.
+void* mmio_map(uint64_t phys, uint64_t size);
+
+#endif
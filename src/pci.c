@@ -0,0 +1,143 @@
+#include "pci.h"
+#include "io.h"
+
+// Найденные функции
+static pci_device_t devices[PCI_MAX_DEVICES];
+static uint32_t device_count = 0;
+
+static uint32_t config_address(uint8_t bus, uint8_t slot, uint8_t function, uint8_t offset) {
+    return 0x80000000 | (uint32_t)bus << 16 | (uint32_t)slot << 11 |
+           (uint32_t)function << 8 | (offset & 0xFC);
+}
+
+static uint32_t config_read(uint8_t bus, uint8_t slot, uint8_t function, uint8_t offset) {
+    outl(PCI_CONFIG_ADDRESS, config_address(bus, slot, function, offset));
+    return inl(PCI_CONFIG_DATA);
+}
+
+uint32_t pci_read32(const pci_device_t* dev, uint8_t offset) {
+    return config_read(dev->bus, dev->slot, dev->function, offset);
+}
+
+uint16_t pci_read16(const pci_device_t* dev, uint8_t offset) {
+    return pci_read32(dev, offset) >> ((offset & 2) * 8);
+}
+
+uint8_t pci_read8(const pci_device_t* dev, uint8_t offset) {
+    return pci_read32(dev, offset) >> ((offset & 3) * 8);
+}
+
+void pci_write32(const pci_device_t* dev, uint8_t offset, uint32_t value) {
+    outl(PCI_CONFIG_ADDRESS, config_address(dev->bus, dev->slot, dev->function, offset));
+    outl(PCI_CONFIG_DATA, value);
+}
+
+void pci_write16(const pci_device_t* dev, uint8_t offset, uint16_t value) {
+    uint32_t shift = (offset & 2) * 8;
+    uint32_t old = pci_read32(dev, offset);
+    pci_write32(dev, offset, (old & ~(0xFFFFu << shift)) | (uint32_t)value << shift);
+}
+
+// Запоминание функции, если она есть
+static void probe_function(uint8_t bus, uint8_t slot, uint8_t function) {
+    uint32_t id = config_read(bus, slot, function, PCI_VENDOR_ID);
+    if ((id & 0xFFFF) == 0xFFFF || device_count >= PCI_MAX_DEVICES) {
+        return;
+    }
+    uint32_t class_reg = config_read(bus, slot, function, PCI_REVISION);
+    pci_device_t* dev = &devices[device_count++];
+    dev->bus = bus;
+    dev->slot = slot;
+    dev->function = function;
+    dev->vendor_id = id & 0xFFFF;
+    dev->device_id = id >> 16;
+    dev->class_code = class_reg >> 24;
+    dev->subclass = class_reg >> 16;
+    dev->prog_if = class_reg >> 8;
+    dev->irq_line = config_read(bus, slot, function, PCI_INTERRUPT_LINE);
+}
+
+int pci_init(void) {
+    device_count = 0;
+    for (uint32_t bus = 0; bus < 256; bus++) {
+        for (uint8_t slot = 0; slot < 32; slot++) {
+            if ((config_read(bus, slot, 0, PCI_VENDOR_ID) & 0xFFFF) == 0xFFFF) {
+                continue;
+            }
+            // Бит 7 типа заголовка - многофункциональное устройство
+            uint8_t header = config_read(bus, slot, 0, PCI_HEADER_TYPE) >> 16;
+            uint8_t functions = header & 0x80 ? 8 : 1;
+            for (uint8_t function = 0; function < functions; function++) {
+                probe_function(bus, slot, function);
+            }
+        }
+    }
+    return device_count;
+}
+
+pci_device_t* pci_get(uint32_t index) {
+    return index < device_count ? &devices[index] : NULL;
+}
+
+pci_device_t* pci_find_class(uint8_t class_code, uint8_t subclass, uint8_t prog_if, uint32_t index) {
+    for (uint32_t i = 0; i < device_count; i++) {
+        pci_device_t* dev = &devices[i];
+        if (dev->class_code == class_code && dev->subclass == subclass &&
+            (prog_if == 0xFF || dev->prog_if == prog_if) && index-- == 0) {
+            return dev;
+        }
+    }
+    return NULL;
+}
+
+pci_device_t* pci_find_device(uint16_t vendor_id, uint16_t device_id, uint32_t index) {
+    for (uint32_t i = 0; i < device_count; i++) {
+        pci_device_t* dev = &devices[i];
+        if (dev->vendor_id == vendor_id && dev->device_id == device_id && index-- == 0) {
+            return dev;
+        }
+    }
+    return NULL;
+}
+
+uint64_t pci_bar_address(const pci_device_t* dev, uint32_t bar, int* is_io) {
+    uint8_t offset = PCI_BAR0 + bar * 4;
+    uint32_t low = pci_read32(dev, offset);
+    if (low & 1) {
+        *is_io = 1;
+        return low & ~3u;
+    }
+    *is_io = 0;
+    uint64_t address = low & ~0xFu;
+    // Тип 2 - 64-битный BAR, старшая половина в следующем
+    if (((low >> 1) & 3) == 2 && bar < 5) {
+        address |= (uint64_t)pci_read32(dev, offset + 4) << 32;
+    }
+    return address;
+}
+
+void pci_enable(const pci_device_t* dev) {
+    uint16_t command = pci_read16(dev, PCI_COMMAND);
+    command |= PCI_COMMAND_IO | PCI_COMMAND_MEMORY | PCI_COMMAND_MASTER;
+    pci_write16(dev, PCI_COMMAND, command & ~PCI_COMMAND_INTX_DISABLE);
+}
+
+uint8_t pci_next_capability(const pci_device_t* dev, uint8_t offset, uint8_t id) {
+    if (!(pci_read16(dev, PCI_STATUS) & PCI_STATUS_CAP_LIST)) {
+        return 0;
+    }
+    offset = offset ? (pci_read32(dev, offset) >> 8) & 0xFC : pci_read8(dev, PCI_CAPABILITIES) & 0xFC;
+    // Ограничение шагов защищает от зацикленного списка
+    for (int steps = 0; offset && steps < 48; steps++) {
+        uint32_t header = pci_read32(dev, offset);
+        if ((header & 0xFF) == id) {
+            return offset;
+        }
+        offset = (header >> 8) & 0xFC;
+    }
+    return 0;
+}
+
+uint8_t pci_find_capability(const pci_device_t* dev, uint8_t id) {
+    return pci_next_capability(dev, 0, id);
+}
@@ -0,0 +1,74 @@
+#ifndef PCI_H
+#define PCI_H
+
+#include "stdint.h"
+
+// Порты механизма конфигурации №1
+#define PCI_CONFIG_ADDRESS 0xCF8
+#define PCI_CONFIG_DATA    0xCFC
+
+// Смещения в конфигурационном пространстве
+#define PCI_VENDOR_ID      0x00
+#define PCI_DEVICE_ID      0x02
+#define PCI_COMMAND        0x04
+#define PCI_STATUS         0x06
+#define PCI_REVISION       0x08
+#define PCI_HEADER_TYPE    0x0E
+#define PCI_BAR0           0x10
+#define PCI_SUBSYSTEM_ID   0x2E
+#define PCI_CAPABILITIES   0x34
+#define PCI_INTERRUPT_LINE 0x3C
+
+// Биты регистра команд
+#define PCI_COMMAND_IO     0x0001
+#define PCI_COMMAND_MEMORY 0x0002
+#define PCI_COMMAND_MASTER 0x0004
+#define PCI_COMMAND_INTX_DISABLE 0x0400
+
+// В регистре состояния: есть список capabilities
+#define PCI_STATUS_CAP_LIST 0x0010
+
+// Максимальное количество запоминаемых функций
+#define PCI_MAX_DEVICES 64
+
+// Функция PCI, найденная при переборе шин
+typedef struct {
+    uint8_t bus;
+    uint8_t slot;
+    uint8_t function;
+    uint8_t class_code;
+    uint8_t subclass;
+    uint8_t prog_if;
+    uint8_t irq_line;    // Линия PIC, назначенная BIOS (0xFF - нет)
+    uint16_t vendor_id;
+    uint16_t device_id;
+} pci_device_t;
+
+// Перебор всех шин, устройств и функций. Возвращает количество найденных функций.
+int pci_init(void);
+
+// Найденная функция по номеру (NULL за концом списка)
+pci_device_t* pci_get(uint32_t index);
+// index-я функция с заданным классом (prog_if 0xFF - любой)
+pci_device_t* pci_find_class(uint8_t class_code, uint8_t subclass, uint8_t prog_if, uint32_t index);
+// index-я функция с заданными производителем и устройством
+pci_device_t* pci_find_device(uint16_t vendor_id, uint16_t device_id, uint32_t index);
+
+// Доступ к конфигурационному пространству, offset выровнен по размеру
+uint32_t pci_read32(const pci_device_t* dev, uint8_t offset);
+uint16_t pci_read16(const pci_device_t* dev, uint8_t offset);
+uint8_t pci_read8(const pci_device_t* dev, uint8_t offset);
+void pci_write32(const pci_device_t* dev, uint8_t offset, uint32_t value);
+void pci_write16(const pci_device_t* dev, uint8_t offset, uint16_t value);
+
+// Физический адрес BAR (с учетом 64-битных BAR) и признак порта ввода-вывода
+uint64_t pci_bar_address(const pci_device_t* dev, uint32_t bar, int* is_io);
+// Включение декодирования памяти/портов, управления шиной (DMA)
+// и прерываний INTx
+void pci_enable(const pci_device_t* dev);
+// Смещение capability с заданным идентификатором, 0 если ее нет
+uint8_t pci_find_capability(const pci_device_t* dev, uint8_t id);
+// Следующая после offset capability с идентификатором id (offset 0 - с начала списка)
+uint8_t pci_next_capability(const pci_device_t* dev, uint8_t offset, uint8_t id);
+
+#endif
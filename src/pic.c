@@ -0,0 +1,70 @@
+#include "pic.h"
+#include "io.h"
+
+// Команды инициализации (ICW) и операций (OCW)
+#define PIC_ICW1_INIT 0x11    // Каскад, ICW4 будет
+#define PIC_ICW4_8086 0x01
+#define PIC_OCW3_READ_ISR 0x0B
+#define PIC_EOI 0x20
+
+// Пауза между командами: запись в неиспользуемый порт
+static void io_wait(void) {
+    outb(0x80, 0);
+}
+
+void pic_init(void) {
+    outb(PIC_MASTER_COMMAND, PIC_ICW1_INIT);
+    io_wait();
+    outb(PIC_SLAVE_COMMAND, PIC_ICW1_INIT);
+    io_wait();
+    outb(PIC_MASTER_DATA, PIC_MASTER_VECTOR);
+    io_wait();
+    outb(PIC_SLAVE_DATA, PIC_SLAVE_VECTOR);
+    io_wait();
+    outb(PIC_MASTER_DATA, 1 << PIC_CASCADE_IRQ);  // Ведомый на входе 2
+    io_wait();
+    outb(PIC_SLAVE_DATA, PIC_CASCADE_IRQ);        // Номер входа у ведущего
+    io_wait();
+    outb(PIC_MASTER_DATA, PIC_ICW4_8086);
+    io_wait();
+    outb(PIC_SLAVE_DATA, PIC_ICW4_8086);
+    io_wait();
+
+    outb(PIC_MASTER_DATA, (uint8_t)~(1 << PIC_CASCADE_IRQ));
+    outb(PIC_SLAVE_DATA, 0xFF);
+}
+
+void pic_unmask(uint8_t irq) {
+    uint16_t port = irq < 8 ? PIC_MASTER_DATA : PIC_SLAVE_DATA;
+    outb(port, inb(port) & ~(1 << (irq & 7)));
+}
+
+void pic_mask(uint8_t irq) {
+    uint16_t port = irq < 8 ? PIC_MASTER_DATA : PIC_SLAVE_DATA;
+    outb(port, inb(port) | 1 << (irq & 7));
+}
+
+// Ложное прерывание возникает, когда запрос снят до подтверждения:
+// контроллер выдает вектор младшего приоритета, не отмечая его в ISR.
+// Ложное от ведомого все же требует EOI ведущему за каскад.
+int pic_spurious(uint8_t irq) {
+    if ((irq & 7) != 7) {
+        return 0;
+    }
+    uint16_t command = irq < 8 ? PIC_MASTER_COMMAND : PIC_SLAVE_COMMAND;
+    outb(command, PIC_OCW3_READ_ISR);
+    if (inb(command) & 0x80) {
+        return 0;
+    }
+    if (irq >= 8) {
+        outb(PIC_MASTER_COMMAND, PIC_EOI);
+    }
+    return 1;
+}
+
+void pic_eoi(uint8_t irq) {
+    if (irq >= 8) {
+        outb(PIC_SLAVE_COMMAND, PIC_EOI);
+    }
+    outb(PIC_MASTER_COMMAND, PIC_EOI);
+}
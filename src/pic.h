@@ -0,0 +1,28 @@
+#ifndef PIC_H
+#define PIC_H
+
+#include "stdint.h"
+
+// Порты контроллеров прерываний 8259
+#define PIC_MASTER_COMMAND 0x20
+#define PIC_MASTER_DATA    0x21
+#define PIC_SLAVE_COMMAND  0xA0
+#define PIC_SLAVE_DATA     0xA1
+
+// Векторы после переназначения: IRQ 0-7 и 8-15 идут за исключениями
+#define PIC_MASTER_VECTOR 0x20
+#define PIC_SLAVE_VECTOR  0x28
+#define PIC_IRQ_COUNT 16
+// Вход ведущего, к которому подключен ведомый
+#define PIC_CASCADE_IRQ 2
+
+// Переназначение векторов, все линии, кроме каскада, запрещены
+void pic_init(void);
+void pic_unmask(uint8_t irq);
+void pic_mask(uint8_t irq);
+// Ложное прерывание (IRQ 7 или 15 без бита в регистре обслуживания)
+int pic_spurious(uint8_t irq);
+// Конец обработки прерывания
+void pic_eoi(uint8_t irq);
+
+#endif
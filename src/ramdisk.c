@@ -0,0 +1,76 @@
+#include "ramdisk.h"
+
+// Память устройства: сектора с first по sector_count - 1
+typedef struct {
+    uint8_t* mem;
+    uint64_t first;
+} ramdisk_t;
+
+static uint8_t ramdisk_mem[RAMDISK_MAX_SECTORS][BLOCK_SECTOR_SIZE];
+static ramdisk_t ramdisk = { &ramdisk_mem[0][0], 0 };
+static ramdisk_t initrd = { NULL, 0 };
+
+static int ramdisk_read(block_device_t* dev, uint64_t lba, uint32_t count, void* buffer) {
+    const ramdisk_t* rd = (const ramdisk_t*)dev->driver_data;
+    uint8_t* out = (uint8_t*)buffer;
+    for (uint32_t s = 0; s < count; s++, lba++) {
+        if (lba < rd->first) {
+            for (uint32_t i = 0; i < BLOCK_SECTOR_SIZE; i++) {
+                *out++ = 0;
+            }
+            continue;
+        }
+        const uint8_t* sector = rd->mem + (lba - rd->first) * BLOCK_SECTOR_SIZE;
+        for (uint32_t i = 0; i < BLOCK_SECTOR_SIZE; i++) {
+            *out++ = sector[i];
+        }
+    }
+    return 0;
+}
+
+static int ramdisk_write(block_device_t* dev, uint64_t lba, uint32_t count, const void* buffer) {
+    const ramdisk_t* rd = (const ramdisk_t*)dev->driver_data;
+    const uint8_t* in = (const uint8_t*)buffer;
+    if (lba < rd->first) {
+        return -1;
+    }
+    uint8_t* out = rd->mem + (lba - rd->first) * BLOCK_SECTOR_SIZE;
+    for (uint32_t i = 0; i < count * BLOCK_SECTOR_SIZE; i++) {
+        out[i] = in[i];
+    }
+    return 0;
+}
+
+static block_device_t ramdisk_dev = {
+    "ram0", 0, ramdisk_read, ramdisk_write, &ramdisk, NULL, NULL, NULL, 0
+};
+
+static block_device_t initrd_dev = {
+    "initrd", 0, ramdisk_read, ramdisk_write, &initrd, NULL, NULL, NULL, 0
+};
+
+block_device_t* ramdisk_init(uint64_t first_lba, uint64_t sector_count) {
+    if (first_lba > sector_count || sector_count - first_lba > RAMDISK_MAX_SECTORS) {
+        return NULL;
+    }
+    // Память не обнуляется загрузчиком
+    for (uint64_t s = 0; s < sector_count - first_lba; s++) {
+        for (uint32_t i = 0; i < BLOCK_SECTOR_SIZE; i++) {
+            ramdisk_mem[s][i] = 0;
+        }
+    }
+    ramdisk.mem = &ramdisk_mem[0][0];
+    ramdisk.first = first_lba;
+    ramdisk_dev.sector_count = sector_count;
+    return &ramdisk_dev;
+}
+
+block_device_t* ramdisk_attach(void* mem, uint64_t first_lba, uint64_t sector_count) {
+    if (!mem || first_lba >= sector_count) {
+        return NULL;
+    }
+    initrd.mem = (uint8_t*)mem;
+    initrd.first = first_lba;
+    initrd_dev.sector_count = sector_count;
+    return &initrd_dev;
+}
@@ -0,0 +1,20 @@
+#ifndef RAMDISK_H
+#define RAMDISK_H
+
+#include "stdint.h"
+#include "block.h"
+
+// Объем памяти под RAM-диск в секторах (6 МБ)
+#define RAMDISK_MAX_SECTORS 12288
+
+// Создание блочного устройства в оперативной памяти. Хранятся только
+// сектора с first_lba по sector_count - 1, сектора до first_lba читаются
+// нулями. Так том FoxFS занимает память только под свою область.
+block_device_t* ramdisk_init(uint64_t first_lba, uint64_t sector_count);
+
+// Устройство "initrd" поверх уже заполненной памяти (например, образа,
+// загруженного загрузчиком): mem содержит сектора с first_lba по
+// sector_count - 1. Память не копируется и не очищается.
+block_device_t* ramdisk_attach(void* mem, uint64_t first_lba, uint64_t sector_count);
+
+#endif
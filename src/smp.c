@@ -0,0 +1,188 @@
+#include "smp.h"
+#include "apic.h"
+#include "acpi.h"
+#include "idt.h"
+#include "io.h"
+#include "clock.h"
+
+#define MSR_GS_BASE 0xC0000101
+
+static cpu_t cpus[SMP_MAX_CPUS];
+static volatile uint32_t cpu_count = 0;
+static acpi_madt_t madt;
+static int apic_ready = 0;
+
+// Замер масштабирования: задания потоков и ожидание последнего
+typedef struct {
+    uint32_t units;
+    uint64_t result;
+} bench_worker_t;
+
+static bench_worker_t bench_workers[SMP_MAX_CPUS];
+static wait_queue_t bench_done = WAIT_QUEUE_INIT;
+static uint32_t bench_running = 0;
+
+static void cpu_setup(cpu_t* cpu, uint32_t index, uint32_t apic) {
+    cpu->self = cpu;
+    cpu->index = index;
+    cpu->apic_id = apic;
+    cpu->online = 0;
+}
+
+static void apic_timer_irq(void) {
+    thread_tick();
+    apic_eoi();
+}
+
+// Сам факт прерывания: need_resched уже выставлен, переключение
+// выполнит interrupt_dispatch на выходе
+static void resched_irq(void) {
+    apic_eoi();
+}
+
+uint32_t smp_init(void) {
+    cpu_t* bsp = &cpus[0];
+    cpu_setup(bsp, 0, 0);
+    bsp->online = 1;
+    wrmsr(MSR_GS_BASE, (uint64_t)bsp);
+    cpu_count = 1;
+    apic_ready = 0;
+
+    if (acpi_read_madt(&madt) < 0 || apic_init(madt.apic_base) < 0) {
+        return 0;
+    }
+    apic_ready = 1;
+    bsp->apic_id = apic_id();
+    idt_register(APIC_TIMER_VECTOR, apic_timer_irq);
+    idt_register(APIC_RESCHED_VECTOR, resched_irq);
+    return madt.cpu_count;
+}
+
+// Продолжение stage2 на процессоре приложений: стек - стек его потока
+// простоя, таблицы страниц общие с загрузочным
+static void ap_main(cpu_t* cpu) {
+    wrmsr(MSR_GS_BASE, (uint64_t)cpu);
+    idt_load();
+    apic_init_ap();
+    cpu->online = 1;
+    interrupts_enable();
+    thread_idle();
+}
+
+uint32_t smp_boot_aps(void) {
+    volatile smp_trampoline_t* params = (volatile smp_trampoline_t*)SMP_TRAMPOLINE_PARAMS;
+    uint64_t cr3;
+    asm volatile("mov %%cr3, %0" : "=r"(cr3));
+    // Точка входа в 32-битном режиме загружает CR3 из 32 бит
+    if (!apic_ready || params->magic != SMP_TRAMPOLINE_MAGIC || cr3 >> 32) {
+        return cpu_count;
+    }
+
+    for (uint32_t i = 0; i < madt.cpu_count && cpu_count < SMP_MAX_CPUS; i++) {
+        if (madt.apic_ids[i] == cpus[0].apic_id) {
+            continue;
+        }
+        cpu_t* cpu = &cpus[cpu_count];
+        cpu_setup(cpu, cpu_count, madt.apic_ids[i]);
+        thread_t* idle = thread_create_idle(cpu);
+        if (!idle) {
+            break;
+        }
+        params->cr3 = (uint32_t)cr3;
+        params->stack = (uint64_t)idle->stack + THREAD_STACK_SIZE;
+        params->entry = (uint64_t)ap_main;
+        params->arg = (uint64_t)cpu;
+
+        apic_send_ipi(cpu->apic_id, APIC_ICR_INIT | APIC_ICR_ASSERT);
+        clock_delay_ns(SMP_INIT_DELAY_NS);
+        for (int sipi = 0; sipi < 2 && !cpu->online; sipi++) {
+            apic_send_ipi(cpu->apic_id, APIC_ICR_STARTUP | APIC_ICR_ASSERT | (SMP_TRAMPOLINE >> 12));
+            clock_delay_ns(SMP_SIPI_DELAY_NS);
+        }
+        uint64_t deadline = clock_now() + SMP_START_TIMEOUT_NS;
+        while (!cpu->online && clock_now() < deadline) {
+            asm volatile("pause");
+        }
+        // Процессор, не ответивший вовремя, может еще стартовать с этими
+        // параметрами, поэтому его место и стек не переиспользуются
+        if (!cpu->online) {
+            break;
+        }
+        cpu_count++;
+    }
+    return cpu_count;
+}
+
+uint32_t smp_cpu_count(void) {
+    return cpu_count;
+}
+
+cpu_t* smp_cpu(uint32_t index) {
+    return &cpus[index];
+}
+
+void smp_kick(cpu_t* cpu) {
+    apic_send_ipi(cpu->apic_id, APIC_ICR_FIXED | APIC_RESCHED_VECTOR);
+}
+
+// Счетная работа без обращений к общей памяти: xorshift
+static void bench_worker(void* arg) {
+    bench_worker_t* worker = arg;
+    uint64_t x = (uint64_t)arg | 1;
+    for (uint32_t unit = 0; unit < worker->units; unit++) {
+        for (uint32_t i = 0; i < SMP_BENCH_ITERATIONS; i++) {
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+        }
+    }
+    worker->result = x;
+
+    uint64_t flags = spin_lock_irqsave(&bench_done.lock);
+    if (--bench_running == 0) {
+        thread_wake_all(&bench_done);
+    }
+    spin_unlock_irqrestore(&bench_done.lock, flags);
+}
+
+int smp_benchmark(uint32_t threads, smp_bench_t* out) {
+    if (!threads || threads > SMP_MAX_CPUS) {
+        return -1;
+    }
+    uint64_t start = clock_now();
+    uint64_t flags = spin_lock_irqsave(&bench_done.lock);
+    bench_running = threads;
+    spin_unlock_irqrestore(&bench_done.lock, flags);
+
+    int status = 0;
+    for (uint32_t i = 0; i < threads; i++) {
+        bench_workers[i].units = SMP_BENCH_UNITS / threads + (i < SMP_BENCH_UNITS % threads);
+        bench_workers[i].result = 0;
+        if (thread_create("bench", THREAD_PRIORITY_NORMAL, bench_worker, &bench_workers[i]) < 0) {
+            // Незапущенные потоки не отметятся сами
+            flags = spin_lock_irqsave(&bench_done.lock);
+            bench_running -= threads - i;
+            spin_unlock_irqrestore(&bench_done.lock, flags);
+            status = -1;
+            break;
+        }
+    }
+
+    flags = spin_lock_irqsave(&bench_done.lock);
+    while (bench_running) {
+        thread_wait(&bench_done);
+    }
+    spin_unlock_irqrestore(&bench_done.lock, flags);
+    if (status < 0) {
+        return -1;
+    }
+
+    out->threads = threads;
+    out->ns = clock_now() - start;
+    out->units_per_sec = (uint64_t)SMP_BENCH_UNITS * 1000000000ull / (out->ns ? out->ns : 1);
+    out->checksum = 0;
+    for (uint32_t i = 0; i < threads; i++) {
+        out->checksum ^= bench_workers[i].result;
+    }
+    return 0;
+}
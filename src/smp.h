@@ -0,0 +1,86 @@
+#ifndef SMP_H
+#define SMP_H
+
+#include "stdint.h"
+#include "sync.h"
+#include "thread.h"
+
+#define SMP_MAX_CPUS 8
+
+// Точка входа процессоров приложений: страница в stage2 (вектор SIPI -
+// номер страницы) и блок параметров, который ядро заполняет перед
+// запуском каждого процессора
+#define SMP_TRAMPOLINE        0xD000
+#define SMP_TRAMPOLINE_PARAMS 0xDF00
+#define SMP_TRAMPOLINE_MAGIC  0x50414F46   // "FOAP"
+
+// Запуск: INIT, пауза, затем до двух SIPI; процессор должен отметиться
+#define SMP_INIT_DELAY_NS    10000000ull
+#define SMP_SIPI_DELAY_NS    200000ull
+#define SMP_START_TIMEOUT_NS 100000000ull
+
+// Замер масштабирования: фиксированный объем счетной работы делится
+// между потоками, потоки создаются на одном процессоре и разбираются
+// простаивающими
+#define SMP_BENCH_UNITS      256
+#define SMP_BENCH_ITERATIONS (1u << 18)
+
+// Данные процессора; адрес лежит в базе GS, первое поле указывает на
+// саму структуру, поэтому this_cpu - одно чтение %gs:0
+typedef struct cpu {
+    struct cpu* self;
+    uint32_t index;
+    uint32_t apic_id;
+    volatile int online;
+
+    // Планировщик: очереди готовых и спящие под lock. Блокировка
+    // держится через переключение и снимается уже новым потоком.
+    spinlock_t lock;
+    thread_t* current;
+    thread_t* idle;
+    thread_t* prev;              // Поток, с которого идет переключение
+    wait_queue_t ready[THREAD_PRIORITIES];
+    uint32_t ready_mask;
+    thread_t* sleepers;
+    volatile int need_resched;
+    uint64_t switch_start;
+    uint64_t run_start;
+    thread_stats_t stats;
+} cpu_t;
+
+// Параметры для stage2: стек, точка входа и ее аргумент, таблицы страниц
+typedef struct {
+    uint32_t magic;
+    uint32_t cr3;
+    uint64_t stack;
+    uint64_t entry;
+    uint64_t arg;
+} __attribute__((packed)) smp_trampoline_t;
+
+typedef struct {
+    uint32_t threads;
+    uint64_t ns;
+    uint64_t units_per_sec;
+    uint64_t checksum;
+} smp_bench_t;
+
+static inline cpu_t* this_cpu(void) {
+    cpu_t* cpu;
+    asm volatile("movq %%gs:0, %0" : "=r"(cpu));
+    return cpu;
+}
+
+// Данные загрузочного процессора, MADT и локальный APIC
+// (после clock_init). Возвращает число процессоров в MADT.
+uint32_t smp_init(void);
+// Запуск процессоров приложений (после thread_init). Без MADT или без
+// точки входа stage2 (загрузка через UEFI) работает один процессор.
+// Возвращает число работающих процессоров.
+uint32_t smp_boot_aps(void);
+uint32_t smp_cpu_count(void);
+cpu_t* smp_cpu(uint32_t index);
+// Прерывание переназначения на другом процессоре
+void smp_kick(cpu_t* cpu);
+int smp_benchmark(uint32_t threads, smp_bench_t* out);
+
+#endif
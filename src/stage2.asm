@@ -1,20 +1,81 @@
 [BITS 16]
 ORG 0x7E00
 
+; Размер области ядра, читаемой с диска (128 КБ, секторы 2048-2303)
+KERNEL_SECTORS equ 256
+; Секторов за одно обращение к BIOS (32 КБ, не пересекает границу сегмента)
+KERNEL_CHUNK equ 64
+
+; Образ тома FoxFS (initrd): сектора с FS_SUPERBLOCK_SECTOR по
+; FS_IMAGE_END_SECTOR из src/fs.h, округленные до KERNEL_CHUNK
+INITRD_LBA equ 4096
+INITRD_SECTORS equ 11712
+; Адрес образа в памяти (16 МБ, выше ядра вместе с его BSS)
+INITRD_BASE equ 0x1000000
+; Буфер ниже 1 МБ, из которого части образа копируются на место
+INITRD_BUFFER equ 0x30000
+
 start:
     mov si, stage2_loaded_msg
     call print_string
 
-    ; Загружаем ядро с диска
+    ; Загружаем ядро с диска частями по KERNEL_CHUNK секторов
+    mov cx, KERNEL_SECTORS / KERNEL_CHUNK
+.read_kernel:
+    push cx
     mov ah, 0x42          ; Extended Read
     mov dl, 0x80         ; First hard drive
     mov si, dap          ; Disk Address Packet
     int 0x13
+    pop cx
     jc disk_error
+    add word [dap + 6], KERNEL_CHUNK * 512 / 16   ; Следующий сегмент
+    add dword [dap + 8], KERNEL_CHUNK             ; Следующий LBA
+    loop .read_kernel
 
     mov si, kernel_loaded_msg
     call print_string
 
+    ; Загружаем образ тома через буфер ниже 1 МБ: BIOS читает часть
+    ; в буфер, INT 15h (AH=87h) переносит ее выше 1 МБ. Если образ
+    ; прочитать не удалось, ядро получает нулевой размер.
+    mov word [dap + 4], INITRD_BUFFER & 0xF
+    mov word [dap + 6], INITRD_BUFFER >> 4
+    mov dword [dap + 8], INITRD_LBA
+    mov cx, INITRD_SECTORS / KERNEL_CHUNK
+.read_initrd:
+    push cx
+    mov ah, 0x42
+    mov dl, 0x80
+    mov si, dap
+    int 0x13
+    jc .initrd_failed
+    mov eax, [initrd_dest]
+    mov [move_gdt + 26], ax       ; База приемника, биты 0-15
+    shr eax, 16
+    mov [move_gdt + 28], al       ; Биты 16-23
+    mov [move_gdt + 31], ah       ; Биты 24-31
+    push ds
+    pop es
+    mov si, move_gdt
+    mov cx, KERNEL_CHUNK * 512 / 2 ; Количество слов
+    mov ah, 0x87
+    int 0x15
+    jc .initrd_failed
+    pop cx
+    add dword [initrd_dest], KERNEL_CHUNK * 512
+    add dword [dap + 8], KERNEL_CHUNK
+    loop .read_initrd
+    mov dword [initrd_size], INITRD_SECTORS * 512
+    mov si, initrd_loaded_msg
+    call print_string
+    jmp .initrd_done
+.initrd_failed:
+    pop cx
+    mov si, initrd_error_msg
+    call print_string
+.initrd_done:
+
     ; Переход в защищённый режим
     cli
     lgdt [gdt_descriptor]
@@ -49,13 +110,38 @@ print_string:
 stage2_loaded_msg db "Stage 2 loaded!", 0
 kernel_loaded_msg db "Kernel loaded!", 0
 disk_error_msg db "Error loading kernel!", 0
+initrd_loaded_msg db "Initrd loaded!", 0
+initrd_error_msg db "No initrd, continuing without it", 0
+
+; Следующий адрес образа в памяти и его итоговый размер (для ядра)
+initrd_dest dd INITRD_BASE
+initrd_size dd 0
+
+; Таблица дескрипторов для INT 15h, AH=87h: пустые, источник, приемник,
+; два пустых для BIOS
+align 8
+move_gdt:
+    times 16 db 0
+    dw 0xFFFF                   ; Источник: лимит 64 КБ
+    dw INITRD_BUFFER & 0xFFFF   ; База, биты 0-15
+    db INITRD_BUFFER >> 16      ; Биты 16-23
+    db 0x93                     ; Данные, чтение/запись
+    db 0
+    db 0                        ; Биты 24-31
+    dw 0xFFFF                   ; Приемник (база заполняется при копировании)
+    dw 0
+    db 0
+    db 0x93
+    db 0
+    db 0
+    times 16 db 0
 
 ; Disk Address Packet
 align 4
 dap:
     db 0x10      ; размер DAP (16 байт)
     db 0         ; всегда 0
-    dw 32        ; количество секторов для чтения (16 КБ)
+    dw KERNEL_CHUNK ; количество секторов за одно чтение
     dw 0x0000    ; смещение
     dw 0x1000    ; сегмент (0x1000 * 16 = 0x10000)
     dq 2048      ; номер начального сектора (LBA)
@@ -120,7 +206,7 @@ protected_mode:
     ; Копируем ядро из временного адреса в финальный
     mov esi, 0x10000      ; Исходный адрес (куда мы загрузили ядро)
     mov edi, 0x100000     ; Целевой адрес (куда нужно ядро)
-    mov ecx, 8192         ; Количество двойных слов (16 КБ / 4)
+    mov ecx, KERNEL_SECTORS * 512 / 4 ; Количество двойных слов
     rep movsd             ; Копируем по 4 байта за раз
 
     ; Подготовка таблиц страниц
@@ -202,11 +288,6 @@ long_mode:
     mov byte [0xB80A6], 'M'
     mov byte [0xB80A7], 0x5F
 
-    ; Небольшая задержка для стабилизации
-    mov ecx, 0x10000000
-.delay:
-    loop .delay
-
     mov byte [0xB8140], 'J'
     mov byte [0xB8141], 0xEF
 
@@ -223,7 +304,13 @@ long_mode:
     add rdi, 2             ; Следующая позиция на экране
     loop .print_kernel_bytes
 
-    ; Переход на ядро
+    ; Переход на ядро: _start(адрес образа, размер образа)
+    mov edi, INITRD_BASE
+    mov esi, [initrd_size]
+    test esi, esi
+    jnz .jump_kernel
+    xor edi, edi
+.jump_kernel:
     mov rax, 0x100000
     jmp rax
 
@@ -233,4 +320,77 @@ not_in_long_mode:
     mov byte [0xB80AA], 'R'
     mov byte [0xB80AB], 0x4F
 
+; Точка входа процессоров приложений (SMP_TRAMPOLINE в src/smp.h).
+; SIPI запускает процессор в реальном режиме с CS = адрес >> 4 и IP = 0.
+; Дальше тот же путь, что у загрузочного: GDT stage2, защищенный режим,
+; таблицы страниц (CR3 из блока параметров), long mode. Ядро заполняет
+; блок параметров перед запуском каждого процессора. Страница лежит
+; сразу за областью, которую занимают таблицы страниц (0x9000-0xCFFF).
+AP_TRAMPOLINE equ 0xD000
+AP_PARAMS equ 0xDF00
+
+times AP_TRAMPOLINE - 0x7E00 - ($ - $$) db 0
+
+[BITS 16]
+ap_trampoline:
+    cli
+    xor ax, ax
+    mov ds, ax
+    lgdt [gdt_descriptor]
+    mov eax, cr0
+    or eax, 1
+    mov cr0, eax
+    jmp 0x08:ap_protected_mode
+
+[BITS 32]
+ap_protected_mode:
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov ss, ax
+
+    mov eax, [ap_cr3]
+    mov cr3, eax
+
+    mov eax, cr4
+    or eax, 1 << 5
+    mov cr4, eax
+
+    mov ecx, 0xC0000080
+    rdmsr
+    or eax, 1 << 8
+    wrmsr
+
+    mov eax, cr0
+    or eax, 1 << 31
+    mov cr0, eax
+
+    jmp 0x18:ap_long_mode
+
+[BITS 64]
+ap_long_mode:
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov ss, ax
+
+    ; ap_entry(ap_arg) на стеке потока простоя; возврата нет
+    mov rsp, [ap_stack]
+    mov rdi, [ap_arg]
+    mov rax, [ap_entry]
+    call rax
+.halt:
+    cli
+    hlt
+    jmp .halt
+
+times AP_PARAMS - 0x7E00 - ($ - $$) db 0
+
+; Блок параметров (smp_trampoline_t в src/smp.h)
+ap_magic dd 0x50414F46      ; "FOAP": точка входа есть
+ap_cr3   dd 0
+ap_stack dq 0
+ap_entry dq 0
+ap_arg   dq 0
+
 times 32768-($-$$) db 0
@@ -0,0 +1,53 @@
+#include "sync.h"
+
+typedef struct {
+    const char* name;
+    sync_kind_t kind;
+    const sync_stats_t* stats;
+} sync_entry_t;
+
+static sync_entry_t registry[SYNC_MAX_LOCKS];
+static uint32_t registry_count = 0;
+// Регистрация идет из потоков, не из прерываний; sync.c собирается
+// и в утилиты хоста, где запрет прерываний недоступен
+static spinlock_t registry_lock = SPINLOCK_INIT;
+
+int sync_register(const char* name, sync_kind_t kind, const sync_stats_t* stats) {
+    spin_lock(&registry_lock);
+    int status = 0;
+    uint32_t i = 0;
+    while (i < registry_count && registry[i].stats != stats) {
+        i++;
+    }
+    if (i == registry_count) {
+        if (registry_count < SYNC_MAX_LOCKS) {
+            registry[i].name = name;
+            registry[i].kind = kind;
+            registry[i].stats = stats;
+            registry_count++;
+        } else {
+            status = -1;
+        }
+    }
+    spin_unlock(&registry_lock);
+    return status;
+}
+
+// Счетчики читаются без блокировки самих замков: значения могут
+// разойтись на несколько захватов, для статистики этого достаточно
+uint32_t sync_list(sync_info_t* out, uint32_t max) {
+    spin_lock(&registry_lock);
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < registry_count && count < max; i++) {
+        const sync_stats_t* stats = registry[i].stats;
+        out[count].name = registry[i].name;
+        out[count].kind = registry[i].kind;
+        out[count].stats.acquisitions = stats->acquisitions;
+        out[count].stats.contended = stats->contended;
+        out[count].stats.spins = stats->spins;
+        out[count].stats.retries = __atomic_load_n(&stats->retries, __ATOMIC_RELAXED);
+        count++;
+    }
+    spin_unlock(&registry_lock);
+    return count;
+}
@@ -0,0 +1,226 @@
+#ifndef SYNC_H
+#define SYNC_H
+
+#include "stdint.h"
+#include "idt.h"
+
+// Счетчики блокировки. Меняются только владельцем, кроме retries:
+// повторы читателей seqlock прибавляются атомарно.
+typedef struct {
+    uint64_t acquisitions;   // Захваты
+    uint64_t contended;      // Захваты, которым пришлось ждать
+    uint64_t spins;          // Циклы ожидания (pause)
+    uint64_t retries;        // Повторы чтения seqlock
+} sync_stats_t;
+
+// Билетная блокировка с активным ожиданием для коротких участков,
+// общих для процессоров. Захват выдает номер (next), владелец - тот,
+// чей номер в owner, поэтому процессоры получают блокировку в порядке
+// очереди. Держатель не должен засыпать; если блокировку берет и
+// обработчик прерывания, остальные берут ее с запретом прерываний.
+typedef struct {
+    volatile uint32_t next;
+    volatile uint32_t owner;
+    sync_stats_t stats;
+} spinlock_t;
+
+#define SPINLOCK_INIT { 0 }
+
+static inline void spin_init(spinlock_t* lock) {
+    lock->next = 0;
+    lock->owner = 0;
+    sync_stats_t empty = {0};
+    lock->stats = empty;
+}
+
+// Ожидание идет чтением owner, без записи в линию кэша
+static inline void spin_lock(spinlock_t* lock) {
+    uint32_t ticket = __atomic_fetch_add(&lock->next, 1, __ATOMIC_RELAXED);
+    uint64_t spins = 0;
+    while (__atomic_load_n(&lock->owner, __ATOMIC_ACQUIRE) != ticket) {
+        asm volatile("pause");
+        spins++;
+    }
+    lock->stats.acquisitions++;
+    if (spins) {
+        lock->stats.contended++;
+        lock->stats.spins += spins;
+    }
+}
+
+// Номер выдается, только если очередь пуста: next == owner
+static inline int spin_trylock(spinlock_t* lock) {
+    uint32_t owner = __atomic_load_n(&lock->owner, __ATOMIC_RELAXED);
+    uint32_t expected = owner;
+    if (lock->next != owner ||
+        !__atomic_compare_exchange_n(&lock->next, &expected, owner + 1, 0,
+                                     __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return 0;
+    }
+    lock->stats.acquisitions++;
+    return 1;
+}
+
+static inline void spin_unlock(spinlock_t* lock) {
+    __atomic_store_n(&lock->owner, lock->owner + 1, __ATOMIC_RELEASE);
+}
+
+static inline uint64_t spin_lock_irqsave(spinlock_t* lock) {
+    uint64_t flags = interrupts_save();
+    spin_lock(lock);
+    return flags;
+}
+
+static inline void spin_unlock_irqrestore(spinlock_t* lock, uint64_t flags) {
+    spin_unlock(lock);
+    interrupts_restore(flags);
+}
+
+// Очередная блокировка MCS: каждый ожидающий крутится на флаге своего
+// узла, а не на общей переменной, поэтому освобождение задевает одну
+// линию кэша следующего в очереди. Узел живет (обычно в стеке) от
+// захвата до освобождения.
+typedef struct mcs_node {
+    struct mcs_node* volatile next;
+    volatile uint32_t locked;
+} mcs_node_t;
+
+typedef struct {
+    mcs_node_t* volatile tail;   // Последний в очереди, NULL - свободна
+    sync_stats_t stats;
+} mcs_lock_t;
+
+#define MCS_LOCK_INIT { NULL }
+
+static inline void mcs_lock(mcs_lock_t* lock, mcs_node_t* node) {
+    node->next = NULL;
+    node->locked = 1;
+    mcs_node_t* prev = __atomic_exchange_n(&lock->tail, node, __ATOMIC_ACQ_REL);
+    uint64_t spins = 0;
+    if (prev) {
+        __atomic_store_n(&prev->next, node, __ATOMIC_RELEASE);
+        while (__atomic_load_n(&node->locked, __ATOMIC_ACQUIRE)) {
+            asm volatile("pause");
+            spins++;
+        }
+    }
+    lock->stats.acquisitions++;
+    if (prev) {
+        lock->stats.contended++;
+        lock->stats.spins += spins;
+    }
+}
+
+// Если за узлом никого нет, очередь закрывается обменом tail; если
+// следующий уже поменял tail, но еще не связался, его нужно дождаться
+static inline void mcs_unlock(mcs_lock_t* lock, mcs_node_t* node) {
+    mcs_node_t* next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE);
+    if (!next) {
+        mcs_node_t* expected = node;
+        if (__atomic_compare_exchange_n(&lock->tail, &expected, NULL, 0,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+            return;
+        }
+        while (!(next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE))) {
+            asm volatile("pause");
+        }
+    }
+    __atomic_store_n(&next->locked, 0, __ATOMIC_RELEASE);
+}
+
+static inline uint64_t mcs_lock_irqsave(mcs_lock_t* lock, mcs_node_t* node) {
+    uint64_t flags = interrupts_save();
+    mcs_lock(lock, node);
+    return flags;
+}
+
+static inline void mcs_unlock_irqrestore(mcs_lock_t* lock, mcs_node_t* node, uint64_t flags) {
+    mcs_unlock(lock, node);
+    interrupts_restore(flags);
+}
+
+// Последовательная блокировка для данных, которые читают часто, а
+// меняют редко. Писатели исключают друг друга билетной блокировкой и
+// держат sequence нечетным, пока меняют данные. Читатели ничего не
+// пишут: запоминают sequence, читают и повторяют, если он изменился.
+// Читатель не должен доверять прочитанному до проверки (индексы -
+// только с проверкой границ, циклы - с ограничением шагов).
+typedef struct {
+    volatile uint32_t sequence;
+    spinlock_t writer;
+} seqlock_t;
+
+#define SEQLOCK_INIT { 0, SPINLOCK_INIT }
+
+static inline void seq_init(seqlock_t* lock) {
+    lock->sequence = 0;
+    spin_init(&lock->writer);
+}
+
+static inline uint32_t seq_read_begin(const seqlock_t* lock) {
+    uint32_t sequence;
+    while ((sequence = __atomic_load_n(&lock->sequence, __ATOMIC_ACQUIRE)) & 1) {
+        asm volatile("pause");
+    }
+    return sequence;
+}
+
+// Ненулевое значение - данные менялись во время чтения, нужен повтор
+static inline int seq_read_retry(seqlock_t* lock, uint32_t sequence) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&lock->sequence, __ATOMIC_RELAXED) == sequence) {
+        return 0;
+    }
+    __atomic_fetch_add(&lock->writer.stats.retries, 1, __ATOMIC_RELAXED);
+    return 1;
+}
+
+// Писатель не может читать под своей же блокировкой через
+// seq_read_begin: sequence нечетный, и чтение будет ждать вечно
+static inline void seq_write_lock(seqlock_t* lock) {
+    spin_lock(&lock->writer);
+    __atomic_store_n(&lock->sequence, lock->sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void seq_write_unlock(seqlock_t* lock) {
+    __atomic_store_n(&lock->sequence, lock->sequence + 1, __ATOMIC_RELEASE);
+    spin_unlock(&lock->writer);
+}
+
+// Реестр блокировок для просмотра счетчиков (команда locks)
+#define SYNC_MAX_LOCKS 24
+
+typedef enum {
+    SYNC_SPIN,
+    SYNC_MCS,
+    SYNC_SEQ
+} sync_kind_t;
+
+typedef struct {
+    const char* name;
+    sync_kind_t kind;
+    sync_stats_t stats;
+} sync_info_t;
+
+// Регистрация счетчиков блокировки под именем (имя не копируется).
+// Повторная регистрация тех же счетчиков ничего не меняет.
+// Возвращает -1, если реестр заполнен.
+int sync_register(const char* name, sync_kind_t kind, const sync_stats_t* stats);
+// Снимок счетчиков зарегистрированных блокировок, не больше max.
+// Возвращает число записей.
+uint32_t sync_list(sync_info_t* out, uint32_t max);
+
+static inline int spin_register(spinlock_t* lock, const char* name) {
+    return sync_register(name, SYNC_SPIN, &lock->stats);
+}
+
+static inline int mcs_register(mcs_lock_t* lock, const char* name) {
+    return sync_register(name, SYNC_MCS, &lock->stats);
+}
+
+static inline int seq_register(seqlock_t* lock, const char* name) {
+    return sync_register(name, SYNC_SEQ, &lock->writer.stats);
+}
+
+#endif
@@ -2,6 +2,12 @@
 #include "keyboard.h"
 #include "vga.h"
 #include "fs.h"
+#include "bcache.h"
+#include "block.h"
+#include "clock.h"
+#include "thread.h"
+#include "smp.h"
+#include "sync.h"
 
 // Объявления строковых функций
 void strcpy(char* dest, const char* src);
@@ -9,15 +15,27 @@ void strcat(char* dest, const char* src);
 void strncpy(char* dest, const char* src, uint32_t n);
 int strncmp(const char* s1, const char* s2, uint32_t n);
 int strcmp(const char* s1, const char* s2);
+uint32_t strlen(const char* str);
 
 static char input_buffer[TERMINAL_BUFFER_SIZE];
 static int buffer_pos = 0;
 static int prompt_length;  // Длина промпта для защиты от стирания
 static int cursor_pos = 0; // Позиция курсора в буфере
 
+// Буфер вывода ls (слишком велик для стека)
+static char list_buffer[64 * 1024];
+
 // Текущая директория (путь)
 static char current_dir[MAX_FILENAME * 2] = "/";
 
+// Команды, которые не трогают файловую систему или только разрешают
+// пути (fs_parse_path не требует блокировки). Они выполняются без
+// io_lock и не ждут, пока ее держит сброс или разбор завершений дисков.
+static const char* const unlocked_commands[] = {
+    "help", "clear", "version", "color", "pwd", "cd",
+    "uptime", "threads", "locks", "smpbench"
+};
+
 #define CHAR_UP    1  // Ctrl-A
 #define CHAR_DOWN  2  // Ctrl-B
 #define CHAR_LEFT  3  // Ctrl-C
@@ -33,6 +51,18 @@ static void clear_buffer(void) {
     cursor_pos = 0;
 }
 
+// Первое слово строки - команда из unlocked_commands
+static int command_is_unlocked(void) {
+    for (uint32_t i = 0; i < sizeof(unlocked_commands) / sizeof(unlocked_commands[0]); i++) {
+        uint32_t length = strlen(unlocked_commands[i]);
+        if (strncmp(input_buffer, unlocked_commands[i], length) == 0 &&
+            (input_buffer[length] == 0 || input_buffer[length] == ' ')) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
 // Обновление позиции курсора на экране
 static void update_cursor_position(void) {
     int x, y;
@@ -132,6 +162,17 @@ static void execute_command(void) {
         vga_printf("  touch    - Create empty file\n");
         vga_printf("  rm       - Remove file or empty directory\n");
         vga_printf("  pwd      - Print working directory\n");
+        vga_printf("  fsstat   - Show filesystem statistics\n");
+        vga_printf("  sync     - Write pending changes to disk\n");
+        vga_printf("  append   - Append text to file (append <file> <text>)\n");
+        vga_printf("  cat      - Print file contents\n");
+        vga_printf("  stat     - Show file size and compression ratio\n");
+        vga_printf("  compress - Compress written files (compress on|off)\n");
+        vga_printf("  blkbench - Compare read throughput of block devices\n");
+        vga_printf("  uptime   - Show time since boot\n");
+        vga_printf("  threads  - Show threads and context switch cost\n");
+        vga_printf("  smpbench - Measure throughput scaling across CPUs\n");
+        vga_printf("  locks    - Show lock contention counters\n");
     }
     else if (strcmp(input_buffer, "clear") == 0) {
         vga_clear();
@@ -227,6 +268,114 @@ static void execute_command(void) {
     else if (strcmp(input_buffer, "pwd") == 0) {
         vga_printf("%s\n", current_dir);
     }
+    else if (strcmp(input_buffer, "fsstat") == 0) {
+        fs_stats_t stats;
+        fs_get_stats(&stats);
+        vga_printf("Lookups: %lld (misses: %lld)\n", stats.lookups, stats.lookup_misses);
+        vga_printf("Lookup probes: %lld (full name reads: %lld)\n",
+                   stats.lookup_probes, stats.lookup_name_reads);
+        vga_printf("Free blocks: %d/%d\n", stats.blocks_free, FS_MAX_BLOCKS);
+        vga_printf("Journal: %lld ops in %lld commits, %lld sectors, %lld checkpoints\n",
+                   stats.journal_ops, stats.journal_commits,
+                   stats.journal_sectors, stats.checkpoints);
+        bcache_stats_t cache;
+        bcache_get_stats(&cache);
+        vga_printf("Cache: %lld hits, %lld misses, %lld evictions, %lld writebacks\n",
+                   cache.hits, cache.misses, cache.evictions, cache.writebacks);
+        vga_printf("Readahead: %lld sectors, %lld used, %lld wasted\n",
+                   cache.readahead, cache.readahead_hits, cache.readahead_wasted);
+        vga_printf("File readahead: %lld blocks, %lld read, %lld wasted\n",
+                   stats.readahead_blocks, stats.readahead_hits, stats.readahead_wasted);
+        for (uint32_t i = 0; i < block_device_count(); i++) {
+            block_queue_stats_t queue;
+            block_get_queue_stats(block_get(i), &queue);
+            vga_printf("Queue %s: %lld requests, %lld merged, %lld commands\n",
+                       block_get(i)->name, queue.submitted, queue.merged, queue.dispatched);
+        }
+        vga_printf("Clusters: %lld packed, %lld raw, %lld unpacked on read\n",
+                   stats.clusters_packed, stats.clusters_raw, stats.clusters_unpacked);
+        vga_printf("Dedup: %lld hits, %d shared blocks, %lld copy-on-write\n",
+                   stats.dedup_hits, stats.blocks_shared, stats.cow_copies);
+    }
+    else if (strcmp(input_buffer, "uptime") == 0) {
+        uint64_t ms = clock_now() / 1000000;
+        vga_printf("Up %lld s %d ms, TSC %lld MHz, %lld timer ticks\n",
+                   ms / 1000, (int)(ms % 1000), clock_tsc_hz() / 1000000, clock_ticks());
+    }
+    else if (strcmp(input_buffer, "threads") == 0) {
+        static const char* state_names[] = {
+            "free", "ready", "running", "blocked", "sleeping", "dead"
+        };
+        thread_info_t list[THREAD_MAX];
+        uint32_t count = thread_list(list, THREAD_MAX);
+        for (uint32_t i = 0; i < count; i++) {
+            vga_printf("%d %s: CPU %d, priority %d, %s, %lld switches, %lld ms\n",
+                       (int)list[i].id, list[i].name, (int)list[i].cpu,
+                       (int)list[i].priority, state_names[list[i].state],
+                       list[i].switches, clock_cycles_to_ns(list[i].run_cycles) / 1000000);
+        }
+        for (uint32_t cpu = 0; cpu < smp_cpu_count(); cpu++) {
+            thread_stats_t stats;
+            thread_get_stats(cpu, &stats);
+            uint64_t average = stats.switches ? stats.switch_cycles / stats.switches : 0;
+            vga_printf("CPU %d: switch %lld ns average, %lld ns best, %lld switches, %lld preempted, %lld stolen\n",
+                       (int)cpu, clock_cycles_to_ns(average), clock_cycles_to_ns(stats.switch_min),
+                       stats.switches, stats.preemptions, stats.steals);
+        }
+    }
+    else if (strcmp(input_buffer, "smpbench") == 0) {
+        // Одинаковый объем работы на 1..N потоков; потоки создаются на
+        // этом процессоре, остальные забирают их из его очереди
+        uint64_t base = 0;
+        for (uint32_t threads = 1; threads <= smp_cpu_count(); threads++) {
+            smp_bench_t bench;
+            if (smp_benchmark(threads, &bench) < 0) {
+                vga_printf("%d threads: cannot start\n", (int)threads);
+                break;
+            }
+            if (threads == 1) {
+                base = bench.units_per_sec;
+            }
+            vga_printf("%d threads: %lld ms, %lld units/s, scaling %lld%%\n",
+                       (int)threads, bench.ns / 1000000, bench.units_per_sec,
+                       base ? bench.units_per_sec * 100 / base : 0);
+        }
+    }
+    else if (strcmp(input_buffer, "locks") == 0) {
+        static const char* kind_names[] = { "ticket", "mcs", "seqlock" };
+        sync_info_t list[SYNC_MAX_LOCKS];
+        uint32_t count = sync_list(list, SYNC_MAX_LOCKS);
+        for (uint32_t i = 0; i < count; i++) {
+            vga_printf("%s (%s): %lld acquired, %lld contended, %lld spins",
+                       list[i].name, kind_names[list[i].kind], list[i].stats.acquisitions,
+                       list[i].stats.contended, list[i].stats.spins);
+            if (list[i].kind == SYNC_SEQ) {
+                vga_printf(", %lld read retries", list[i].stats.retries);
+            }
+            vga_printf("\n");
+        }
+    }
+    else if (strcmp(input_buffer, "blkbench") == 0) {
+        // Только чтение, поэтому замер безопасен и для смонтированного тома
+        for (uint32_t i = 0; i < block_device_count(); i++) {
+            block_device_t* dev = block_get(i);
+            block_bench_t bench;
+            if (block_benchmark(dev, &bench) < 0) {
+                vga_printf("%s: read error\n", dev->name);
+                continue;
+            }
+            uint64_t seq_us = clock_cycles_to_ns(bench.seq_cycles) / 1000;
+            uint64_t kb_per_s = seq_us ? bench.seq_bytes * 1000000 / 1024 / seq_us : 0;
+            uint64_t random_us = clock_cycles_to_ns(bench.random_cycles) / 1000;
+            vga_printf("%s: sequential %lld KB/s, random 4K %lld us per read\n",
+                       dev->name, kb_per_s, random_us / bench.random_reads);
+        }
+    }
+    else if (strcmp(input_buffer, "sync") == 0) {
+        if (fs_save() < 0) {
+            vga_printf("Error: No disk to sync\n");
+        }
+    }
     else if (strncmp(input_buffer, "ls", 2) == 0) {
         parse_args(input_buffer, arg1, arg2);
         if (!arg1[0] || strcmp(arg1, ".") == 0) {
@@ -236,7 +385,6 @@ static void execute_command(void) {
             build_path(arg1, full_path);
         }
         
-        char list_buffer[MAX_FILES * (MAX_FILENAME + 2)];
         int count = fs_list_dir(full_path, list_buffer, sizeof(list_buffer));
         
         if (count < 0) {
@@ -251,8 +399,8 @@ static void execute_command(void) {
             strcpy(current_dir, "/");
         } else {
             build_path(arg1, full_path);
-            file_t* dir = fs_get_file(full_path);
-            if (dir && dir->type == FILE_TYPE_DIR) {
+            int dir = fs_parse_path(full_path);
+            if (dir >= 0 && fs_file_type(dir) == FILE_TYPE_DIR) {
                 strcpy(current_dir, full_path);
             } else {
                 vga_printf("Error: Directory not found\n");
@@ -299,6 +447,78 @@ static void execute_command(void) {
             }
         }
     }
+    else if (strncmp(input_buffer, "stat", 4) == 0) {
+        parse_args(input_buffer, arg1, arg2);
+        if (!arg1[0]) {
+            vga_printf("Error: File name required\n");
+        } else {
+            build_path(arg1, full_path);
+            fs_stat_t st;
+            if (fs_stat(full_path, &st) < 0) {
+                vga_printf("Error: File not found\n");
+            } else {
+                uint32_t stored = st.blocks * FS_BLOCK_SIZE;
+                vga_printf("Size: %d bytes, on disk: %d bytes (%d blocks)\n",
+                           st.size, stored, st.blocks);
+                if (st.flags & FS_FILE_COMPRESSED) {
+                    vga_printf("Compressed, ratio: %d%%\n", stored * 100 / st.size);
+                }
+            }
+        }
+    }
+    else if (strncmp(input_buffer, "compress", 8) == 0) {
+        parse_args(input_buffer, arg1, arg2);
+        if (strcmp(arg1, "on") == 0) {
+            fs_set_compression(1);
+        } else if (strcmp(arg1, "off") == 0) {
+            fs_set_compression(0);
+        } else {
+            vga_printf("Usage: compress on|off\n");
+        }
+    }
+    else if (strncmp(input_buffer, "cat", 3) == 0) {
+        parse_args(input_buffer, arg1, arg2);
+        if (!arg1[0]) {
+            vga_printf("Error: File name required\n");
+        } else {
+            build_path(arg1, full_path);
+            fs_map_t map;
+            if (fs_map(full_path, &map) < 0) {
+                vga_printf("Error: Cannot open file\n");
+            } else {
+                // Выводим прямо из буферов кэша, без промежуточной копии
+                const uint8_t* data;
+                uint32_t len;
+                while ((data = fs_map_next(&map, &len)) != NULL) {
+                    for (uint32_t i = 0; i < len; i++) {
+                        vga_putchar(data[i]);
+                    }
+                }
+                fs_unmap(&map);
+            }
+        }
+    }
+    else if (strncmp(input_buffer, "append", 6) == 0) {
+        parse_args(input_buffer, arg1, arg2);
+        if (!arg1[0]) {
+            vga_printf("Error: File name required\n");
+        } else {
+            build_path(arg1, full_path);
+            int fd = fs_open(full_path, FS_O_WRITE | FS_O_APPEND | FS_O_CREATE);
+            if (fd < 0) {
+                vga_printf("Error: Cannot open file\n");
+            } else {
+                // Текст дописывается отдельной строкой
+                uint32_t len = 0;
+                while (arg2[len]) len++;
+                arg2[len] = '\n';
+                if (fs_fwrite(fd, (const uint8_t*)arg2, len + 1) < 0) {
+                    vga_printf("Error: Cannot write file\n");
+                }
+                fs_close(fd);
+            }
+        }
+    }
     else if (strncmp(input_buffer, "rm", 2) == 0) {
         parse_args(input_buffer, arg1, arg2);
         if (!arg1[0]) {
@@ -318,7 +538,6 @@ static void execute_command(void) {
 
 void terminal_init(void) {
     keyboard_init();
-    fs_init();  // Инициализируем файловую систему
     clear_buffer();
     prompt_length = sizeof(TERMINAL_PROMPT) - 1;  // -1 чтобы не учитывать завершающий ноль
     vga_printf(TERMINAL_PROMPT);
@@ -362,7 +581,15 @@ void terminal_run(void) {
 
         case '\n':
             vga_putchar('\n');
-            execute_command();
+            // Редактирование строки не трогает файловую систему, поэтому
+            // эхо продолжается, пока поток записи держит блокировку
+            if (command_is_unlocked()) {
+                execute_command();
+            } else {
+                mutex_lock(&io_lock);
+                execute_command();
+                mutex_unlock(&io_lock);
+            }
             clear_buffer();
             vga_printf(TERMINAL_PROMPT);
             return;
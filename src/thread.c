@@ -0,0 +1,468 @@
+#include "thread.h"
+#include "smp.h"
+#include "idt.h"
+#include "io.h"
+#include "clock.h"
+
+mutex_t io_lock = { NULL, WAIT_QUEUE_INIT };
+
+static thread_t threads[THREAD_MAX];
+// Стеки новых потоков; поток простоя загрузочного процессора остается
+// на стеке загрузки
+static uint8_t stacks[THREAD_MAX - 1][THREAD_STACK_SIZE] __attribute__((aligned(16)));
+// Таблица потоков: поиск свободного места и снимок
+static spinlock_t threads_lock = SPINLOCK_INIT;
+static uint32_t next_id = 0;
+// Имена блокировок очередей в реестре (см. sync_register)
+static const char* const runqueue_names[SMP_MAX_CPUS] = {
+    "runqueue 0", "runqueue 1", "runqueue 2", "runqueue 3",
+    "runqueue 4", "runqueue 5", "runqueue 6", "runqueue 7"
+};
+// До thread_init прерывания не переключают потоки
+static int scheduler_running = 0;
+
+void switch_context(uint64_t* save_rsp, uint64_t load_rsp);
+void thread_start(void);
+void thread_entered(void);
+
+// Контекст - регистры, которые сохраняет вызываемая функция, и адрес
+// возврата на стеке потока. Остальные регистры сохранил компилятор
+// у вызывающего, а при вытеснении - isr_common на том же стеке.
+// Новый поток начинает в thread_start: точка входа в r12, аргумент в r13.
+asm(
+    ".pushsection .text\n"
+    "switch_context:\n"
+    "    pushq %rbp\n"
+    "    pushq %rbx\n"
+    "    pushq %r12\n"
+    "    pushq %r13\n"
+    "    pushq %r14\n"
+    "    pushq %r15\n"
+    "    movq %rsp, (%rdi)\n"
+    "    movq %rsi, %rsp\n"
+    "    popq %r15\n"
+    "    popq %r14\n"
+    "    popq %r13\n"
+    "    popq %r12\n"
+    "    popq %rbx\n"
+    "    popq %rbp\n"
+    "    ret\n"
+    "thread_start:\n"
+    "    call thread_entered\n"
+    "    movq %r13, %rdi\n"
+    "    call *%r12\n"
+    "    call thread_exit\n"
+    ".popsection\n"
+);
+
+static void queue_push(wait_queue_t* queue, thread_t* thread) {
+    thread->next = NULL;
+    if (queue->tail) {
+        queue->tail->next = thread;
+    } else {
+        queue->head = thread;
+    }
+    queue->tail = thread;
+}
+
+static thread_t* queue_pop(wait_queue_t* queue) {
+    thread_t* thread = queue->head;
+    if (thread) {
+        queue->head = thread->next;
+        if (!queue->head) {
+            queue->tail = NULL;
+        }
+        thread->next = NULL;
+    }
+    return thread;
+}
+
+// Под блокировкой процессора
+static void enqueue(cpu_t* cpu, thread_t* thread) {
+    thread->state = THREAD_READY;
+    queue_push(&cpu->ready[thread->priority], thread);
+    cpu->ready_mask |= 1u << thread->priority;
+}
+
+static thread_t* dequeue(cpu_t* cpu, uint32_t priority) {
+    thread_t* thread = queue_pop(&cpu->ready[priority]);
+    if (!cpu->ready[priority].head) {
+        cpu->ready_mask &= ~(1u << priority);
+    }
+    return thread;
+}
+
+// Поток становится в очередь своего процессора. Процессор, для
+// которого он важнее текущего, переключается сразу: свой - при выходе
+// из прерывания или по thread_preempt, чужой - по прерыванию от smp_kick.
+static void make_ready(thread_t* thread) {
+    cpu_t* cpu = thread->cpu;
+    spin_lock(&cpu->lock);
+    enqueue(cpu, thread);
+    int kick = thread->priority < cpu->current->priority;
+    if (kick) {
+        cpu->need_resched = 1;
+    }
+    spin_unlock(&cpu->lock);
+    if (kick && cpu != this_cpu()) {
+        smp_kick(cpu);
+    }
+}
+
+// Кража работы: процессору без своих потоков достается самый старый
+// поток высшего приоритета из очереди другого процессора. Своя
+// блокировка уже взята, поэтому чужая берется только попыткой - два
+// простаивающих процессора не ждут друг друга. Поток в очереди
+// полностью сохранен: процессор, с которого он снят, держит свою
+// блокировку до конца переключения.
+static thread_t* steal(cpu_t* cpu) {
+    uint32_t count = smp_cpu_count();
+    for (uint32_t i = 1; i < count; i++) {
+        cpu_t* victim = smp_cpu((cpu->index + i) % count);
+        uint32_t work = victim->ready_mask & ~(1u << THREAD_PRIORITY_IDLE);
+        if (!work || !spin_trylock(&victim->lock)) {
+            continue;
+        }
+        work = victim->ready_mask & ~(1u << THREAD_PRIORITY_IDLE);
+        thread_t* thread = NULL;
+        if (work) {
+            thread = dequeue(victim, __builtin_ctz(work));
+            thread->cpu = cpu;
+        }
+        spin_unlock(&victim->lock);
+        if (thread) {
+            cpu->stats.steals++;
+            return thread;
+        }
+    }
+    return NULL;
+}
+
+// Поток простоя не спит и не ждет, поэтому готовый поток есть всегда.
+// Выбор - младший бит маски непустых очередей.
+static thread_t* pick_next(cpu_t* cpu) {
+    if (!(cpu->ready_mask & ~(1u << THREAD_PRIORITY_IDLE))) {
+        thread_t* stolen = steal(cpu);
+        if (stolen) {
+            return stolen;
+        }
+    }
+    return dequeue(cpu, __builtin_ctz(cpu->ready_mask));
+}
+
+// Завершение переключения уже на стеке нового потока. Процессор
+// читается заново: поток мог продолжить не там, где уснул.
+static void switch_done(void) {
+    cpu_t* cpu = this_cpu();
+    uint64_t now = rdtsc();
+    uint64_t cost = now - cpu->switch_start;
+    cpu->stats.switches++;
+    cpu->stats.switch_cycles += cost;
+    if (!cpu->stats.switch_min || cost < cpu->stats.switch_min) {
+        cpu->stats.switch_min = cost;
+    }
+    cpu->run_start = now;
+    // Стек завершенного потока больше не используется
+    if (cpu->prev->state == THREAD_DEAD) {
+        cpu->prev->state = THREAD_FREE;
+    }
+    spin_unlock(&cpu->lock);
+}
+
+// Вызывается с запрещенными прерываниями и взятой блокировкой
+// процессора. Текущий поток, если он еще работает, становится в конец
+// своей очереди.
+static void schedule(cpu_t* cpu) {
+    thread_t* prev = cpu->current;
+    if (prev->state == THREAD_RUNNING) {
+        enqueue(cpu, prev);
+    }
+    thread_t* next = pick_next(cpu);
+    cpu->need_resched = 0;
+    next->state = THREAD_RUNNING;
+    next->slice = 0;
+    if (next == prev) {
+        spin_unlock(&cpu->lock);
+        return;
+    }
+
+    next->switches++;
+    cpu->current = next;
+    cpu->prev = prev;
+    cpu->switch_start = rdtsc();
+    prev->run_cycles += cpu->switch_start - cpu->run_start;
+    switch_context(&prev->rsp, next->rsp);
+    switch_done();
+}
+
+void thread_entered(void) {
+    switch_done();
+    interrupts_enable();
+}
+
+void thread_tick(void) {
+    cpu_t* cpu = this_cpu();
+    uint64_t now = clock_now();
+    spin_lock(&cpu->lock);
+    while (cpu->sleepers && cpu->sleepers->wake_time <= now) {
+        thread_t* thread = cpu->sleepers;
+        cpu->sleepers = thread->next;
+        enqueue(cpu, thread);
+        if (thread->priority < cpu->current->priority) {
+            cpu->need_resched = 1;
+        }
+    }
+    if (++cpu->current->slice >= THREAD_QUANTUM_TICKS) {
+        cpu->need_resched = 1;
+    }
+    spin_unlock(&cpu->lock);
+}
+
+static void cpu_sched_init(cpu_t* cpu, thread_t* idle) {
+    spin_init(&cpu->lock);
+    spin_register(&cpu->lock, runqueue_names[cpu->index]);
+    for (uint32_t p = 0; p < THREAD_PRIORITIES; p++) {
+        cpu->ready[p].head = NULL;
+        cpu->ready[p].tail = NULL;
+    }
+    cpu->ready_mask = 0;
+    cpu->sleepers = NULL;
+    cpu->need_resched = 0;
+    thread_stats_t empty = {0};
+    cpu->stats = empty;
+
+    idle->id = next_id++;
+    idle->name = "idle";
+    idle->priority = THREAD_PRIORITY_IDLE;
+    idle->state = THREAD_RUNNING;
+    idle->next = NULL;
+    idle->slice = 0;
+    idle->switches = 1;
+    idle->run_cycles = 0;
+    idle->cpu = cpu;
+    cpu->current = idle;
+    cpu->idle = idle;
+    cpu->prev = idle;
+    cpu->run_start = rdtsc();
+}
+
+// Свободное место в таблице (под threads_lock). Место освобождается,
+// когда процессор ушел со стека завершенного потока.
+static thread_t* thread_alloc(void) {
+    for (uint32_t slot = 1; slot < THREAD_MAX; slot++) {
+        if (threads[slot].state == THREAD_FREE) {
+            threads[slot].stack = stacks[slot - 1];
+            threads[slot].state = THREAD_BLOCKED;
+            return &threads[slot];
+        }
+    }
+    return NULL;
+}
+
+void thread_init(void) {
+    for (uint32_t i = 0; i < THREAD_MAX; i++) {
+        threads[i].state = THREAD_FREE;
+    }
+    spin_init(&threads_lock);
+    spin_register(&threads_lock, "threads");
+    next_id = 0;
+
+    threads[0].stack = NULL;
+    cpu_sched_init(this_cpu(), &threads[0]);
+    irq_register(PIT_IRQ, thread_tick);
+    scheduler_running = 1;
+}
+
+thread_t* thread_create_idle(cpu_t* cpu) {
+    uint64_t flags = spin_lock_irqsave(&threads_lock);
+    thread_t* idle = thread_alloc();
+    if (idle) {
+        cpu_sched_init(cpu, idle);
+    }
+    spin_unlock_irqrestore(&threads_lock, flags);
+    return idle;
+}
+
+void thread_idle(void) {
+    this_cpu()->run_start = rdtsc();
+    while (1) {
+        thread_yield();
+        asm volatile("hlt");
+    }
+}
+
+int thread_create(const char* name, uint8_t priority, void (*entry)(void* arg), void* arg) {
+    if (priority >= THREAD_PRIORITIES) {
+        return -1;
+    }
+    uint64_t flags = spin_lock_irqsave(&threads_lock);
+    thread_t* thread = thread_alloc();
+    if (!thread) {
+        spin_unlock_irqrestore(&threads_lock, flags);
+        return -1;
+    }
+
+    thread->id = next_id++;
+    thread->name = name;
+    thread->priority = priority;
+    thread->slice = 0;
+    thread->switches = 0;
+    thread->run_cycles = 0;
+    thread->cpu = this_cpu();
+
+    // Кадр для switch_context: регистры r15..rbp и адрес возврата.
+    // После ret стек выровнен на 16, как перед вызовом функции.
+    uint64_t* sp = (uint64_t*)(thread->stack + THREAD_STACK_SIZE);
+    *--sp = (uint64_t)thread_start;
+    *--sp = 0;                       // rbp
+    *--sp = 0;                       // rbx
+    *--sp = (uint64_t)entry;         // r12
+    *--sp = (uint64_t)arg;           // r13
+    *--sp = 0;                       // r14
+    *--sp = 0;                       // r15
+    thread->rsp = (uint64_t)sp;
+    int id = thread->id;
+    spin_unlock(&threads_lock);
+
+    make_ready(thread);
+    interrupts_restore(flags);
+    return id;
+}
+
+thread_t* thread_current(void) {
+    uint64_t flags = interrupts_save();
+    thread_t* thread = this_cpu()->current;
+    interrupts_restore(flags);
+    return thread;
+}
+
+void thread_yield(void) {
+    uint64_t flags = interrupts_save();
+    cpu_t* cpu = this_cpu();
+    spin_lock(&cpu->lock);
+    schedule(cpu);
+    interrupts_restore(flags);
+}
+
+void thread_sleep(uint64_t ns) {
+    uint64_t flags = interrupts_save();
+    cpu_t* cpu = this_cpu();
+    thread_t* thread = cpu->current;
+    spin_lock(&cpu->lock);
+    thread->wake_time = clock_now() + ns;
+    thread->state = THREAD_SLEEPING;
+    thread_t** link = &cpu->sleepers;
+    while (*link && (*link)->wake_time <= thread->wake_time) {
+        link = &(*link)->next;
+    }
+    thread->next = *link;
+    *link = thread;
+    schedule(cpu);
+    interrupts_restore(flags);
+}
+
+void thread_exit(void) {
+    interrupts_disable();
+    cpu_t* cpu = this_cpu();
+    spin_lock(&cpu->lock);
+    cpu->current->state = THREAD_DEAD;
+    schedule(cpu);
+    for (;;);
+}
+
+// Блокировка процессора берется до снятия блокировки очереди: тот, кто
+// будит, ставит поток в очередь процессора только после того, как
+// переключение с него закончено
+void thread_wait(wait_queue_t* queue) {
+    cpu_t* cpu = this_cpu();
+    thread_t* thread = cpu->current;
+    thread->state = THREAD_BLOCKED;
+    queue_push(queue, thread);
+    spin_lock(&cpu->lock);
+    spin_unlock(&queue->lock);
+    schedule(cpu);
+    spin_lock(&queue->lock);
+}
+
+void thread_wake_one(wait_queue_t* queue) {
+    thread_t* thread = queue_pop(queue);
+    if (thread) {
+        make_ready(thread);
+    }
+}
+
+void thread_wake_all(wait_queue_t* queue) {
+    thread_t* thread;
+    while ((thread = queue_pop(queue)) != NULL) {
+        make_ready(thread);
+    }
+}
+
+// Из interrupt_dispatch после EOI: вытесненный поток продолжит
+// с этого места, когда снова будет выбран, и вернется из прерывания
+void thread_preempt(void) {
+    if (!scheduler_running) {
+        return;
+    }
+    uint64_t flags = interrupts_save();
+    cpu_t* cpu = this_cpu();
+    if (cpu->need_resched) {
+        cpu->stats.preemptions++;
+        spin_lock(&cpu->lock);
+        schedule(cpu);
+    }
+    interrupts_restore(flags);
+}
+
+void mutex_lock(mutex_t* mutex) {
+    uint64_t flags = spin_lock_irqsave(&mutex->waiters.lock);
+    while (mutex->owner) {
+        thread_wait(&mutex->waiters);
+    }
+    mutex->owner = this_cpu()->current;
+    spin_unlock_irqrestore(&mutex->waiters.lock, flags);
+}
+
+// Разбуженный поток сам забирает блокировку, когда получит процессор;
+// если он важнее текущего, переключение происходит сразу
+void mutex_unlock(mutex_t* mutex) {
+    uint64_t flags = spin_lock_irqsave(&mutex->waiters.lock);
+    mutex->owner = NULL;
+    thread_wake_one(&mutex->waiters);
+    spin_unlock_irqrestore(&mutex->waiters.lock, flags);
+    thread_preempt();
+}
+
+uint32_t thread_list(thread_info_t* out, uint32_t max) {
+    uint64_t flags = spin_lock_irqsave(&threads_lock);
+    // Время текущего потока учитывается до момента снимка
+    cpu_t* self = this_cpu();
+    uint64_t now = rdtsc();
+    self->current->run_cycles += now - self->run_start;
+    self->run_start = now;
+
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < THREAD_MAX && count < max; i++) {
+        thread_t* thread = &threads[i];
+        if (thread->state == THREAD_FREE || thread->state == THREAD_DEAD) {
+            continue;
+        }
+        out[count].id = thread->id;
+        out[count].name = thread->name;
+        out[count].priority = thread->priority;
+        out[count].state = thread->state;
+        out[count].cpu = thread->cpu->index;
+        out[count].switches = thread->switches;
+        out[count].run_cycles = thread->run_cycles;
+        count++;
+    }
+    spin_unlock_irqrestore(&threads_lock, flags);
+    return count;
+}
+
+void thread_get_stats(uint32_t index, thread_stats_t* out) {
+    cpu_t* cpu = smp_cpu(index);
+    uint64_t flags = spin_lock_irqsave(&cpu->lock);
+    *out = cpu->stats;
+    spin_unlock_irqrestore(&cpu->lock, flags);
+}
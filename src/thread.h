@@ -0,0 +1,123 @@
+#ifndef THREAD_H
+#define THREAD_H
+
+#include "stdint.h"
+#include "sync.h"
+
+// Потоков, включая потоки простоя (по одному на процессор; на
+// загрузочном это поток загрузки)
+#define THREAD_MAX 32
+#define THREAD_STACK_SIZE 32768
+// Приоритеты: 0 - высший. Очередь простоя всегда последняя.
+#define THREAD_PRIORITY_HIGH   0
+#define THREAD_PRIORITY_NORMAL 1
+#define THREAD_PRIORITY_LOW    2
+#define THREAD_PRIORITY_IDLE   3
+#define THREAD_PRIORITIES      4
+// Квант в тиках таймера: по его истечении поток уступает процессор
+// потокам того же приоритета
+#define THREAD_QUANTUM_TICKS 10
+
+typedef enum {
+    THREAD_FREE = 0,
+    THREAD_READY,
+    THREAD_RUNNING,
+    THREAD_BLOCKED,
+    THREAD_SLEEPING,
+    THREAD_DEAD
+} thread_state_t;
+
+typedef struct thread {
+    uint64_t rsp;                // Сохраненный стек (контекст в switch_context)
+    uint32_t id;
+    const char* name;
+    uint8_t priority;
+    thread_state_t state;
+    struct thread* next;         // Очередь готовых, ожидания или сна
+    uint64_t wake_time;          // Срок сна по clock_now
+    uint32_t slice;              // Тиков израсходовано из кванта
+    uint64_t switches;           // Сколько раз получал процессор
+    uint64_t run_cycles;         // Время на процессоре в тактах TSC
+    uint8_t* stack;
+    struct cpu* cpu;             // Процессор, в очередь которого ставится поток
+} thread_t;
+
+// Очередь ожидающих потоков (FIFO). Блокировка защищает очередь и
+// условие, которого ждут потоки.
+typedef struct {
+    spinlock_t lock;
+    thread_t* head;
+    thread_t* tail;
+} wait_queue_t;
+
+#define WAIT_QUEUE_INIT { SPINLOCK_INIT, NULL, NULL }
+
+// Блокировка со сном: ожидающий поток не занимает процессор
+typedef struct {
+    thread_t* owner;
+    wait_queue_t waiters;
+} mutex_t;
+
+// Снимок состояния потока для вывода
+typedef struct {
+    uint32_t id;
+    const char* name;
+    uint8_t priority;
+    thread_state_t state;
+    uint32_t cpu;
+    uint64_t switches;
+    uint64_t run_cycles;
+} thread_info_t;
+
+typedef struct {
+    uint64_t switches;           // Переключений контекста
+    uint64_t switch_cycles;      // Суммарная цена переключений в тактах
+    uint64_t switch_min;         // Самое быстрое переключение в тактах
+    uint64_t preemptions;        // Из них по таймеру или пробуждению из прерывания
+    uint64_t steals;             // Потоков забрано из очередей других процессоров
+} thread_stats_t;
+
+// Файловая система, кэш буферов и очереди блочных устройств не знают
+// о потоках (они же собираются в утилиты), поэтому их защищает одна
+// общая блокировка: терминал на время команды, поток записи и поток
+// завершений дисков (io, просыпается по прерыванию диска)
+extern mutex_t io_lock;
+
+// Текущий поток загрузки становится потоком простоя загрузочного
+// процессора; тик планировщика подключается к IRQ 0 (после smp_init)
+void thread_init(void);
+// Планировщик процессора приложений и его поток простоя; стек потока
+// простоя - начальный стек процессора
+thread_t* thread_create_idle(struct cpu* cpu);
+// Цикл простоя: поиск работы (в том числе чужой) и hlt до прерывания
+void thread_idle(void) __attribute__((noreturn));
+// Новый поток ставится в очередь текущего процессора. Возвращает -1,
+// если мест нет.
+int thread_create(const char* name, uint8_t priority, void (*entry)(void* arg), void* arg);
+thread_t* thread_current(void);
+void thread_yield(void);
+void thread_sleep(uint64_t ns);
+void thread_exit(void) __attribute__((noreturn));
+
+// Ожидание и пробуждение вызываются под блокировкой очереди (взятой
+// с запретом прерываний): так проверка условия и постановка в очередь
+// не разделяются пробуждением. thread_wait снимает блокировку на время
+// сна и снова берет ее. Пробуждение допустимо из обработчика прерывания.
+void thread_wait(wait_queue_t* queue);
+void thread_wake_one(wait_queue_t* queue);
+void thread_wake_all(wait_queue_t* queue);
+
+// Тик планировщика текущего процессора: пробуждение спящих и квант
+void thread_tick(void);
+// Вызывается при выходе из прерывания: переключение, если разбуженный
+// поток важнее текущего или квант истек
+void thread_preempt(void);
+
+void mutex_lock(mutex_t* mutex);
+void mutex_unlock(mutex_t* mutex);
+
+// Снимок существующих потоков; возвращает их количество
+uint32_t thread_list(thread_info_t* out, uint32_t max);
+void thread_get_stats(uint32_t cpu, thread_stats_t* stats);
+
+#endif
@@ -144,6 +144,38 @@ EFI_STATUS __attribute__((ms_abi)) UefiMain(
     if(status) { Print(SystemTable, "Error: Read kernel\r\n"); return status; }
     Print(SystemTable, "Kernel loaded\r\n");
 
+    // 9. Загружаем образ тома FoxFS (initrd), если он есть рядом с ядром.
+    // Ядро монтирует его прямо в памяти.
+    EFI_PHYSICAL_ADDRESS initrd_addr = 0;
+    uint64_t initrd_size = 0;
+    EFI_FILE_PROTOCOL* InitrdFile;
+    uint16_t initrd_path[] = u"EFI\\FOXOS\\foxfs.img";
+    status = Root->Open(Root, (void**)&InitrdFile, initrd_path, 0x01, 0);
+    if(status == 0) {
+        info_size = 0;
+        status = InitrdFile->GetInfo(InitrdFile, &file_info_guid, &info_size, 0);
+        if(status == 0x8000000000000005) {
+            status = BS->AllocatePages(0, 2, EFI_SIZE_TO_PAGES(info_size), &mem_addr); // AllocateAnyPages, EfiLoaderData
+        }
+        if(status == 0) {
+            status = InitrdFile->GetInfo(InitrdFile, &file_info_guid, &info_size, (void*)mem_addr);
+        }
+        if(status == 0) {
+            initrd_size = *(uint64_t*)((void*)mem_addr + 8);  // EFI_FILE_INFO.FileSize
+            status = BS->AllocatePages(0, 2, EFI_SIZE_TO_PAGES(initrd_size), &initrd_addr);
+        }
+        if(status == 0) {
+            status = InitrdFile->Read(InitrdFile, &initrd_size, (void*)initrd_addr);
+        }
+        if(status) {
+            Print(SystemTable, "Warning: initrd not loaded\r\n");
+            initrd_addr = 0;
+            initrd_size = 0;
+        } else {
+            Print(SystemTable, "Initrd loaded\r\n");
+        }
+    }
+
     // Изменить вызов ExitBootServices
     uint64_t MapKey = 0;
     // Перед переходом на ядро
@@ -155,9 +187,9 @@ EFI_STATUS __attribute__((ms_abi)) UefiMain(
     }
 
     // 10. Переход на ядро
-    void (*KernelEntry)(void) = (void(*)(void))kernel_buffer;
+    void (*KernelEntry)(uint64_t, uint64_t) = (void(*)(uint64_t, uint64_t))kernel_buffer;
     Print(SystemTable, "Jumping to kernel...\r\n");
-    KernelEntry();
+    KernelEntry(initrd_addr, initrd_size);
 
     // После загрузки ядра
     if(*(uint64_t*)kernel_buffer != 0x0000FFFFB8C30000) { // Сигнатура исполняемого кода
@@ -1,11 +1,27 @@
 #include "vga.h"
 #include "io.h"
+#include "sync.h"
 
 static uint16_t* const vga_buffer = (uint16_t*)VGA_MEMORY;
 static int cursor_x = 0;
 static int cursor_y = 0;
 static uint8_t vga_color = 0;
 
+// Экран, курсор и цвет общие для всех потоков и процессоров. Каждая
+// функция vga_* держит блокировку целиком (строка vga_printf выводится
+// без вклинивания чужого вывода), внутри работают функции console_*
+// без блокировки. Прерывания на время вывода запрещены, чтобы
+// обработчик на том же процессоре не ждал прерванного владельца.
+static mcs_lock_t console_lock = MCS_LOCK_INIT;
+
+static inline uint64_t console_lock_irqsave(mcs_node_t* node) {
+    return mcs_lock_irqsave(&console_lock, node);
+}
+
+static inline void console_unlock_irqrestore(mcs_node_t* node, uint64_t flags) {
+    mcs_unlock_irqrestore(&console_lock, node, flags);
+}
+
 // Создает цветовой атрибут из цветов переднего и заднего плана
 static inline uint8_t vga_entry_color(enum vga_color fg, enum vga_color bg) {
     return fg | bg << 4;
@@ -30,12 +46,21 @@ static void vga_scroll(void) {
     }
 }
 
-void vga_init(void) {
-    vga_color = vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK);
-    vga_clear();
+// Перенос аппаратного курсора
+static void move_cursor(int x, int y) {
+    uint16_t pos = y * VGA_WIDTH + x;
+    
+    // Управляющие порты курсора VGA
+    outb(0x3D4, 0x0F);
+    outb(0x3D5, (uint8_t)(pos & 0xFF));
+    outb(0x3D4, 0x0E);
+    outb(0x3D5, (uint8_t)((pos >> 8) & 0xFF));
+    
+    cursor_x = x;
+    cursor_y = y;
 }
 
-void vga_clear(void) {
+static void console_clear(void) {
     for (int y = 0; y < VGA_HEIGHT; y++) {
         for (int x = 0; x < VGA_WIDTH; x++) {
             vga_buffer[y * VGA_WIDTH + x] = vga_entry(' ', vga_color);
@@ -43,10 +68,10 @@ void vga_clear(void) {
     }
     cursor_x = 0;
     cursor_y = 0;
-    vga_set_cursor(0, 0);
+    move_cursor(0, 0);
 }
 
-void vga_putchar(char c) {
+static void console_putchar(char c) {
     if (c == '\n') {
         cursor_x = 0;
         cursor_y++;
@@ -60,14 +85,14 @@ void vga_putchar(char c) {
             // Очищаем символ в текущей позиции
             vga_buffer[cursor_y * VGA_WIDTH + cursor_x] = vga_entry(' ', vga_color);
             // Сразу обновляем позицию курсора
-            vga_set_cursor(cursor_x, cursor_y);
+            move_cursor(cursor_x, cursor_y);
             return;  // Выходим, чтобы избежать повторного обновления курсора
         } else if (cursor_y > 0) {
             // Если мы в начале строки и есть предыдущая строка
             cursor_y--;
             cursor_x = VGA_WIDTH - 1;
             vga_buffer[cursor_y * VGA_WIDTH + cursor_x] = vga_entry(' ', vga_color);
-            vga_set_cursor(cursor_x, cursor_y);
+            move_cursor(cursor_x, cursor_y);
             return;
         }
     } else {
@@ -85,37 +110,20 @@ void vga_putchar(char c) {
         cursor_y = VGA_HEIGHT - 1;
     }
 
-    vga_set_cursor(cursor_x, cursor_y);
+    move_cursor(cursor_x, cursor_y);
 }
 
-void vga_write(const char* str) {
+static void console_write(const char* str) {
     while (*str) {
-        vga_putchar(*str++);
+        console_putchar(*str++);
     }
 }
 
-void vga_set_color(uint8_t foreground, uint8_t background) {
-    vga_color = vga_entry_color(foreground, background);
-}
-
-void vga_set_cursor(int x, int y) {
-    uint16_t pos = y * VGA_WIDTH + x;
-    
-    // Управляющие порты курсора VGA
-    outb(0x3D4, 0x0F);
-    outb(0x3D5, (uint8_t)(pos & 0xFF));
-    outb(0x3D4, 0x0E);
-    outb(0x3D5, (uint8_t)((pos >> 8) & 0xFF));
-    
-    cursor_x = x;
-    cursor_y = y;
-}
-
 // Вспомогательная функция для вывода числа в десятичном формате
-void vga_put_dec(int64_t num) {
+static void console_put_dec(int64_t num) {
     // Специальная обработка для минимального значения int64_t
     if (num == INT64_MIN) {
-        vga_write("-9223372036854775808");
+        console_write("-9223372036854775808");
         return;
     }
 
@@ -142,17 +150,17 @@ void vga_put_dec(int64_t num) {
 
     // Добавляем знак минус для отрицательных чисел
     if (is_negative) {
-        vga_putchar('-');
+        console_putchar('-');
     }
 
     // Выводим строку в правильном порядке
     while (i > 0) {
-        vga_putchar(buf[--i]);
+        console_putchar(buf[--i]);
     }
 }
 
 // Вспомогательная функция для вывода числа в шестнадцатеричном формате
-void vga_put_hex(uint64_t num) {
+static void console_put_hex(uint64_t num) {
     char buf[32];
     int i = 0;
     const char hex_digits[] = "0123456789ABCDEF";
@@ -164,16 +172,16 @@ void vga_put_hex(uint64_t num) {
     } while (num > 0);
 
     // Выводим 0x префикс
-    vga_write("0x");
+    console_write("0x");
 
     // Выводим строку в правильном порядке
     while (i > 0) {
-        vga_putchar(buf[--i]);
+        console_putchar(buf[--i]);
     }
 }
 
 // Вспомогательная функция для вывода числа в двоичном формате
-void vga_put_bin(uint64_t num) {
+static void console_put_bin(uint64_t num) {
     char buf[65];
     int i = 0;
 
@@ -184,18 +192,82 @@ void vga_put_bin(uint64_t num) {
     } while (num > 0);
 
     // Выводим 0b префикс
-    vga_write("0b");
+    console_write("0b");
 
     // Выводим строку в правильном порядке
     while (i > 0) {
-        vga_putchar(buf[--i]);
+        console_putchar(buf[--i]);
     }
 }
 
+void vga_init(void) {
+    mcs_register(&console_lock, "console");
+    vga_color = vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK);
+    vga_clear();
+}
+
+void vga_clear(void) {
+    mcs_node_t node;
+    uint64_t flags = console_lock_irqsave(&node);
+    console_clear();
+    console_unlock_irqrestore(&node, flags);
+}
+
+void vga_putchar(char c) {
+    mcs_node_t node;
+    uint64_t flags = console_lock_irqsave(&node);
+    console_putchar(c);
+    console_unlock_irqrestore(&node, flags);
+}
+
+void vga_write(const char* str) {
+    mcs_node_t node;
+    uint64_t flags = console_lock_irqsave(&node);
+    console_write(str);
+    console_unlock_irqrestore(&node, flags);
+}
+
+void vga_set_color(uint8_t foreground, uint8_t background) {
+    mcs_node_t node;
+    uint64_t flags = console_lock_irqsave(&node);
+    vga_color = vga_entry_color(foreground, background);
+    console_unlock_irqrestore(&node, flags);
+}
+
+void vga_set_cursor(int x, int y) {
+    mcs_node_t node;
+    uint64_t flags = console_lock_irqsave(&node);
+    move_cursor(x, y);
+    console_unlock_irqrestore(&node, flags);
+}
+
+void vga_put_dec(int64_t num) {
+    mcs_node_t node;
+    uint64_t flags = console_lock_irqsave(&node);
+    console_put_dec(num);
+    console_unlock_irqrestore(&node, flags);
+}
+
+void vga_put_hex(uint64_t num) {
+    mcs_node_t node;
+    uint64_t flags = console_lock_irqsave(&node);
+    console_put_hex(num);
+    console_unlock_irqrestore(&node, flags);
+}
+
+void vga_put_bin(uint64_t num) {
+    mcs_node_t node;
+    uint64_t flags = console_lock_irqsave(&node);
+    console_put_bin(num);
+    console_unlock_irqrestore(&node, flags);
+}
+
 // Форматированный вывод
 void vga_printf(const char* format, ...) {
     __builtin_va_list args;
     __builtin_va_start(args, format);
+    mcs_node_t node;
+    uint64_t flags = console_lock_irqsave(&node);
 
     while (*format) {
         if (*format == '%') {
@@ -204,57 +276,62 @@ void vga_printf(const char* format, ...) {
             if (*format == 'l' && *(format + 1) == 'l') {
                 format += 2;
                 if (*format == 'd') {
-                    vga_put_dec(__builtin_va_arg(args, int64_t));
+                    console_put_dec(__builtin_va_arg(args, int64_t));
                 }
             } else {
                 switch (*format) {
                     case 'd': // Десятичное число
-                        vga_put_dec(__builtin_va_arg(args, int));
+                        console_put_dec(__builtin_va_arg(args, int));
                         break;
                     case 'x': // Шестнадцатеричное число
-                        vga_put_hex(__builtin_va_arg(args, uint64_t));
+                        console_put_hex(__builtin_va_arg(args, uint64_t));
                         break;
                     case 'b': // Двоичное число
-                        vga_put_bin(__builtin_va_arg(args, uint64_t));
+                        console_put_bin(__builtin_va_arg(args, uint64_t));
                         break;
                     case 's': // Строка
-                        vga_write(__builtin_va_arg(args, const char*));
+                        console_write(__builtin_va_arg(args, const char*));
                         break;
                     case 'c': // Символ
-                        vga_putchar(__builtin_va_arg(args, int));
+                        console_putchar(__builtin_va_arg(args, int));
                         break;
                     case '%': // Символ %
-                        vga_putchar('%');
+                        console_putchar('%');
                         break;
                     default:
-                        vga_putchar('%');
-                        vga_putchar(*format);
+                        console_putchar('%');
+                        console_putchar(*format);
                 }
             }
         } else {
-            vga_putchar(*format);
+            console_putchar(*format);
         }
         format++;
     }
 
+    console_unlock_irqrestore(&node, flags);
     __builtin_va_end(args);
 }
 
 // Получение текущей позиции курсора
 void vga_get_cursor(int* x, int* y) {
+    mcs_node_t node;
+    uint64_t flags = console_lock_irqsave(&node);
     *x = cursor_x;
     *y = cursor_y;
+    console_unlock_irqrestore(&node, flags);
 }
 
 // Запись символа в конкретную позицию
 void vga_put_entry(int x, int y, char c) {
     if (x >= 0 && x < VGA_WIDTH && y >= 0 && y < VGA_HEIGHT) {
+        mcs_node_t node;
+        uint64_t flags = console_lock_irqsave(&node);
         vga_buffer[y * VGA_WIDTH + x] = vga_entry(c, vga_color);
+        console_unlock_irqrestore(&node, flags);
     }
 }
 
 void vga_puts(const char* str) {
-    while (*str) {
-        vga_putchar(*str++);
-    }
+    vga_write(str);
 }
\ No newline at end of file
@@ -0,0 +1,370 @@
+#include "virtio_blk.h"
+#include "pci.h"
+#include "mmio.h"
+#include "idt.h"
+#include "pic.h"
+
+// Предел опроса (итераций) до признания устройства зависшим
+#define VIRTIO_TIMEOUT 100000000
+
+// Устройство с одной очередью запросов (split virtqueue)
+typedef struct {
+    virtio_pci_common_t* common;
+    volatile uint16_t* notify;       // Регистр уведомления очереди
+    volatile uint8_t* isr;           // Чтение сбрасывает прерывание
+    volatile uint32_t* capacity;     // Размер в секторах (конфигурация устройства)
+    uint16_t size;                   // Размер очереди
+    uint8_t event_idx;               // Согласован VIRTIO_RING_F_EVENT_IDX
+    uint8_t broken;                  // Устройство не ответило, обмен невозможен
+    virtq_desc_t* desc;
+    virtq_avail_t* avail;
+    virtq_used_t* used;
+    volatile uint16_t* used_event;
+    volatile uint16_t* avail_event;
+    uint16_t free_head;              // Свободные дескрипторы, связанные через next
+    uint16_t free_count;
+    uint16_t avail_idx;              // Индекс с еще не опубликованными запросами
+    uint16_t last_used;              // Следующий разбираемый элемент used
+    uint32_t pending;                // Запросов у устройства
+    uint32_t failed;                 // Служебных запросов, завершенных с ошибкой
+    uint32_t stall;                  // Опросов подряд без завершений
+    virtio_blk_req_t* headers;       // Заголовок, байт состояния и цепочка
+    uint8_t* status;                 // очереди - по номеру первого
+    block_request_t** requests;      // дескриптора запроса
+} virtio_blk_t;
+
+static virtio_blk_t devices[VIRTIO_BLK_MAX_DEVICES];
+static uint32_t device_count = 0;
+static block_device_t virtio_devs[VIRTIO_BLK_MAX_DEVICES];
+static const char* virtio_names[VIRTIO_BLK_MAX_DEVICES] = { "vda", "vdb" };
+
+// Очереди в памяти, которую читает устройство. Ядро отображено
+// один к одному, поэтому адрес в дескрипторах - это адрес переменной.
+static virtq_desc_t queue_desc[VIRTIO_BLK_MAX_DEVICES][VIRTIO_QUEUE_SIZE] __attribute__((aligned(16)));
+static virtq_avail_t queue_avail[VIRTIO_BLK_MAX_DEVICES] __attribute__((aligned(2)));
+static virtq_used_t queue_used[VIRTIO_BLK_MAX_DEVICES] __attribute__((aligned(4)));
+static virtio_blk_req_t req_headers[VIRTIO_BLK_MAX_DEVICES][VIRTIO_QUEUE_SIZE];
+static uint8_t req_status[VIRTIO_BLK_MAX_DEVICES][VIRTIO_QUEUE_SIZE];
+static block_request_t* req_chains[VIRTIO_BLK_MAX_DEVICES][VIRTIO_QUEUE_SIZE];
+
+// Нужно ли уведомление: индекс перешел через event при переходе от old к next
+static int need_event(uint16_t event, uint16_t next, uint16_t old) {
+    return (uint16_t)(next - event - 1) < (uint16_t)(next - old);
+}
+
+// Постановка запроса в кольцо доступных без публикации: цепочка
+// "заголовок - буферы запросов chain - состояние". Возвращает первый
+// дескриптор или -1, если дескрипторов не хватает.
+static int vq_add(virtio_blk_t* vb, uint32_t type, uint64_t sector, block_request_t* chain) {
+    uint32_t need = 2 + (chain ? chain->parts : 0);
+    if (vb->free_count < need) {
+        return -1;
+    }
+    uint16_t head = vb->free_head;
+    uint16_t d = head;
+    vb->headers[head].type = type;
+    vb->headers[head].reserved = 0;
+    vb->headers[head].sector = sector;
+    vb->status[head] = 0xFF;
+    vb->requests[head] = chain;
+
+    vb->desc[d].addr = (uint64_t)&vb->headers[head];
+    vb->desc[d].len = sizeof(virtio_blk_req_t);
+    vb->desc[d].flags = VIRTQ_DESC_F_NEXT;
+    d = vb->desc[d].next;
+    for (block_request_t* part = chain; part; part = part->merged) {
+        vb->desc[d].addr = (uint64_t)part->buffer;
+        vb->desc[d].len = part->count * BLOCK_SECTOR_SIZE;
+        vb->desc[d].flags = VIRTQ_DESC_F_NEXT | (type == VIRTIO_BLK_T_IN ? VIRTQ_DESC_F_WRITE : 0);
+        d = vb->desc[d].next;
+    }
+    vb->desc[d].addr = (uint64_t)&vb->status[head];
+    vb->desc[d].len = 1;
+    vb->desc[d].flags = VIRTQ_DESC_F_WRITE;
+    vb->free_head = vb->desc[d].next;
+    vb->free_count -= need;
+
+    vb->avail->ring[vb->avail_idx % vb->size] = head;
+    vb->avail_idx++;
+    vb->pending++;
+    return head;
+}
+
+// Публикация накопленных запросов и одно уведомление на всю пачку.
+// С event idx устройство само сообщает, нужно ли уведомление, и получает
+// просьбу прервать процессор только после последнего запроса пачки.
+static void vq_kick(virtio_blk_t* vb) {
+    uint16_t old = vb->avail->idx;
+    if (old == vb->avail_idx) {
+        return;
+    }
+    if (vb->event_idx) {
+        *vb->used_event = vb->last_used + vb->pending - 1;
+    }
+    asm volatile("" : : : "memory");  // Кольцо заполнено до публикации индекса
+    vb->avail->idx = vb->avail_idx;
+    // Индекс опубликован до чтения avail_event/flags устройства
+    asm volatile("mfence" : : : "memory");
+    int notify = vb->event_idx ? need_event(*vb->avail_event, vb->avail_idx, old)
+                               : !(vb->used->flags & VIRTQ_USED_F_NO_NOTIFY);
+    if (notify) {
+        *vb->notify = 0;
+    }
+}
+
+// Разбор выполненных запросов: дескрипторы возвращаются в свободный
+// список, цепочки очереди завершаются
+static void vq_reap(virtio_blk_t* vb) {
+    while (vb->last_used != vb->used->idx) {
+        asm volatile("" : : : "memory");  // Элемент читается после индекса
+        uint16_t head = vb->used->ring[vb->last_used % vb->size].id;
+        int status = vb->status[head] == 0 ? 0 : -1;
+        block_request_t* chain = vb->requests[head];
+        vb->requests[head] = NULL;
+        uint16_t d = head;
+        uint16_t freed = 1;
+        while (vb->desc[d].flags & VIRTQ_DESC_F_NEXT) {
+            d = vb->desc[d].next;
+            freed++;
+        }
+        vb->desc[d].next = vb->free_head;
+        vb->free_head = head;
+        vb->free_count += freed;
+        vb->last_used++;
+        vb->pending--;
+        if (chain) {
+            block_complete(chain, status);
+        } else if (status < 0) {
+            vb->failed++;
+        }
+    }
+    if (vb->event_idx) {
+        *vb->used_event = vb->last_used + vb->pending - 1;
+    }
+}
+
+// Устройство не отвечает: все его запросы завершаются с ошибкой,
+// дескрипторы остаются у устройства, и обмен больше не начинается
+static void vq_fail(virtio_blk_t* vb) {
+    vb->broken = 1;
+    for (uint32_t i = 0; i < vb->size; i++) {
+        block_request_t* chain = vb->requests[i];
+        if (chain) {
+            vb->requests[i] = NULL;
+            block_complete(chain, -1);
+        }
+    }
+}
+
+// Чтение ISR снимает запрос прерывания и будит ожидающие потоки.
+// Выполненные запросы разбирает virtio_poll из block_poll, вне обработчика.
+void virtio_blk_irq(void) {
+    int events = 0;
+    for (uint32_t i = 0; i < device_count; i++) {
+        if (*devices[i].isr) {
+            events = 1;
+        }
+    }
+    if (events) {
+        block_irq();
+    }
+}
+
+// Выдача цепочки очереди одним запросом virtio-blk. Запрос только
+// ставится в кольцо, публикует пачку virtio_poll.
+static int virtio_start(block_device_t* dev, block_request_t* req) {
+    virtio_blk_t* vb = (virtio_blk_t*)dev->driver_data;
+    if (vb->broken) {
+        block_complete(req, -1);
+        return 0;
+    }
+    return vq_add(vb, req->write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN, req->lba, req) < 0 ? -1 : 0;
+}
+
+static void virtio_poll(block_device_t* dev) {
+    virtio_blk_t* vb = (virtio_blk_t*)dev->driver_data;
+    if (vb->broken) {
+        return;
+    }
+    vq_kick(vb);
+    uint16_t before = vb->last_used;
+    vq_reap(vb);
+    if (vb->pending && vb->last_used == before) {
+        if (++vb->stall >= VIRTIO_TIMEOUT) {
+            vq_fail(vb);
+        }
+    } else {
+        vb->stall = 0;
+    }
+}
+
+// Сброс кэша записи. Вызывается, когда у устройства нет запросов
+// очереди, поэтому ожидается только сам запрос сброса.
+static int virtio_flush(block_device_t* dev) {
+    virtio_blk_t* vb = (virtio_blk_t*)dev->driver_data;
+    if (vb->broken) {
+        return -1;
+    }
+    vb->failed = 0;
+    if (vq_add(vb, VIRTIO_BLK_T_FLUSH, 0, NULL) < 0) {
+        return -1;
+    }
+    vq_kick(vb);
+    for (uint32_t i = 0; vb->pending; i++) {
+        if (i == VIRTIO_TIMEOUT) {
+            vq_fail(vb);
+            return -1;
+        }
+        vq_reap(vb);
+    }
+    return vb->failed ? -1 : 0;
+}
+
+// Адрес структуры, описанной capability virtio
+static volatile void* cap_address(const pci_device_t* pci, uint8_t cap) {
+    uint8_t bar = pci_read8(pci, cap + 4);
+    uint32_t offset = pci_read32(pci, cap + 8);
+    uint32_t length = pci_read32(pci, cap + 12);
+    int is_io;
+    uint64_t base = bar < 6 ? pci_bar_address(pci, bar, &is_io) : 0;
+    if (!base || is_io) {
+        return NULL;
+    }
+    return mmio_map(base + offset, length ? length : 1);
+}
+
+// Согласование возможностей и запуск очереди 0.
+// Возвращает размер устройства в секторах или 0.
+static uint64_t device_setup(virtio_blk_t* vb, const pci_device_t* pci, uint32_t n, int* has_flush) {
+    volatile uint8_t* notify_base = NULL;
+    uint32_t notify_multiplier = 0;
+    vb->common = NULL;
+    vb->isr = NULL;
+    vb->capacity = NULL;
+    for (uint8_t cap = 0; (cap = pci_next_capability(pci, cap, VIRTIO_PCI_CAP_ID));) {
+        uint8_t type = pci_read8(pci, cap + 3);
+        volatile void* address = cap_address(pci, cap);
+        if (type == VIRTIO_PCI_CAP_COMMON && !vb->common) {
+            vb->common = (virtio_pci_common_t*)address;
+        } else if (type == VIRTIO_PCI_CAP_NOTIFY && !notify_base) {
+            notify_base = (volatile uint8_t*)address;
+            notify_multiplier = pci_read32(pci, cap + 16);
+        } else if (type == VIRTIO_PCI_CAP_ISR && !vb->isr) {
+            vb->isr = (volatile uint8_t*)address;
+        } else if (type == VIRTIO_PCI_CAP_DEVICE && !vb->capacity) {
+            vb->capacity = (volatile uint32_t*)address;
+        }
+    }
+    // Без этих структур устройство работает только в старом режиме
+    if (!vb->common || !notify_base || !vb->isr || !vb->capacity) {
+        return 0;
+    }
+    virtio_pci_common_t* common = vb->common;
+
+    // Сброс: устройство готово, когда состояние читается нулем
+    common->device_status = 0;
+    for (uint32_t i = 0; common->device_status != 0; i++) {
+        if (i == VIRTIO_TIMEOUT) {
+            return 0;
+        }
+    }
+    common->device_status = VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER;
+
+    common->device_feature_select = 0;
+    uint32_t features_low = common->device_feature;
+    common->device_feature_select = 1;
+    uint32_t features_high = common->device_feature;
+    if (!(features_high & (1u << (VIRTIO_F_VERSION_1 - 32)))) {
+        common->device_status = VIRTIO_STATUS_FAILED;
+        return 0;
+    }
+    uint32_t accept = features_low & ((1u << VIRTIO_BLK_F_FLUSH) | (1u << VIRTIO_RING_F_EVENT_IDX));
+    common->driver_feature_select = 0;
+    common->driver_feature = accept;
+    common->driver_feature_select = 1;
+    common->driver_feature = 1u << (VIRTIO_F_VERSION_1 - 32);
+    common->device_status |= VIRTIO_STATUS_FEATURES_OK;
+    if (!(common->device_status & VIRTIO_STATUS_FEATURES_OK)) {
+        common->device_status = VIRTIO_STATUS_FAILED;
+        return 0;
+    }
+    vb->event_idx = (accept >> VIRTIO_RING_F_EVENT_IDX) & 1;
+    *has_flush = (accept >> VIRTIO_BLK_F_FLUSH) & 1;
+
+    common->queue_select = 0;
+    uint16_t size = common->queue_size;
+    if (size == 0) {
+        common->device_status = VIRTIO_STATUS_FAILED;
+        return 0;
+    }
+    vb->size = size < VIRTIO_QUEUE_SIZE ? size : VIRTIO_QUEUE_SIZE;
+    vb->desc = queue_desc[n];
+    vb->avail = &queue_avail[n];
+    vb->used = &queue_used[n];
+    vb->headers = req_headers[n];
+    vb->status = req_status[n];
+    vb->requests = req_chains[n];
+    vb->used_event = &vb->avail->ring[vb->size];
+    vb->avail_event = (volatile uint16_t*)&vb->used->ring[vb->size];
+    for (uint16_t i = 0; i < vb->size; i++) {
+        vb->desc[i].next = i + 1;
+        vb->requests[i] = NULL;
+    }
+    vb->avail->flags = 0;
+    vb->avail->idx = 0;
+    *vb->used_event = 0;
+    vb->used->flags = 0;
+    vb->used->idx = 0;
+    *vb->avail_event = 0;
+    vb->free_head = 0;
+    vb->free_count = vb->size;
+    vb->avail_idx = 0;
+    vb->last_used = 0;
+    vb->pending = 0;
+    vb->failed = 0;
+    vb->stall = 0;
+    vb->broken = 0;
+
+    common->queue_size = vb->size;
+    common->queue_desc_lo = (uint32_t)(uint64_t)vb->desc;
+    common->queue_desc_hi = (uint32_t)((uint64_t)vb->desc >> 32);
+    common->queue_driver_lo = (uint32_t)(uint64_t)vb->avail;
+    common->queue_driver_hi = (uint32_t)((uint64_t)vb->avail >> 32);
+    common->queue_device_lo = (uint32_t)(uint64_t)vb->used;
+    common->queue_device_hi = (uint32_t)((uint64_t)vb->used >> 32);
+    vb->notify = (volatile uint16_t*)(notify_base + common->queue_notify_off * notify_multiplier);
+    common->queue_enable = 1;
+    common->device_status |= VIRTIO_STATUS_DRIVER_OK;
+    return vb->capacity[0] | (uint64_t)vb->capacity[1] << 32;
+}
+
+int virtio_blk_init(void) {
+    pci_device_t* pci;
+    for (uint32_t i = 0; (pci = pci_get(i)) && device_count < VIRTIO_BLK_MAX_DEVICES; i++) {
+        if (pci->vendor_id != VIRTIO_PCI_VENDOR ||
+            (pci->device_id != VIRTIO_PCI_BLK_LEGACY && pci->device_id != VIRTIO_PCI_BLK_MODERN)) {
+            continue;
+        }
+        pci_enable(pci);
+        virtio_blk_t* vb = &devices[device_count];
+        int has_flush = 0;
+        uint64_t sectors = device_setup(vb, pci, device_count, &has_flush);
+        if (!sectors) {
+            continue;
+        }
+
+        block_device_t* dev = &virtio_devs[device_count];
+        dev->name = virtio_names[device_count];
+        dev->sector_count = sectors;
+        dev->read = NULL;
+        dev->write = NULL;
+        dev->driver_data = vb;
+        dev->flush = has_flush ? virtio_flush : NULL;
+        dev->start = virtio_start;
+        dev->poll = virtio_poll;
+        device_count++;
+        block_register(dev);
+        dev->irq = pci->irq_line < PIC_IRQ_COUNT && irq_register(pci->irq_line, virtio_blk_irq) == 0;
+    }
+    return device_count;
+}
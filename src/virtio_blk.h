@@ -0,0 +1,122 @@
+#ifndef VIRTIO_BLK_H
+#define VIRTIO_BLK_H
+
+#include "stdint.h"
+#include "block.h"
+
+// Идентификаторы virtio-blk в PCI: переходное и современное устройство
+#define VIRTIO_PCI_VENDOR        0x1AF4
+#define VIRTIO_PCI_BLK_LEGACY    0x1001
+#define VIRTIO_PCI_BLK_MODERN    0x1042
+
+// Capability с расположением структур virtio (тип в cfg_type)
+#define VIRTIO_PCI_CAP_ID        0x09
+#define VIRTIO_PCI_CAP_COMMON    1
+#define VIRTIO_PCI_CAP_NOTIFY    2
+#define VIRTIO_PCI_CAP_ISR       3
+#define VIRTIO_PCI_CAP_DEVICE    4
+
+// Биты состояния устройства
+#define VIRTIO_STATUS_ACKNOWLEDGE 0x01
+#define VIRTIO_STATUS_DRIVER      0x02
+#define VIRTIO_STATUS_DRIVER_OK   0x04
+#define VIRTIO_STATUS_FEATURES_OK 0x08
+#define VIRTIO_STATUS_FAILED      0x80
+
+// Возможности (номера битов)
+#define VIRTIO_BLK_F_FLUSH       9
+#define VIRTIO_RING_F_EVENT_IDX  29
+#define VIRTIO_F_VERSION_1       32
+
+// Флаги дескриптора
+#define VIRTQ_DESC_F_NEXT  1
+#define VIRTQ_DESC_F_WRITE 2   // Буфер заполняет устройство
+// Устройство просит не уведомлять его (без VIRTIO_RING_F_EVENT_IDX)
+#define VIRTQ_USED_F_NO_NOTIFY 1
+
+// Типы запросов virtio-blk
+#define VIRTIO_BLK_T_IN    0
+#define VIRTIO_BLK_T_OUT   1
+#define VIRTIO_BLK_T_FLUSH 4
+
+// Размер очереди (не больше того, что предлагает устройство). Цепочка
+// блочного уровня занимает дескриптор на каждый запрос и еще два.
+#define VIRTIO_QUEUE_SIZE 256
+// Максимум обслуживаемых устройств
+#define VIRTIO_BLK_MAX_DEVICES 2
+
+// Общая конфигурация современного устройства
+typedef volatile struct {
+    uint32_t device_feature_select;
+    uint32_t device_feature;
+    uint32_t driver_feature_select;
+    uint32_t driver_feature;
+    uint16_t msix_config;
+    uint16_t num_queues;
+    uint8_t device_status;
+    uint8_t config_generation;
+    uint16_t queue_select;
+    uint16_t queue_size;
+    uint16_t queue_msix_vector;
+    uint16_t queue_enable;
+    uint16_t queue_notify_off;
+    // 64-битные адреса пишутся половинами: устройство может не принимать
+    // обращения шире 32 бит
+    uint32_t queue_desc_lo;
+    uint32_t queue_desc_hi;
+    uint32_t queue_driver_lo;
+    uint32_t queue_driver_hi;
+    uint32_t queue_device_lo;
+    uint32_t queue_device_hi;
+} virtio_pci_common_t;
+
+// Дескриптор буфера
+typedef struct {
+    uint64_t addr;
+    uint32_t len;
+    uint16_t flags;
+    uint16_t next;
+} virtq_desc_t;
+
+// Кольцо доступных запросов (от драйвера). За ring[размер очереди]
+// лежит used_event: устройству нужно прерывание, когда индекс
+// выполненных запросов перейдет через это значение.
+typedef struct {
+    uint16_t flags;
+    volatile uint16_t idx;
+    uint16_t ring[VIRTIO_QUEUE_SIZE + 1];
+} virtq_avail_t;
+
+typedef struct {
+    uint32_t id;       // Первый дескриптор выполненной цепочки
+    uint32_t len;
+} virtq_used_elem_t;
+
+// Кольцо выполненных запросов (от устройства). За ring[размер очереди]
+// лежит avail_event: драйверу нужно уведомлять устройство, когда индекс
+// доступных запросов перейдет через это значение.
+typedef struct {
+    uint16_t flags;
+    volatile uint16_t idx;
+    virtq_used_elem_t ring[VIRTIO_QUEUE_SIZE + 1];
+} virtq_used_t;
+
+// Заголовок запроса virtio-blk
+typedef struct {
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t sector;
+} virtio_blk_req_t;
+
+// Поиск устройств virtio-blk среди найденных pci_init функций и
+// регистрация их как блочных устройств "vda", "vdb". Драйвер асинхронный:
+// цепочки очереди блочного уровня, выданные между опросами, уходят
+// устройству пачкой с одним уведомлением. Возвращает количество устройств.
+int virtio_blk_init(void);
+
+// Обработчик прерывания (линия PCI подключается в virtio_blk_init):
+// подтверждает прерывание и будит ожидающих (block_irq), выполненные
+// запросы разбирает block_poll
+void virtio_blk_irq(void);
+
+#endif
@@ -0,0 +1,502 @@
+// fsck.foxfs - проверка и восстановление тома FoxFS в образе диска.
+//
+//   fsck.foxfs [-r] <образ>
+//
+// Проверка не использует код ядра: метаданные тома (суперблок, inode,
+// экстенты, битовая карта, хеши блоков) читаются в память, поверх них
+// накладываются зафиксированные транзакции журнала, после чего
+// проверяются ссылки и согласованность. Найденные ошибки исправляются
+// в памяти; на диск исправления пишутся только с ключом -r.
+//
+// Код завершения как у e2fsck: 0 - ошибок нет, 1 - ошибки исправлены,
+// 4 - ошибки остались, 8 - образ не удалось прочитать.
+
+#include "fs.h"
+#include "host_io.h"
+
+#define FSCK_OK 0
+#define FSCK_FIXED 1
+#define FSCK_ERRORS 4
+#define FSCK_FAILED 8
+
+// Метаданные тома: сектора с FS_SUPERBLOCK_SECTOR по журнал
+static uint8_t meta[FS_META_SECTORS * BLOCK_SECTOR_SIZE];
+// Сектора метаданных, отличающиеся от диска
+static uint8_t meta_changed[FS_META_SECTORS];
+static uint8_t journal[FS_JOURNAL_SECTORS * BLOCK_SECTOR_SIZE];
+
+#define SUPERBLOCK ((superblock_t*)meta)
+#define INODE(i) ((fs_disk_inode_t*)(meta + (FS_INODE_START_SECTOR - FS_SUPERBLOCK_SECTOR + (i)) * BLOCK_SECTOR_SIZE))
+#define EXTENTS ((fs_disk_extent_t*)(meta + (FS_EXTENT_START_SECTOR - FS_SUPERBLOCK_SECTOR) * BLOCK_SECTOR_SIZE))
+#define BITMAP ((uint32_t*)(meta + (FS_BITMAP_START_SECTOR - FS_SUPERBLOCK_SECTOR) * BLOCK_SECTOR_SIZE))
+#define HASHES ((uint32_t*)(meta + (FS_HASH_START_SECTOR - FS_SUPERBLOCK_SECTOR) * BLOCK_SECTOR_SIZE))
+
+// Владелец экстента (-1 - свободен) и число ссылок на блок
+static int32_t extent_owner[FS_MAX_EXTENTS];
+static uint32_t block_refs[FS_MAX_BLOCKS];
+
+static uint32_t file_count;
+static uint32_t errors = 0;
+static uint32_t journal_next_seq = 0;  // Номер после наложенных транзакций
+static int journal_header_bad = 0;
+
+static void mark_changed(const void* ptr) {
+    meta_changed[((const uint8_t*)ptr - meta) / BLOCK_SECTOR_SIZE] = 1;
+}
+
+static int names_equal(const char* a, const char* b) {
+    while (*a && *a == *b) {
+        a++;
+        b++;
+    }
+    return *a == *b;
+}
+
+// Имя вида "#<индекс>" для inode без корректного имени или родителя
+static void lost_name(fs_disk_inode_t* in, uint32_t index) {
+    char digits[12];
+    uint32_t len = 0;
+    do {
+        digits[len++] = '0' + index % 10;
+        index /= 10;
+    } while (index);
+    uint32_t pos = 0;
+    in->name[pos++] = '#';
+    while (len) {
+        in->name[pos++] = digits[--len];
+    }
+    in->name[pos] = 0;
+}
+
+static void problem(uint32_t index, const char* what) {
+    printf("fsck.foxfs: inode %u (%s): %s\n", index, INODE(index)->name, what);
+    errors++;
+}
+
+// Та же контрольная сумма, что у журнала в src/fs.c (продолжается с hash)
+static uint32_t journal_checksum(uint32_t hash, const uint8_t* data, uint32_t size) {
+    for (uint32_t i = 0; i < size; i++) {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Наложение полностью записанных транзакций журнала на метаданные,
+// как это делает journal_replay при монтировании. Транзакция - цепочка
+// дескрипторов с образами и одна запись фиксации после них.
+static void journal_apply(void) {
+    const fs_journal_header_t* hdr = (const fs_journal_header_t*)journal;
+    if (hdr->magic != FS_JOURNAL_MAGIC) {
+        printf("fsck.foxfs: journal header is invalid\n");
+        errors++;
+        journal_header_bad = 1;
+        journal_next_seq = 1;
+        return;
+    }
+    uint32_t seq = hdr->sequence;
+    uint32_t pos = 1;
+    uint32_t applied = 0;
+    while (pos < FS_JOURNAL_SECTORS) {
+        uint32_t start = pos;
+        uint32_t count = 0;
+        uint32_t checksum = 2166136261u;
+        int complete = 0;
+        while (pos < FS_JOURNAL_SECTORS) {
+            const fs_journal_desc_t* desc = (const fs_journal_desc_t*)(journal + pos * BLOCK_SECTOR_SIZE);
+            uint32_t n = desc->count;
+            if (desc->magic == FS_JOURNAL_DESC_MAGIC && desc->sequence == seq &&
+                n != 0 && n <= FS_JOURNAL_DESC_LBAS && pos + n + 2 <= FS_JOURNAL_SECTORS) {
+                checksum = journal_checksum(checksum, journal + (pos + 1) * BLOCK_SECTOR_SIZE,
+                                            n * BLOCK_SECTOR_SIZE);
+                count += n;
+                pos += n + 1;
+                continue;
+            }
+            const fs_journal_commit_t* commit = (const fs_journal_commit_t*)desc;
+            complete = count && commit->magic == FS_JOURNAL_COMMIT_MAGIC &&
+                       commit->sequence == seq && commit->count == count &&
+                       commit->checksum == checksum;
+            break;
+        }
+        if (!complete) {
+            break;
+        }
+        for (uint32_t at = start; at < pos;) {
+            const fs_journal_desc_t* desc = (const fs_journal_desc_t*)(journal + at * BLOCK_SECTOR_SIZE);
+            const uint8_t* images = journal + (at + 1) * BLOCK_SECTOR_SIZE;
+            for (uint32_t i = 0; i < desc->count; i++) {
+                uint32_t lba = desc->lba[i];
+                if (lba < FS_SUPERBLOCK_SECTOR || lba >= FS_JOURNAL_START_SECTOR) {
+                    continue;
+                }
+                uint8_t* dst = meta + (lba - FS_SUPERBLOCK_SECTOR) * BLOCK_SECTOR_SIZE;
+                for (uint32_t j = 0; j < BLOCK_SECTOR_SIZE; j++) {
+                    dst[j] = images[i * BLOCK_SECTOR_SIZE + j];
+                }
+                meta_changed[lba - FS_SUPERBLOCK_SECTOR] = 1;
+            }
+            at += desc->count + 1;
+        }
+        pos++;
+        seq++;
+        applied++;
+    }
+    journal_next_seq = applied ? seq : 0;
+    if (applied) {
+        printf("fsck.foxfs: %u committed journal transactions applied\n", applied);
+    }
+}
+
+static int superblock_valid(void) {
+    const superblock_t* sb = SUPERBLOCK;
+    return sb->magic == FS_MAGIC && sb->version == FS_VERSION &&
+           sb->file_count != 0 && sb->file_count <= MAX_FILES &&
+           sb->inode_start_sector == FS_INODE_START_SECTOR &&
+           sb->extent_start_sector == FS_EXTENT_START_SECTOR &&
+           sb->bitmap_start_sector == FS_BITMAP_START_SECTOR &&
+           sb->first_data_sector == FS_DATA_START_SECTOR &&
+           sb->block_count == FS_MAX_BLOCKS &&
+           sb->journal_start_sector == FS_JOURNAL_START_SECTOR &&
+           sb->journal_sectors == FS_JOURNAL_SECTORS &&
+           sb->hash_start_sector == FS_HASH_START_SECTOR;
+}
+
+// Обрезка списка экстентов inode после экстента prev (-1 - весь список)
+static void chain_cut(fs_disk_inode_t* in, int32_t prev) {
+    if (prev == -1) {
+        in->first_extent = -1;
+        mark_changed(in);
+    } else {
+        EXTENTS[prev].next = -1;
+        mark_changed(&EXTENTS[prev]);
+    }
+}
+
+// Проверка списка экстентов файла: индексы, границы, пересечения с другими
+// файлами, длины кластеров сжатого файла, размер и число блоков
+static void check_extents(uint32_t index) {
+    fs_disk_inode_t* in = INODE(index);
+    int compressed = (in->flags & FS_FILE_COMPRESSED) != 0;
+    uint32_t blocks = 0;
+    uint32_t bytes = 0;
+    int32_t prev = -1;
+    int32_t e = in->first_extent;
+    while (e != -1) {
+        if (e < 0 || e >= FS_MAX_EXTENTS) {
+            problem(index, "extent index out of range, list truncated");
+            chain_cut(in, prev);
+            break;
+        }
+        fs_disk_extent_t* ex = &EXTENTS[e];
+        if (extent_owner[e] != -1) {
+            problem(index, extent_owner[e] == (int32_t)index ?
+                    "extent list loops, list truncated" :
+                    "extent shared with another inode, list truncated");
+            chain_cut(in, prev);
+            break;
+        }
+        if (ex->count == 0 || ex->start >= FS_MAX_BLOCKS || ex->count > FS_MAX_BLOCKS - ex->start) {
+            problem(index, "extent outside the data area, list truncated");
+            chain_cut(in, prev);
+            break;
+        }
+        if (compressed) {
+            uint32_t raw = FS_EXTENT_RAW_LEN(ex->info);
+            uint32_t packed = FS_EXTENT_PACKED_LEN(ex->info);
+            if (raw == 0 || raw > FS_CLUSTER_SIZE || packed == 0 ||
+                packed > ex->count * FS_BLOCK_SIZE ||
+                (!(ex->info & FS_EXTENT_COMPRESSED) && packed != raw)) {
+                problem(index, "cluster lengths are invalid, list truncated");
+                chain_cut(in, prev);
+                break;
+            }
+            bytes += raw;
+        }
+        extent_owner[e] = index;
+        for (uint32_t b = ex->start; b < ex->start + ex->count; b++) {
+            block_refs[b]++;
+        }
+        blocks += ex->count;
+        prev = e;
+        e = ex->next;
+    }
+
+    if (in->block_count != blocks) {
+        problem(index, "block count does not match extents, fixed");
+        in->block_count = blocks;
+        mark_changed(in);
+    }
+    uint32_t limit = compressed ? bytes : blocks * FS_BLOCK_SIZE;
+    if (compressed ? in->size != bytes : in->size > limit) {
+        problem(index, "size does not match data, fixed");
+        in->size = limit;
+        mark_changed(in);
+    }
+}
+
+// Проверка inode по отдельности. Возвращает 0, если inode свободен.
+static int check_inode(uint32_t index) {
+    fs_disk_inode_t* in = INODE(index);
+    if (in->type == FILE_TYPE_NONE) {
+        return 0;
+    }
+    if (index == 0 && in->type != FILE_TYPE_DIR) {
+        problem(index, "root is not a directory, fixed");
+        in->type = FILE_TYPE_DIR;
+        mark_changed(in);
+    }
+    if (in->type != FILE_TYPE_FILE && in->type != FILE_TYPE_DIR) {
+        problem(index, "unknown type, inode cleared");
+        in->type = FILE_TYPE_NONE;
+        in->name[0] = 0;
+        in->generation++;
+        mark_changed(in);
+        return 0;
+    }
+
+    // Имя: завершено нулем, без '/', пустое только у корня
+    uint32_t len = 0;
+    while (len < MAX_FILENAME && in->name[len]) {
+        len++;
+    }
+    int bad_name = len == MAX_FILENAME || (index != 0 && len == 0);
+    for (uint32_t i = 0; i < len && !bad_name; i++) {
+        bad_name = in->name[i] == '/';
+    }
+    if (bad_name) {
+        in->name[MAX_FILENAME - 1] = 0;
+        problem(index, "invalid name, renamed");
+        lost_name(in, index);
+        mark_changed(in);
+    }
+
+    if (in->flags & ~FS_FILE_COMPRESSED) {
+        problem(index, "unknown flags, cleared");
+        in->flags &= FS_FILE_COMPRESSED;
+        mark_changed(in);
+    }
+    if (in->type == FILE_TYPE_DIR && (in->first_extent != -1 || in->size || in->flags)) {
+        problem(index, "directory has data, released");
+        in->first_extent = -1;
+        in->size = 0;
+        in->flags = 0;
+        mark_changed(in);
+    }
+    check_extents(index);
+    return 1;
+}
+
+static int is_dir(uint32_t index) {
+    return index < file_count && INODE(index)->type == FILE_TYPE_DIR;
+}
+
+// Проверка дерева: у каждого inode родитель - директория, и цепочка
+// родителей доходит до корня. Иначе inode переносится в корень.
+static void check_tree(void) {
+    for (uint32_t i = 1; i < file_count; i++) {
+        fs_disk_inode_t* in = INODE(i);
+        if (in->type == FILE_TYPE_NONE) {
+            continue;
+        }
+        uint32_t node = i;
+        uint32_t steps = 0;
+        while (node != 0 && is_dir(INODE(node)->parent_index) && ++steps <= file_count) {
+            node = INODE(node)->parent_index;
+        }
+        if (node != 0) {
+            problem(i, "not reachable from root, moved to /");
+            in->parent_index = 0;
+            lost_name(in, i);
+            mark_changed(in);
+        }
+    }
+}
+
+// Повторяющиеся имена в одной директории
+#define NAME_BUCKETS 8192
+static int32_t name_buckets[NAME_BUCKETS];
+static int32_t name_next[MAX_FILES];
+
+static uint32_t name_hash(uint32_t parent, const char* name) {
+    uint32_t hash = 2166136261u ^ parent;
+    while (*name) {
+        hash ^= (uint8_t)*name++;
+        hash *= 16777619u;
+    }
+    return hash & (NAME_BUCKETS - 1);
+}
+
+static void check_names(void) {
+    for (uint32_t i = 0; i < NAME_BUCKETS; i++) {
+        name_buckets[i] = -1;
+    }
+    for (uint32_t i = 1; i < file_count; i++) {
+        fs_disk_inode_t* in = INODE(i);
+        if (in->type == FILE_TYPE_NONE) {
+            continue;
+        }
+        uint32_t bucket = name_hash(in->parent_index, in->name);
+        for (int32_t j = name_buckets[bucket]; j != -1; j = name_next[j]) {
+            if (INODE(j)->parent_index == in->parent_index && names_equal(INODE(j)->name, in->name)) {
+                problem(i, "duplicate name in directory, renamed");
+                lost_name(in, i);
+                mark_changed(in);
+                bucket = name_hash(in->parent_index, in->name);
+                break;
+            }
+        }
+        name_next[i] = name_buckets[bucket];
+        name_buckets[bucket] = i;
+    }
+}
+
+// Битовая карта должна совпадать с множеством блоков, на которые
+// ссылаются экстенты; хеш содержимого хранится только у занятых блоков
+static void check_bitmap(void) {
+    uint32_t leaked = 0;
+    uint32_t unmarked = 0;
+    uint32_t stale_hashes = 0;
+    uint32_t* bitmap = BITMAP;
+    uint32_t* hashes = HASHES;
+    for (uint32_t b = 0; b < FS_MAX_BLOCKS; b++) {
+        int used = (bitmap[b / 32] >> (b % 32)) & 1;
+        if (block_refs[b] && !used) {
+            bitmap[b / 32] |= 1u << (b % 32);
+            mark_changed(&bitmap[b / 32]);
+            unmarked++;
+        } else if (!block_refs[b] && used) {
+            bitmap[b / 32] &= ~(1u << (b % 32));
+            mark_changed(&bitmap[b / 32]);
+            leaked++;
+        }
+        if (!block_refs[b] && hashes[b]) {
+            hashes[b] = 0;
+            mark_changed(&hashes[b]);
+            stale_hashes++;
+        }
+    }
+    if (unmarked) {
+        printf("fsck.foxfs: %u blocks in use are marked free, fixed\n", unmarked);
+        errors++;
+    }
+    if (leaked) {
+        printf("fsck.foxfs: %u unreferenced blocks are marked used, freed\n", leaked);
+        errors++;
+    }
+    if (stale_hashes) {
+        printf("fsck.foxfs: %u free blocks have content hashes, cleared\n", stale_hashes);
+        errors++;
+    }
+}
+
+// Запись исправлений: сначала метаданные на место, затем заголовок
+// журнала, чтобы наложенные транзакции не воспроизводились повторно.
+// Снимок состояния (fs_mount_image) после исправлений устаревает.
+static int write_back(int fd, unsigned long long image_size) {
+    int changed = 0;
+    for (uint32_t s = 0; s < FS_META_SECTORS; s++) {
+        changed |= meta_changed[s];
+    }
+    static uint8_t zero[BLOCK_SECTOR_SIZE];
+    if (changed && image_size >= (unsigned long long)FS_IMAGE_END_SECTOR * BLOCK_SECTOR_SIZE &&
+        host_image_write(fd, (unsigned long long)FS_SNAPSHOT_START_SECTOR * BLOCK_SECTOR_SIZE,
+                         zero, BLOCK_SECTOR_SIZE) < 0) {
+        return -1;
+    }
+    for (uint32_t s = 0; s < FS_META_SECTORS; s++) {
+        if (meta_changed[s] &&
+            host_image_write(fd, (unsigned long long)(FS_SUPERBLOCK_SECTOR + s) * BLOCK_SECTOR_SIZE,
+                             meta + s * BLOCK_SECTOR_SIZE, BLOCK_SECTOR_SIZE) < 0) {
+            return -1;
+        }
+    }
+    if (journal_next_seq) {
+        static uint8_t header[BLOCK_SECTOR_SIZE * 2];
+        fs_journal_header_t* hdr = (fs_journal_header_t*)header;
+        hdr->magic = FS_JOURNAL_MAGIC;
+        hdr->sequence = journal_next_seq;
+        // Вместе с заголовком затирается первый дескриптор, если журнал
+        // был поврежден и его содержимое не разобрано
+        uint32_t sectors = journal_header_bad ? 2 : 1;
+        if (host_image_write(fd, (unsigned long long)FS_JOURNAL_START_SECTOR * BLOCK_SECTOR_SIZE,
+                             header, sectors * BLOCK_SECTOR_SIZE) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    int repair = 0;
+    int arg = 1;
+    if (arg < argc && names_equal(argv[arg], "-r")) {
+        repair = 1;
+        arg++;
+    }
+    if (argc - arg != 1) {
+        printf("usage: fsck.foxfs [-r] <image>\n");
+        return FSCK_FAILED;
+    }
+    const char* image = argv[arg];
+
+    unsigned long long image_size;
+    int fd = host_image_open(image, repair, &image_size);
+    if (fd < 0) {
+        printf("fsck.foxfs: %s: %s\n", image, host_error());
+        return FSCK_FAILED;
+    }
+    if (image_size < (unsigned long long)FS_END_SECTOR * BLOCK_SECTOR_SIZE ||
+        host_image_read(fd, (unsigned long long)FS_SUPERBLOCK_SECTOR * BLOCK_SECTOR_SIZE,
+                        meta, sizeof(meta)) < 0 ||
+        host_image_read(fd, (unsigned long long)FS_JOURNAL_START_SECTOR * BLOCK_SECTOR_SIZE,
+                        journal, sizeof(journal)) < 0) {
+        printf("fsck.foxfs: %s: image too small or unreadable\n", image);
+        return FSCK_FAILED;
+    }
+
+    journal_apply();
+    if (!superblock_valid()) {
+        printf("fsck.foxfs: %s: no valid FoxFS superblock\n", image);
+        return FSCK_FAILED;
+    }
+    file_count = SUPERBLOCK->file_count;
+
+    for (uint32_t e = 0; e < FS_MAX_EXTENTS; e++) {
+        extent_owner[e] = -1;
+    }
+    for (uint32_t b = 0; b < FS_MAX_BLOCKS; b++) {
+        block_refs[b] = 0;
+    }
+    uint32_t files = 0;
+    uint32_t dirs = 0;
+    for (uint32_t i = 0; i < file_count; i++) {
+        if (check_inode(i) && i != 0) {
+            INODE(i)->type == FILE_TYPE_DIR ? dirs++ : files++;
+        }
+    }
+    check_tree();
+    check_names();
+    check_bitmap();
+
+    uint32_t used = 0;
+    for (uint32_t b = 0; b < FS_MAX_BLOCKS; b++) {
+        used += block_refs[b] != 0;
+    }
+    printf("fsck.foxfs: %s: %u files, %u directories, %u of %u blocks used\n",
+           image, files, dirs, used, FS_MAX_BLOCKS);
+
+    int status = FSCK_OK;
+    if (repair) {
+        if (write_back(fd, image_size) < 0) {
+            printf("fsck.foxfs: %s: %s\n", image, host_error());
+            return FSCK_FAILED;
+        }
+        status = errors ? FSCK_FIXED : FSCK_OK;
+    } else if (errors) {
+        printf("fsck.foxfs: %s: %u errors found, run with -r to repair\n", image, errors);
+        status = FSCK_ERRORS;
+    }
+    host_image_close(fd);
+    return status;
+}
@@ -0,0 +1,143 @@
+// Доступ к файлам хоста для утилит FoxFS (см. host_io.h)
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "host_io.h"
+
+int host_image_open(const char* path, int writable, unsigned long long* size) {
+    int fd = open(path, writable ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return -1;
+    }
+    *size = st.st_size;
+    return fd;
+}
+
+int host_image_read(int fd, unsigned long long offset, void* buffer, unsigned int size) {
+    unsigned int done = 0;
+    while (done < size) {
+        ssize_t n = pread(fd, (char*)buffer + done, size - done, offset + done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return -1;
+        }
+        if (n == 0) {
+            // За концом образа - нули, как у незаписанных секторов
+            memset((char*)buffer + done, 0, size - done);
+            break;
+        }
+        done += n;
+    }
+    return 0;
+}
+
+int host_image_write(int fd, unsigned long long offset, const void* buffer, unsigned int size) {
+    unsigned int done = 0;
+    while (done < size) {
+        ssize_t n = pwrite(fd, (const char*)buffer + done, size - done, offset + done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        done += n;
+    }
+    return 0;
+}
+
+int host_image_resize(int fd, unsigned long long size) {
+    return ftruncate(fd, size);
+}
+
+void host_image_close(int fd) {
+    close(fd);
+}
+
+int host_stat(const char* path, unsigned long long* size) {
+    struct stat st;
+    if (stat(path, &st) < 0) {
+        return -1;
+    }
+    *size = st.st_size;
+    if (S_ISDIR(st.st_mode)) {
+        return HOST_DIR;
+    }
+    return S_ISREG(st.st_mode) ? HOST_FILE : HOST_OTHER;
+}
+
+int host_read_file(const char* path, unsigned char* buffer, unsigned int size) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    int result = host_image_read(fd, 0, buffer, size);
+    close(fd);
+    return result;
+}
+
+static int compare_names(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+int host_list_dir(const char* path, char*** names) {
+    DIR* dir = opendir(path);
+    if (!dir) {
+        return -1;
+    }
+    int count = 0;
+    int capacity = 16;
+    char** list = malloc(capacity * sizeof(char*));
+    struct dirent* entry = NULL;
+    while (list && (entry = readdir(dir))) {
+        if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, "..")) {
+            continue;
+        }
+        if (count == capacity) {
+            capacity *= 2;
+            char** grown = realloc(list, capacity * sizeof(char*));
+            if (!grown) {
+                break;
+            }
+            list = grown;
+        }
+        list[count] = strdup(entry->d_name);
+        if (!list[count]) {
+            break;
+        }
+        count++;
+    }
+    int failed = !list || entry != NULL;
+    closedir(dir);
+    if (failed) {
+        host_free_names(list, count);
+        return -1;
+    }
+    qsort(list, count, sizeof(char*), compare_names);
+    *names = list;
+    return count;
+}
+
+void host_free_names(char** names, int count) {
+    for (int i = 0; i < count; i++) {
+        free(names[i]);
+    }
+    free(names);
+}
+
+const char* host_error(void) {
+    return strerror(errno);
+}
@@ -0,0 +1,37 @@
+#ifndef HOST_IO_H
+#define HOST_IO_H
+
+// Доступ к файлам хоста для утилит FoxFS. Утилиты собираются вместе
+// с src/stdint.h, который конфликтует с заголовками libc, поэтому
+// системные заголовки подключает только host_io.c, а здесь используются
+// лишь встроенные типы C.
+
+// Вид объекта на хосте (host_stat)
+#define HOST_OTHER 0
+#define HOST_FILE  1
+#define HOST_DIR   2
+
+int printf(const char* format, ...);
+void* malloc(unsigned long size);
+void free(void* ptr);
+
+// Образ диска. Смещения и размеры в байтах, функции возвращают -1 при ошибке.
+int host_image_open(const char* path, int writable, unsigned long long* size);
+int host_image_read(int fd, unsigned long long offset, void* buffer, unsigned int size);
+int host_image_write(int fd, unsigned long long offset, const void* buffer, unsigned int size);
+int host_image_resize(int fd, unsigned long long size);
+void host_image_close(int fd);
+
+// Вид объекта по пути (с переходом по символьным ссылкам) и размер файла
+int host_stat(const char* path, unsigned long long* size);
+// Чтение файла хоста целиком, size - ожидаемый размер
+int host_read_file(const char* path, unsigned char* buffer, unsigned int size);
+// Имена в каталоге без "." и "..", отсортированные для воспроизводимого
+// образа. Возвращает количество имен или -1; список освобождает host_free_names.
+int host_list_dir(const char* path, char*** names);
+void host_free_names(char** names, int count);
+
+// Текст последней ошибки libc
+const char* host_error(void);
+
+#endif
@@ -0,0 +1,185 @@
+// mkfs.foxfs - создание тома FoxFS в образе диска из дерева каталогов хоста.
+//
+//   mkfs.foxfs [-c] <образ> [каталог]
+//
+// Том размещается в образе по разметке из src/fs.h (с сектора
+// FS_SUPERBLOCK_SECTOR), остальные сектора образа не меняются, поэтому
+// утилиту можно запускать по уже собранному os-image.bin. Прежний том
+// затирается. Файлы пишутся кодом файловой системы ядра (src/fs.c),
+// собранным компилятором хоста; -c включает сжатие при записи.
+// После тома записывается снимок состояния для fs_mount_image.
+
+#include "fs.h"
+#include "bcache.h"
+#include "host_io.h"
+
+// Строковые функции из src/fs.c
+int strcmp(const char* s1, const char* s2);
+uint32_t strlen(const char* str);
+
+static int image_fd = -1;
+
+static int image_read(block_device_t* dev, uint64_t lba, uint32_t count, void* buffer) {
+    return host_image_read(image_fd, lba * BLOCK_SECTOR_SIZE, buffer, count * BLOCK_SECTOR_SIZE);
+}
+
+static int image_write(block_device_t* dev, uint64_t lba, uint32_t count, const void* buffer) {
+    return host_image_write(image_fd, lba * BLOCK_SECTOR_SIZE, buffer, count * BLOCK_SECTOR_SIZE);
+}
+
+static block_device_t image_dev = { "image", 0, image_read, image_write, NULL, NULL, NULL, NULL, 0 };
+
+static uint32_t files_added = 0;
+static uint32_t dirs_added = 0;
+
+// Склейка пути: out = dir + "/" + name, -1 если не помещается
+static int join_path(char* out, uint32_t size, const char* dir, const char* name) {
+    uint32_t len = 0;
+    for (const char* p = dir; *p; p++) {
+        if (len + 1 >= size) return -1;
+        out[len++] = *p;
+    }
+    if (len == 0 || out[len - 1] != '/') {
+        if (len + 1 >= size) return -1;
+        out[len++] = '/';
+    }
+    for (const char* p = name; *p; p++) {
+        if (len + 1 >= size) return -1;
+        out[len++] = *p;
+    }
+    out[len] = 0;
+    return 0;
+}
+
+// Копирование файла хоста в том
+static int add_file(const char* host_path, const char* fs_path, unsigned long long size) {
+    if (size > (unsigned long long)FS_MAX_BLOCKS * FS_BLOCK_SIZE) {
+        printf("mkfs.foxfs: %s: file too large\n", host_path);
+        return -1;
+    }
+    uint8_t* data = malloc(size ? size : 1);
+    if (!data || host_read_file(host_path, data, size) < 0) {
+        printf("mkfs.foxfs: %s: %s\n", host_path, host_error());
+        free(data);
+        return -1;
+    }
+    int result = fs_create(fs_path);
+    if (result >= 0 && size) {
+        result = fs_write(fs_path, data, size);
+    }
+    free(data);
+    if (result < 0) {
+        printf("mkfs.foxfs: %s: no space left on volume\n", fs_path);
+        return -1;
+    }
+    files_added++;
+    return 0;
+}
+
+// Рекурсивное копирование содержимого каталога хоста в каталог тома
+static int add_tree(const char* host_dir, const char* fs_dir) {
+    char** names;
+    int count = host_list_dir(host_dir, &names);
+    if (count < 0) {
+        printf("mkfs.foxfs: %s: %s\n", host_dir, host_error());
+        return -1;
+    }
+
+    int result = 0;
+    char host_path[4096];
+    char fs_path[MAX_FILENAME * 2];
+    for (int i = 0; i < count && result == 0; i++) {
+        if (strlen(names[i]) >= MAX_FILENAME ||
+            join_path(host_path, sizeof(host_path), host_dir, names[i]) < 0 ||
+            join_path(fs_path, sizeof(fs_path), fs_dir, names[i]) < 0) {
+            printf("mkfs.foxfs: %s/%s: name too long\n", host_dir, names[i]);
+            result = -1;
+            break;
+        }
+
+        unsigned long long size;
+        int kind = host_stat(host_path, &size);
+        if (kind == HOST_DIR) {
+            if (fs_mkdir(fs_path) < 0) {
+                printf("mkfs.foxfs: %s: cannot create directory\n", fs_path);
+                result = -1;
+            } else {
+                dirs_added++;
+                result = add_tree(host_path, fs_path);
+            }
+        } else if (kind == HOST_FILE) {
+            result = add_file(host_path, fs_path, size);
+        } else if (kind < 0) {
+            printf("mkfs.foxfs: %s: %s\n", host_path, host_error());
+            result = -1;
+        } else {
+            printf("mkfs.foxfs: %s: not a regular file, skipped\n", host_path);
+        }
+    }
+    host_free_names(names, count);
+    return result;
+}
+
+int main(int argc, char** argv) {
+    int compress = 0;
+    int arg = 1;
+    if (arg < argc && strcmp(argv[arg], "-c") == 0) {
+        compress = 1;
+        arg++;
+    }
+    if (argc - arg < 1 || argc - arg > 2) {
+        printf("usage: mkfs.foxfs [-c] <image> [directory]\n");
+        return 2;
+    }
+    const char* image = argv[arg];
+    const char* source = argc - arg == 2 ? argv[arg + 1] : NULL;
+
+    unsigned long long image_size;
+    image_fd = host_image_open(image, 1, &image_size);
+    if (image_fd < 0) {
+        printf("mkfs.foxfs: %s: %s\n", image, host_error());
+        return 1;
+    }
+    // Образ дополняется нулями до конца тома и снимка состояния
+    uint64_t sectors = image_size / BLOCK_SECTOR_SIZE;
+    if (sectors < FS_IMAGE_END_SECTOR) {
+        if (host_image_resize(image_fd, (unsigned long long)FS_IMAGE_END_SECTOR * BLOCK_SECTOR_SIZE) < 0) {
+            printf("mkfs.foxfs: %s: %s\n", image, host_error());
+            return 1;
+        }
+        sectors = FS_IMAGE_END_SECTOR;
+    }
+    image_dev.sector_count = sectors;
+
+    // Затираем суперблок и заголовок журнала, чтобы fs_mount
+    // не подхватил прежний том, а отформатировал новый
+    static uint8_t zero[BLOCK_SECTOR_SIZE];
+    if (image_write(&image_dev, FS_SUPERBLOCK_SECTOR, 1, zero) < 0 ||
+        image_write(&image_dev, FS_JOURNAL_START_SECTOR, 1, zero) < 0) {
+        printf("mkfs.foxfs: %s: %s\n", image, host_error());
+        return 1;
+    }
+
+    bcache_init();
+    fs_init();
+    if (fs_mount(&image_dev) < 0) {
+        printf("mkfs.foxfs: %s: cannot format volume\n", image);
+        return 1;
+    }
+    fs_set_compression(compress);
+    if (source && add_tree(source, "/") < 0) {
+        return 1;
+    }
+    // Снимок состояния позволяет ядру смонтировать образ из памяти без разбора
+    if (fs_write_snapshot() < 0) {
+        printf("mkfs.foxfs: %s: write failed\n", image);
+        return 1;
+    }
+
+    fs_stats_t stats;
+    fs_get_stats(&stats);
+    printf("mkfs.foxfs: %s: %u files, %u directories, %u of %u blocks used\n",
+           image, files_added, dirs_added, FS_MAX_BLOCKS - stats.blocks_free, FS_MAX_BLOCKS);
+    host_image_close(image_fd);
+    return 0;
+}
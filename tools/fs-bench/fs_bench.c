@@ -0,0 +1,432 @@
+// Бенчмарк и дифференциальный фаззер FoxFS, собираемые компилятором хоста
+// (make fs-bench). Файловая система работает поверх RAM-диска ядра.
+//
+// Каждая строка вывода - отдельный JSON-объект:
+//   {"bench":"create","files":1000,"depth":4,"ops":1000,"ns":...,"ops_per_sec":...,"dev_requests":...}
+//   {"fuzz":"ok","seed":1,"ops":20000}
+// При расхождении с эталонной моделью фаззер печатает "fuzz":"fail"
+// с номером операции и завершается с кодом 1.
+//
+// Системные заголовки не подключаются: src/stdint.h конфликтует с libc,
+// поэтому нужные функции libc объявлены вручную.
+
+#include "fs.h"
+#include "bcache.h"
+#include "ramdisk.h"
+
+int printf(const char* format, ...);
+int snprintf(char* buffer, unsigned long size, const char* format, ...);
+int atoi(const char* s);
+void exit(int code);
+
+struct host_timespec {
+    long tv_sec;
+    long tv_nsec;
+};
+int clock_gettime(int clock, struct host_timespec* ts);
+#define HOST_CLOCK_MONOTONIC 1
+
+static uint64_t now_ns(void) {
+    struct host_timespec ts;
+    clock_gettime(HOST_CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Устройство-обертка над RAM-диском со счетчиками запросов
+static block_device_t* ram;
+static uint64_t dev_reads, dev_writes;
+
+static int count_read(block_device_t* dev, uint64_t lba, uint32_t count, void* buffer) {
+    dev_reads++;
+    return block_read(ram, lba, count, buffer);
+}
+
+static int count_write(block_device_t* dev, uint64_t lba, uint32_t count, const void* buffer) {
+    dev_writes++;
+    return block_write(ram, lba, count, buffer);
+}
+
+static block_device_t bench_dev = { "bench", 0, count_read, count_write, NULL, NULL, NULL, NULL, 0 };
+
+// Пустой том на чистом RAM-диске
+static void fresh_volume(void) {
+    ram = ramdisk_init(FS_SUPERBLOCK_SECTOR, FS_END_SECTOR);
+    bench_dev.sector_count = FS_END_SECTOR;
+    block_register(&bench_dev);
+    bcache_init();
+    if (fs_mount(&bench_dev) < 0) {
+        printf("{\"error\":\"mount failed\"}\n");
+        exit(1);
+    }
+}
+
+static void report(const char* op, uint32_t files, uint32_t depth, uint32_t ops,
+                   uint64_t ns, uint64_t requests) {
+    uint64_t rate = ns ? (uint64_t)ops * 1000000000ull / ns : 0;
+    printf("{\"bench\":\"%s\",\"files\":%u,\"depth\":%u,\"ops\":%u,\"ns\":%llu,"
+           "\"ops_per_sec\":%llu,\"dev_requests\":%llu}\n",
+           op, files, depth, ops, (unsigned long long)ns,
+           (unsigned long long)rate, (unsigned long long)requests);
+}
+
+// Путь к каталогу глубины depth: /d0/d1/...
+static void dir_path(char* out, uint32_t size, uint32_t depth) {
+    uint32_t len = 0;
+    out[0] = 0;
+    for (uint32_t i = 0; i < depth; i++) {
+        len += snprintf(out + len, size - len, "/d%u", i);
+    }
+}
+
+static char paths[MAX_FILES][MAX_FILENAME];
+
+static void bench_metadata(uint32_t files, uint32_t depth) {
+    fresh_volume();
+    char dir[MAX_FILENAME];
+    for (uint32_t d = 1; d <= depth; d++) {
+        dir_path(dir, sizeof(dir), d);
+        fs_mkdir(dir);
+    }
+    dir_path(dir, sizeof(dir), depth);
+    for (uint32_t i = 0; i < files; i++) {
+        snprintf(paths[i], MAX_FILENAME, "%s/file_%u.txt", dir, i);
+    }
+
+    uint64_t w = dev_writes;
+    uint64_t t = now_ns();
+    for (uint32_t i = 0; i < files; i++) {
+        if (fs_create(paths[i]) < 0) {
+            printf("{\"error\":\"create failed\",\"path\":\"%s\"}\n", paths[i]);
+            exit(1);
+        }
+    }
+    fs_commit();
+    report("create", files, depth, files, now_ns() - t, dev_writes - w);
+
+    uint32_t rounds = 100000 / files + 1;
+    t = now_ns();
+    for (uint32_t r = 0; r < rounds; r++) {
+        for (uint32_t i = 0; i < files; i++) {
+            if (fs_parse_path(paths[i]) < 0) {
+                printf("{\"error\":\"lookup failed\",\"path\":\"%s\"}\n", paths[i]);
+                exit(1);
+            }
+        }
+    }
+    report("lookup", files, depth, rounds * files, now_ns() - t, 0);
+
+    static char list[64 * 1024];
+    dir_path(dir, sizeof(dir), depth);
+    rounds = 10000 / files + 1;
+    t = now_ns();
+    for (uint32_t r = 0; r < rounds; r++) {
+        fs_list_dir(dir[0] ? dir : "/", list, sizeof(list));
+    }
+    report("list", files, depth, rounds, now_ns() - t, 0);
+
+    w = dev_writes;
+    t = now_ns();
+    for (uint32_t i = 0; i < files; i++) {
+        fs_delete_file(paths[i]);
+    }
+    fs_commit();
+    report("delete", files, depth, files, now_ns() - t, dev_writes - w);
+}
+
+static uint8_t data[512 * 1024];
+static uint8_t back[512 * 1024];
+
+// Пропускная способность записи и чтения одного файла (ops - байты)
+static void bench_io(const char* name, uint32_t size, int compress) {
+    fresh_volume();
+    fs_set_compression(compress);
+    const char* text = "2024-01-01 12:00:00 foxos[1]: request served in 3 ms\n";
+    for (uint32_t i = 0; i < size; i++) {
+        data[i] = compress ? text[i % 53] : (uint8_t)(i * 2654435761u >> 13);
+    }
+    fs_create("/io");
+
+    uint64_t w = dev_writes;
+    uint64_t t = now_ns();
+    fs_write("/io", data, size);
+    fs_save();
+    char op[32];
+    snprintf(op, sizeof(op), "write_%s", name);
+    report(op, 1, 1, size, now_ns() - t, dev_writes - w);
+
+    // Чтение с холодным кэшем
+    bcache_init();
+    uint64_t r = dev_reads;
+    t = now_ns();
+    fs_read("/io", back, size);
+    snprintf(op, sizeof(op), "read_%s", name);
+    report(op, 1, 1, size, now_ns() - t, dev_reads - r);
+
+    // Последовательное чтение через дескриптор по блоку, с холодным кэшем
+    bcache_init();
+    int fd = fs_open("/io", FS_O_READ);
+    r = dev_reads;
+    t = now_ns();
+    while (fs_fread(fd, back, FS_BLOCK_SIZE) > 0) {
+    }
+    fs_close(fd);
+    snprintf(op, sizeof(op), "fread_%s", name);
+    report(op, 1, 1, size, now_ns() - t, dev_reads - r);
+    fs_set_compression(0);
+
+    // Дозапись через дескриптор малыми порциями
+    fd = fs_open("/log", FS_O_WRITE | FS_O_APPEND | FS_O_CREATE);
+    w = dev_writes;
+    t = now_ns();
+    for (uint32_t done = 0; done < size; done += 64) {
+        fs_fwrite(fd, data + done, 64);
+    }
+    fs_close(fd);
+    fs_save();
+    snprintf(op, sizeof(op), "append_%s", name);
+    report(op, 1, 1, size, now_ns() - t, dev_writes - w);
+}
+
+// ---- Дифференциальный фаззер ----
+
+#define MODEL_MAX 96
+#define MODEL_DATA 12288
+
+typedef struct {
+    int alive;
+    int parent;             // Индекс в модели, -1 для корня
+    file_type_t type;
+    char path[MAX_FILENAME];
+    uint32_t size;
+    uint8_t data[MODEL_DATA];
+} model_entry_t;
+
+static model_entry_t model[MODEL_MAX];
+static uint64_t rng_state;
+static uint32_t fuzz_op;
+static uint32_t fuzz_seed;
+
+static uint32_t rnd(uint32_t n) {
+    rng_state = rng_state * 6364136223846793005ull + 1442695040888963407ull;
+    return (uint32_t)(rng_state >> 33) % n;
+}
+
+static void fail(const char* what, const char* path) {
+    printf("{\"fuzz\":\"fail\",\"seed\":%u,\"op\":%u,\"check\":\"%s\",\"path\":\"%s\"}\n",
+           fuzz_seed, fuzz_op, what, path);
+    exit(1);
+}
+
+static int model_lookup(int parent, const char* name, char* path) {
+    if (parent < 0) {
+        snprintf(path, MAX_FILENAME, "/%s", name);
+    } else {
+        snprintf(path, MAX_FILENAME, "%s/%s", model[parent].path, name);
+    }
+    for (int i = 0; i < MODEL_MAX; i++) {
+        if (model[i].alive && model[i].parent == parent) {
+            int j = 0;
+            while (model[i].path[j] && model[i].path[j] == path[j]) {
+                j++;
+            }
+            if (!model[i].path[j] && !path[j]) {
+                return i;
+            }
+        }
+    }
+    return -1;
+}
+
+static int model_children(int dir) {
+    int n = 0;
+    for (int i = 0; i < MODEL_MAX; i++) {
+        n += model[i].alive && model[i].parent == dir;
+    }
+    return n;
+}
+
+static int random_entry(file_type_t type) {
+    int start = rnd(MODEL_MAX);
+    for (int k = 0; k < MODEL_MAX; k++) {
+        int i = (start + k) % MODEL_MAX;
+        if (model[i].alive && model[i].type == type) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void check_file(int i) {
+    static uint8_t buf[MODEL_DATA];
+    if (fs_read(model[i].path, buf, MODEL_DATA) != (int)model[i].size) {
+        fail("read_size", model[i].path);
+    }
+    for (uint32_t j = 0; j < model[i].size; j++) {
+        if (buf[j] != model[i].data[j]) {
+            fail("read_data", model[i].path);
+        }
+    }
+}
+
+static void fill_random(uint8_t* out, uint32_t size) {
+    // Смесь повторяющихся и случайных данных, чтобы работали сжатие и дедупликация
+    uint32_t mode = rnd(3);
+    for (uint32_t i = 0; i < size; i++) {
+        out[i] = mode == 0 ? rnd(256) : mode == 1 ? "abcdefgh"[i % 8] : (i / 512) & 1;
+    }
+}
+
+static void fuzz(uint32_t seed, uint32_t ops) {
+    static const char* names[] = {
+        "a", "b", "c", "etc", "config.txt", "very_long_configuration_name", "very_long_configuration_nam2"
+    };
+    static uint8_t tmp[MODEL_DATA];
+    fresh_volume();
+    rng_state = seed;
+    fuzz_seed = seed;
+    for (int i = 0; i < MODEL_MAX; i++) {
+        model[i].alive = 0;
+    }
+
+    for (fuzz_op = 0; fuzz_op < ops; fuzz_op++) {
+        uint32_t op = rnd(12);
+        int parent = rnd(3) ? random_entry(FILE_TYPE_DIR) : -1;
+        const char* name = names[rnd(7)];
+        char path[MAX_FILENAME];
+
+        if (op <= 1) {
+            // Создание файла или директории
+            int existing = model_lookup(parent, name, path);
+            int slot = -1;
+            for (int i = 0; i < MODEL_MAX && slot < 0; i++) {
+                if (!model[i].alive) {
+                    slot = i;
+                }
+            }
+            if (slot < 0) {
+                continue;
+            }
+            int r = op == 0 ? fs_create(path) : fs_mkdir(path);
+            if ((r >= 0) != (existing < 0)) {
+                fail(op == 0 ? "create" : "mkdir", path);
+            }
+            if (r >= 0) {
+                model[slot].alive = 1;
+                model[slot].parent = parent;
+                model[slot].type = op == 0 ? FILE_TYPE_FILE : FILE_TYPE_DIR;
+                model[slot].size = 0;
+                snprintf(model[slot].path, MAX_FILENAME, "%s", path);
+            }
+        } else if (op == 2) {
+            // Удаление
+            int i = rnd(2) ? random_entry(FILE_TYPE_FILE) : random_entry(FILE_TYPE_DIR);
+            if (i < 0) {
+                continue;
+            }
+            int expect = model[i].type == FILE_TYPE_FILE || model_children(i) == 0;
+            if ((fs_delete_file(model[i].path) == 0) != expect) {
+                fail("delete", model[i].path);
+            }
+            if (expect) {
+                model[i].alive = 0;
+            }
+        } else if (op <= 4) {
+            // Перезапись файла целиком
+            int i = random_entry(FILE_TYPE_FILE);
+            if (i < 0) {
+                continue;
+            }
+            uint32_t size = rnd(MODEL_DATA);
+            fill_random(model[i].data, size);
+            model[i].size = size;
+            if (fs_write(model[i].path, model[i].data, size) != (int)size) {
+                fail("write", model[i].path);
+            }
+        } else if (op <= 6) {
+            // Запись с позиции или дозапись через дескриптор
+            int i = random_entry(FILE_TYPE_FILE);
+            if (i < 0) {
+                continue;
+            }
+            int append = rnd(2);
+            uint32_t offset = append ? model[i].size : rnd(model[i].size + 512);
+            uint32_t size = rnd(2048);
+            if (offset + size > MODEL_DATA) {
+                continue;
+            }
+            fill_random(tmp, size);
+            int fd = fs_open(model[i].path, FS_O_WRITE | (append ? FS_O_APPEND : 0));
+            int r = append ? fs_fwrite(fd, tmp, size) : fs_pwrite(fd, tmp, size, offset);
+            fs_close(fd);
+            if (r != (int)size) {
+                fail("pwrite", model[i].path);
+            }
+            if (size) {
+                for (uint32_t j = model[i].size; j < offset; j++) {
+                    model[i].data[j] = 0;
+                }
+                for (uint32_t j = 0; j < size; j++) {
+                    model[i].data[offset + j] = tmp[j];
+                }
+                if (offset + size > model[i].size) {
+                    model[i].size = offset + size;
+                }
+            }
+        } else if (op <= 8) {
+            int i = random_entry(FILE_TYPE_FILE);
+            if (i >= 0) {
+                check_file(i);
+            }
+        } else if (op == 9) {
+            // Содержимое директории и поиск отсутствующего имени
+            static char list[64 * 1024];
+            int i = random_entry(FILE_TYPE_DIR);
+            const char* dir = i < 0 ? "/" : model[i].path;
+            if (fs_list_dir(dir, list, sizeof(list)) != model_children(i)) {
+                fail("list", dir);
+            }
+            if (model_lookup(i, name, path) < 0 && fs_parse_path(path) >= 0) {
+                fail("lookup_absent", path);
+            }
+        } else if (op == 10) {
+            fs_set_compression(rnd(2));
+        } else if (rnd(8) == 0) {
+            // Сохранение и повторное монтирование с холодным кэшем
+            if (fs_save() < 0) {
+                fail("save", "/");
+            }
+            bcache_init();
+            if (fs_mount(&bench_dev) < 0) {
+                fail("remount", "/");
+            }
+            for (int i = 0; i < MODEL_MAX; i++) {
+                if (model[i].alive && model[i].type == FILE_TYPE_FILE) {
+                    check_file(i);
+                }
+            }
+        }
+    }
+    fs_set_compression(0);
+    printf("{\"fuzz\":\"ok\",\"seed\":%u,\"ops\":%u}\n", seed, ops);
+}
+
+// Аргументы: [число итераций фаззера] [начальное зерно]
+int main(int argc, char** argv) {
+    uint32_t fuzz_ops = argc > 1 ? (uint32_t)atoi(argv[1]) : 20000;
+    uint32_t seed = argc > 2 ? (uint32_t)atoi(argv[2]) : 1;
+
+    static const uint32_t counts[] = { 10, 100, 1000, 4000 };
+    static const uint32_t depths[] = { 0, 4, 16 };
+    for (uint32_t c = 0; c < 4; c++) {
+        for (uint32_t d = 0; d < 3; d++) {
+            bench_metadata(counts[c], depths[d]);
+        }
+    }
+    bench_io("plain", sizeof(data), 0);
+    bench_io("compressible", sizeof(data), 1);
+
+    for (uint32_t s = seed; s < seed + 4; s++) {
+        fuzz(s, fuzz_ops);
+    }
+    return 0;
+}
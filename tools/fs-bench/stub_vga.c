@@ -0,0 +1,16 @@
+// Заглушка VGA для сборки файловой системы на хосте
+#include "vga.h"
+
+void vga_init(void) {}
+void vga_clear(void) {}
+void vga_putchar(char c) { (void)c; }
+void vga_puts(const char* str) { (void)str; }
+void vga_write(const char* str) { (void)str; }
+void vga_set_color(uint8_t foreground, uint8_t background) { (void)foreground; (void)background; }
+void vga_set_cursor(int x, int y) { (void)x; (void)y; }
+void vga_get_cursor(int* x, int* y) { *x = 0; *y = 0; }
+void vga_put_entry(int x, int y, char c) { (void)x; (void)y; (void)c; }
+void vga_printf(const char* format, ...) { (void)format; }
+void vga_put_dec(int64_t num) { (void)num; }
+void vga_put_hex(uint64_t num) { (void)num; }
+void vga_put_bin(uint64_t num) { (void)num; }